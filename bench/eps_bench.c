@@ -0,0 +1,795 @@
+/**
+ * @file eps_bench.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Non-interactive benchmarks of the datalogger and the EPS thread against the simulated P31u.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Runs in a scratch directory and needs neither root nor a board:
+ *
+ *     make bench && build/eps_bench.out [-n records] [-l latency_us] [-f fault_ppm] [-t seconds] [-d dir] [-v]
+ *
+ * Syscall and byte counts come from /proc/self/io and cover the whole
+ * process, including the datalogger thread and its debug prints (to
+ * /dev/null unless -v is given). The records of the datalogger runs are
+ * read back, directly and through dlgr_export_next, and compared with those
+ * generated; the benchmark exits with 1 if any differ.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#define _GNU_SOURCE  // nftw()
+#define MAIN_PRIVATE // datalogger_t, dlgr_thread and dlgr_destroy
+#include <main.h>
+#undef MAIN_PRIVATE
+#include "eps.h"
+#include "eps_decode.h"
+#include "eps_iface.h"
+#include "eps_stats.h"
+#include "latency.h"
+#include "p31u_sim.h"
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef NO_LATENCY_STATS
+#error "eps_bench reports latencies; build it without NO_LATENCY_STATS"
+#endif
+
+int sys_boot_count = 0;
+volatile sig_atomic_t done = 0;
+__thread int sys_status;
+
+// main.c is not linked in; the workers of the EPS thread start with default attributes.
+int main_start_worker(pthread_t *thread, void *(*exec)(void *), void *arg)
+{
+    return pthread_create(thread, NULL, exec, arg);
+}
+
+#define BENCH_RECORDS 20000      // records per dlgr_LogData run, see: -n
+#define BENCH_SYNC_RECORDS 2000  // records of the run that syncs after every record
+#define BENCH_RETRIEVE_CALLS 200 // dlgr_RetrieveData calls per run
+#define BENCH_RETRIEVE_LOGS 50   // records per dlgr_RetrieveData call
+#define BENCH_DECODE_LOGS 1000   // records decoded per eps_decode_hk call
+#define BENCH_DECODE_CALLS 2000  // eps_decode_hk calls
+#define BENCH_VERIFY_LOGS 5000   // newest records compared with the generated ones, see: bench_verify
+#define BENCH_EXPORT_MTU 1024    // bytes per dlgr_export_next frame
+#define BENCH_STATS_SAMPLES 1000000 // eps_stats_update calls
+#define BENCH_STATS_WINDOW_MS 1000  // summary window of the eps_thread run
+#define BENCH_LATENCY_US 500     // simulated I2C transaction, see: -l
+#define BENCH_SECONDS 5          // eps_thread run, see: -t
+
+/**
+ * @brief Process-wide I/O counters, from /proc/self/io.
+ *
+ */
+typedef struct
+{
+    uint64_t rchar; // Bytes read.
+    uint64_t wchar; // Bytes written.
+    uint64_t syscr; // read-like syscalls.
+    uint64_t syscw; // write-like syscalls.
+} bench_io_t;
+
+static int bench_io(bench_io_t *io)
+{
+    memset(io, 0x0, sizeof(bench_io_t));
+
+    FILE *fp = fopen("/proc/self/io", "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    char key[32];
+    unsigned long long value;
+    while (fscanf(fp, "%31[^:]: %llu\n", key, &value) == 2)
+    {
+        if (strcmp(key, "rchar") == 0)
+            io->rchar = value;
+        else if (strcmp(key, "wchar") == 0)
+            io->wchar = value;
+        else if (strcmp(key, "syscr") == 0)
+            io->syscr = value;
+        else if (strcmp(key, "syscw") == 0)
+            io->syscw = value;
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+/**
+ * @brief The scratch directory made by mkdtemp when -d names none, removed at exit.
+ *
+ */
+static char bench_scratch[] = "/tmp/eps_bench.XXXXXX";
+static int bench_scratch_made = 0;
+
+static int bench_remove_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    remove(path);
+    return 0;
+}
+
+/**
+ * @brief Removes the scratch directory and every log in it.
+ *
+ */
+static void bench_remove_scratch()
+{
+    if (bench_scratch_made)
+    {
+        nftw(bench_scratch, bench_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+static void bench_io_diff(const bench_io_t *before, bench_io_t *after)
+{
+    after->rchar -= before->rchar;
+    after->wchar -= before->wchar;
+    after->syscr -= before->syscr;
+    after->syscw -= before->syscw;
+}
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Bytes in a module's .dat files.
+ *
+ */
+static uint64_t bench_dat_bytes(const char *moduleName)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "log/%s", moduleName);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t bytes = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        const char *ext = strrchr(entry->d_name, '.');
+        struct stat st;
+        if (ext != NULL && strcmp(ext, ".dat") == 0 && fstatat(dirfd(dir), entry->d_name, &st, 0) == 0)
+        {
+            bytes += st.st_size;
+        }
+    }
+
+    closedir(dir);
+    return bytes;
+}
+
+/**
+ * @brief Waits until the datalogger thread has written or failed every record it accepted.
+ *
+ */
+static void bench_drain(char *moduleName)
+{
+    dlgr_queue_stats_t stats;
+    while (dlgr_GetQueueStats(moduleName, &stats) > 0 && stats.written + stats.writeErrors < stats.enqueued)
+    {
+        pthread_cond_signal(dlgr_wakeup);
+        usleep(1000);
+    }
+}
+
+static void bench_print_lat(const char *what, lat_hist_t *hist)
+{
+    lat_summary_t lat;
+    lat_summarize(hist, &lat);
+    printf("    %-24s p50 %9.1f us  p99 %9.1f us  max %9.1f us  (%llu calls, %llu errors)\n", what, lat.p50_ns / 1e3,
+           lat.p99_ns / 1e3, lat.max_ns / 1e3, (unsigned long long)lat.count, (unsigned long long)lat.errors);
+}
+
+/**
+ * @brief Logs records of simulated housekeeping as fast as the datalogger takes them.
+ *
+ * @param moduleName A module name not registered yet.
+ * @param batch Records per write, see: dlgr_SetBatching.
+ * @param keyframe See: dlgr_SetCompression.
+ * @param syncEvery Records per fdatasync.
+ * @param numRecords Records to log.
+ * @param generated Output, the numRecords records logged, oldest first.
+ */
+static void bench_log(char *moduleName, int batch, int keyframe, int syncEvery, int numRecords, eps_hk_t *generated)
+{
+    static lat_hist_t lat;
+    memset(&lat, 0x0, sizeof(lat));
+
+    dlgr_handle_t handle = dlgr_init(moduleName, sizeof(eps_hk_t), DLGR_SCHEMA_EPS_HK);
+    if (handle < 0)
+    {
+        printf("  %s: dlgr_init failed: %d\n", moduleName, handle);
+        return;
+    }
+    dlgr_SetBatching(moduleName, batch, 10);
+    dlgr_SetCompression(moduleName, keyframe);
+    if (syncEvery > 1)
+    {
+        dlgr_SetSyncPolicy(moduleName, DLGR_SYNC_COUNT, syncEvery);
+    }
+
+    eps_hk_t hk;
+    uint64_t full = 0;
+    bench_io_t before, io;
+
+    bench_io(&before);
+    uint64_t start = bench_now_ns();
+
+    for (int i = 0; i < numRecords; i++)
+    {
+        eps_p31u_get_hk(NULL, &hk);
+        memcpy(&generated[i], &hk, sizeof(eps_hk_t));
+        for (;;)
+        {
+            LAT_START(t0);
+            int retval = dlgr_LogDataH(handle, sizeof(eps_hk_t), &hk);
+            LAT_RECORD(&lat, t0, retval < 0 && retval != ERR_QUEUE_FULL);
+            if (retval != ERR_QUEUE_FULL)
+            {
+                break;
+            }
+            // The ring is full; the record is retried once the writer catches up.
+            full++;
+            usleep(50);
+        }
+    }
+
+    bench_drain(moduleName);
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_io(&io);
+    bench_io_diff(&before, &io);
+
+    uint64_t disk = bench_dat_bytes(moduleName);
+    printf("  %s (batch %d, %s, sync every %d)\n", moduleName, batch, keyframe > 0 ? "compressed" : "plain", syncEvery);
+    printf("    %-24s %9.0f records/s end to end, %llu enqueue retries\n", "throughput", numRecords / (elapsed / 1e9),
+           (unsigned long long)full);
+    bench_print_lat("dlgr_LogData", &lat);
+    printf("    %-24s %9.2f write syscalls/record, %9.1f bytes/record written, %9.1f bytes/record in .dat files\n", "I/O",
+           (double)io.syscw / numRecords, (double)io.wchar / numRecords, (double)disk / numRecords);
+}
+
+/**
+ * @brief Compares the newest records retrieved from a module with those bench_log generated.
+ *
+ * @param moduleName A module logged by bench_log.
+ * @param generated The records it logged, oldest first.
+ * @param numRecords Records it logged.
+ * @param oldest Output, CLOCK_REALTIME of the oldest record compared.
+ * @return int The number of records compared, -1 if any of them differ or could not be retrieved.
+ */
+static int bench_verify(char *moduleName, const eps_hk_t *generated, int numRecords, uint64_t *oldest)
+{
+    int numLogs = numRecords < BENCH_VERIFY_LOGS ? numRecords : BENCH_VERIFY_LOGS;
+    ssize_t stride = dlgr_QueryMemorySize(moduleName, 1);
+    char *output = malloc(dlgr_QueryMemorySize(moduleName, numLogs));
+    if (output == NULL || numLogs < 1)
+    {
+        free(output);
+        return -1;
+    }
+
+    int retval = dlgr_RetrieveData(moduleName, output, numLogs);
+    int mismatches = 0;
+    for (int i = 0; i < numLogs && retval == 1; i++)
+    {
+        // Newest first, so record i is the (i + 1)-th last one generated.
+        if (memcmp(output + i * stride + DLGR_RECORD_DATA_OFFSET, &generated[numRecords - 1 - i], sizeof(eps_hk_t)) != 0)
+        {
+            mismatches++;
+        }
+    }
+
+    dlgr_timestamp_t timestamp;
+    memcpy(&timestamp, output + (numLogs - 1) * stride + FBEGIN_SIZE, sizeof(timestamp));
+    *oldest = timestamp.realtime;
+    free(output);
+
+    if (retval != 1)
+    {
+        printf("    %-24s dlgr_RetrieveData of the newest %d records failed: %d\n", "verify", numLogs, retval);
+        return -1;
+    }
+    if (mismatches > 0)
+    {
+        printf("    %-24s %d of the newest %d records differ from those logged\n", "verify", mismatches, numLogs);
+        return -1;
+    }
+    printf("    %-24s newest %d records retrieved as logged\n", "verify", numLogs);
+    return numLogs;
+}
+
+/**
+ * @brief Exports the records bench_verify compared, checks every frame and resumes the pass halfway.
+ *
+ * @param moduleName A module checked by bench_verify.
+ * @param generated The records bench_log logged, oldest first.
+ * @param numRecords Records it logged.
+ * @param numLogs Records bench_verify compared.
+ * @param tStart CLOCK_REALTIME of the oldest of them.
+ * @return int 1 if every frame is as expected and the resumed pass repeats the first one, otherwise -1.
+ */
+static int bench_export(char *moduleName, const eps_hk_t *generated, int numRecords, int numLogs, uint64_t tStart)
+{
+    // Every frame but the last holds at least one record.
+    int maxFrames = numRecords + 2;
+    int *lengths = calloc(maxFrames, sizeof(int));
+    uint16_t *crcs = calloc(maxFrames, sizeof(uint16_t));
+    char frame[BENCH_EXPORT_MTU];
+    ssize_t stride = DLGR_PACKED_STRIDE(sizeof(eps_hk_t));
+    const char *problem = NULL;
+    int numFrames = 0;
+    int exported = 0;
+
+    dlgr_export_t exp;
+    int opened = dlgr_export_open(&exp, moduleName, tStart, UINT64_MAX, BENCH_EXPORT_MTU, 0);
+    if (lengths == NULL || crcs == NULL || opened < 0)
+    {
+        problem = "dlgr_export_open failed";
+    }
+
+    while (problem == NULL)
+    {
+        int len = dlgr_export_next(&exp, frame);
+        if (len <= 0)
+        {
+            problem = len < 0 ? "dlgr_export_next failed" : NULL;
+            break;
+        }
+
+        dlgr_export_header_t header;
+        memcpy(&header, frame, sizeof(header));
+        uint16_t crc;
+        memcpy(&crc, frame + len - DLGR_EXPORT_CRC_SIZE, sizeof(crc));
+        if (numFrames == maxFrames || header.magic != DLGR_EXPORT_MAGIC || header.sequence != (uint32_t)numFrames ||
+            header.recordSize != sizeof(eps_hk_t) || len != (int)(sizeof(header) + header.numRecords * stride + DLGR_EXPORT_CRC_SIZE))
+        {
+            problem = "bad frame header";
+            break;
+        }
+        if (dlgr_crc16(frame, len - DLGR_EXPORT_CRC_SIZE) != crc)
+        {
+            problem = "bad frame CRC";
+            break;
+        }
+
+        // Packed records, newest first; a record logged in the same nanosecond as the oldest one may follow it.
+        for (int i = 0; i < header.numRecords; i++, exported++)
+        {
+            const char *data = frame + sizeof(header) + i * stride + sizeof(dlgr_timestamp_t);
+            if (exported < numLogs && memcmp(data, &generated[numRecords - 1 - exported], sizeof(eps_hk_t)) != 0)
+            {
+                problem = "records differ from those logged";
+            }
+        }
+
+        lengths[numFrames] = len;
+        crcs[numFrames++] = crc;
+        if (header.flags & DLGR_EXPORT_LAST)
+        {
+            break;
+        }
+    }
+    dlgr_export_close(&exp);
+
+    if (problem == NULL && exported < numLogs)
+    {
+        problem = "records missing";
+    }
+
+    // A pass resumed from a later frame must reproduce the rest of the first one exactly.
+    int resume = numFrames / 2;
+    if (problem == NULL && dlgr_export_open(&exp, moduleName, tStart, UINT64_MAX, BENCH_EXPORT_MTU, resume) < 0)
+    {
+        problem = "dlgr_export_open failed on resume";
+    }
+    for (int n = resume; problem == NULL; n++)
+    {
+        int len = dlgr_export_next(&exp, frame);
+        if (len == 0 && n == numFrames)
+        {
+            break;
+        }
+        uint16_t crc;
+        memcpy(&crc, frame + (len > DLGR_EXPORT_CRC_SIZE ? len - DLGR_EXPORT_CRC_SIZE : 0), sizeof(crc));
+        if (n == numFrames || len != lengths[n] || crc != crcs[n])
+        {
+            problem = "resumed pass differs";
+        }
+    }
+    dlgr_export_close(&exp);
+
+    free(lengths);
+    free(crcs);
+
+    if (problem != NULL)
+    {
+        printf("    %-24s %s after %d frames, %d records\n", "dlgr_export_next", problem, numFrames, exported);
+        return -1;
+    }
+    printf("    %-24s %d frames of at most %d bytes, %d records as logged, resumed at frame %d identically\n",
+           "dlgr_export_next", numFrames, BENCH_EXPORT_MTU, exported, resume);
+    return 1;
+}
+
+/**
+ * @brief Retrieves the newest records of a module over and over.
+ *
+ */
+static void bench_retrieve(char *moduleName)
+{
+    static lat_hist_t lat;
+    memset(&lat, 0x0, sizeof(lat));
+
+    char *output = malloc(dlgr_QueryMemorySize(moduleName, BENCH_RETRIEVE_LOGS));
+    if (output == NULL)
+    {
+        return;
+    }
+
+    uint64_t records = 0;
+    bench_io_t before, io;
+
+    bench_io(&before);
+    uint64_t start = bench_now_ns();
+
+    for (int i = 0; i < BENCH_RETRIEVE_CALLS; i++)
+    {
+        LAT_START(t0);
+        int retval = dlgr_RetrieveData(moduleName, output, BENCH_RETRIEVE_LOGS);
+        LAT_RECORD(&lat, t0, retval < 0);
+        if (retval > 0)
+        {
+            records += retval;
+        }
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_io(&io);
+    bench_io_diff(&before, &io);
+    free(output);
+
+    printf("  %s, %d records per call\n", moduleName, BENCH_RETRIEVE_LOGS);
+    printf("    %-24s %9.0f records/s\n", "throughput", records / (elapsed / 1e9));
+    bench_print_lat("dlgr_RetrieveData", &lat);
+    printf("    %-24s %9.2f read syscalls/call, %9.1f bytes/call read\n", "I/O", (double)io.syscr / BENCH_RETRIEVE_CALLS,
+           (double)io.rchar / BENCH_RETRIEVE_CALLS);
+}
+
+/**
+ * @brief Decodes the newest records of a module into columns over and over.
+ *
+ */
+static void bench_decode(char *moduleName)
+{
+    char *output = malloc(dlgr_QueryMemorySize(moduleName, BENCH_DECODE_LOGS));
+    void *columns = malloc(eps_hk_columns_size(BENCH_DECODE_LOGS));
+    int numRecords = BENCH_DECODE_LOGS;
+    if (output == NULL || columns == NULL || dlgr_RetrieveData(moduleName, output, numRecords) != 1)
+    {
+        free(output);
+        free(columns);
+        return;
+    }
+
+    eps_hk_columns_t cols;
+    eps_hk_columns_bind(&cols, columns, numRecords);
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_DECODE_CALLS; i++)
+    {
+        eps_decode_hk(output, numRecords, 0, &cols);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    // Read a result, so that the loop is not optimized away.
+    printf("  %s, %d records per call, newest vbatt %.3f V\n", moduleName, numRecords, cols.col[EPS_HK_COL_VBATT][0]);
+    printf("    %-24s %9.0f records/s, %7.1f ns/record\n", "throughput",
+           (double)numRecords * BENCH_DECODE_CALLS / (elapsed / 1e9), elapsed / ((double)numRecords * BENCH_DECODE_CALLS));
+
+    free(output);
+    free(columns);
+}
+
+/**
+ * @brief Feeds eps_stats_update samples 50 ms apart, as during a burst.
+ *
+ */
+static void bench_stats()
+{
+    eps_hk_t hk;
+    eps_stats_summary_t summary;
+    memset(&hk, 0x0, sizeof(eps_hk_t));
+    uint64_t now = bench_now_ns();
+    int closed = 0;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_STATS_SAMPLES; i++)
+    {
+        hk.vbatt = 7400 + (i & 0x3f);
+        hk.cursys = 500 + (i & 0xf);
+        hk.curout[0] = 100 + (i & 0x7);
+        closed += (eps_stats_update(EPS_DEV_DEFAULT, &hk, i % 20 == 0, now, &summary) & EPS_STATS_CLOSED) != 0;
+        now += 50000000ULL;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("  %d samples, %d windows, %zu bytes per summary\n", BENCH_STATS_SAMPLES, closed, sizeof(eps_stats_summary_t));
+    printf("    %-24s %9.0f samples/s, %7.1f ns/sample\n", "throughput", BENCH_STATS_SAMPLES / (elapsed / 1e9),
+           (double)elapsed / BENCH_STATS_SAMPLES);
+}
+
+/**
+ * @brief Runs eps_thread against the simulated P31u with shortened periods.
+ *
+ */
+static void bench_eps_thread(int seconds, pthread_t dlgr_tid)
+{
+    const char *task_names[EPS_TASK_NUM] = {"Housekeeping", "Basic housekeeping", "V/I", "Configuration", "Logging"};
+    dlgr_OpenChannels(eps_channels, EPS_NUM_CHANNELS, eps_handles);
+    if (eps_init() < 0)
+    {
+        printf("  eps_init failed\n");
+        return;
+    }
+
+    // Ten times the flight rates, so a short run sees every task many times.
+    eps_sample_policy_t policy;
+    eps_get_sample_policy(&policy, NULL);
+    policy.slow_period_ms /= 10;
+    policy.vi_period_ms /= 10;
+    policy.basic_period_ms /= 10;
+    policy.conf_period_ms /= 100;
+    for (int dev = 0; dev < EPS_DEV_NUM; dev++)
+    {
+        eps_dev_set_sample_policy(dev, &policy);
+    }
+    eps_stats_policy_t stats_policy;
+    eps_get_stats_policy(&stats_policy);
+    stats_policy.window_ms = BENCH_STATS_WINDOW_MS;
+    eps_set_stats_policy(&stats_policy);
+
+    p31u_sim_stats_t sim_before, sim;
+    bench_io_t before, io;
+    p31u_sim_get_stats(&sim_before);
+    bench_io(&before);
+    uint64_t start = bench_now_ns();
+
+    pthread_t eps_tid, wdt_tid;
+    pthread_create(&eps_tid, NULL, eps_thread, NULL);
+    pthread_create(&wdt_tid, NULL, eps_wdt_thread, NULL);
+    sleep(seconds);
+
+    // Stops all threads; the datalogger thread writes out what is queued before it exits.
+    done = 1;
+    pthread_cond_broadcast(eps_cmd_wait);
+    pthread_cond_broadcast(eps_wdt_wait);
+    pthread_cond_broadcast(dlgr_wakeup);
+    pthread_join(eps_tid, NULL);
+    pthread_join(wdt_tid, NULL);
+    pthread_join(dlgr_tid, NULL);
+
+    uint64_t elapsed = bench_now_ns() - start;
+    p31u_sim_get_stats(&sim);
+    bench_io(&io);
+    bench_io_diff(&before, &io);
+
+    uint64_t written = 0;
+    uint64_t disk = 0;
+    for (int i = 0; i < EPS_NUM_CHANNELS; i++)
+    {
+        dlgr_queue_stats_t stats;
+        if (dlgr_GetQueueStats((char *)eps_channels[i].moduleName, &stats) > 0)
+        {
+            written += stats.written;
+        }
+        disk += bench_dat_bytes(eps_channels[i].moduleName);
+    }
+
+    printf("  %d s, %d board(s), full housekeeping every %u ms, V/I every %u ms\n", seconds, EPS_DEV_NUM, policy.slow_period_ms, policy.vi_period_ms);
+    printf("    %-24s %9.0f transactions/s, %llu injected faults\n", "bus",
+           (sim.transactions - sim_before.transactions) / (elapsed / 1e9), (unsigned long long)(sim.faults - sim_before.faults));
+    for (int i = 0; i < EPS_TASK_NUM; i++)
+    {
+        eps_sched_task_stats_t stats;
+        lat_summary_t lat;
+        if (eps_get_sched_stats(i, &stats) > 0 && eps_get_task_latency(i, &lat) > 0 && stats.runs > 0)
+        {
+            printf("    %-24s %6llu runs, %4llu overruns, p50 %9.1f us  p99 %9.1f us, jitter avg %7.1f us  max %7.1f us\n",
+                   task_names[i], (unsigned long long)stats.runs, (unsigned long long)stats.overruns, lat.p50_ns / 1e3,
+                   lat.p99_ns / 1e3, stats.jitter_avg_ns / 1e3, stats.jitter_max_ns / 1e3);
+        }
+    }
+    lat_summary_t wake;
+    if (eps_get_wake_latency(&wake) > 0 && wake.count > 0)
+    {
+        printf("    %-24s p50 %9.1f us  p99 %9.1f us  max %9.1f us  (%llu sleeps)\n", "wake-up", wake.p50_ns / 1e3,
+               wake.p99_ns / 1e3, wake.max_ns / 1e3, (unsigned long long)wake.count);
+    }
+    eps_wdt_stats_t wdt;
+    lat_summary_t kick;
+    if (eps_get_wdt_stats(&wdt) > 0 && eps_get_wdt_latency(&kick) > 0 && kick.count > 0)
+    {
+        printf("    %-24s %6llu kicks, %4llu misses, p50 %9.1f us  p99 %9.1f us, late max %7.1f us, interval max %.3f s\n",
+               "watchdog", (unsigned long long)wdt.kicks, (unsigned long long)wdt.misses, kick.p50_ns / 1e3,
+               kick.p99_ns / 1e3, wdt.late_max_ns / 1e3, wdt.interval_max_ns / 1e9);
+    }
+    dlgr_queue_stats_t summaries;
+    uint32_t raised = 0;
+    for (int i = 0; i < EPS_STAT_NUM; i++)
+    {
+        eps_channel_stats_t stats;
+        if (eps_get_channel_stats(i, &stats) > 0)
+        {
+            raised += stats.raised;
+        }
+    }
+    if (dlgr_GetQueueStats((char *)EPS_LOG_STATS, &summaries) > 0)
+    {
+        printf("    %-24s %6llu summaries of %u ms, %4u alarms raised\n", "telemetry stats",
+               (unsigned long long)summaries.written, stats_policy.window_ms, raised);
+    }
+    if (written > 0)
+    {
+        printf("    %-24s %9.0f records/s logged, %9.2f write syscalls/record, %9.1f bytes/record in .dat files\n", "logging",
+               written / (elapsed / 1e9), (double)io.syscw / written, (double)disk / written);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int numRecords = BENCH_RECORDS;
+    int seconds = BENCH_SECONDS;
+    int verbose = 0;
+    char *dir = NULL;
+    p31u_sim_config_t sim = {BENCH_LATENCY_US, 0};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:f:t:d:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numRecords = atoi(optarg);
+            break;
+        case 'l':
+            sim.latency_us = atoi(optarg);
+            break;
+        case 'f':
+            sim.fault_ppm = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n records] [-l latency_us] [-f fault_ppm] [-t seconds] [-d dir] [-v]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    // Everything goes into a scratch log/ directory, removed at exit unless it was given with -d.
+    if (dir == NULL)
+    {
+        if ((dir = mkdtemp(bench_scratch)) == NULL)
+        {
+            perror("mkdtemp");
+            return -1;
+        }
+        bench_scratch_made = 1;
+        atexit(bench_remove_scratch);
+    }
+    if (chdir(dir) < 0)
+    {
+        perror("chdir");
+        return -1;
+    }
+    if (!verbose)
+    {
+        freopen("/dev/null", "w", stderr);
+    }
+
+    printf("eps_bench in %s\n", dir);
+
+    // The benchmark's own channels, then those eps_init expects registered.
+    dlgr_channel_t channels[3 + EPS_NUM_CHANNELS] = {
+        {"bench_sync", sizeof(eps_hk_t), DLGR_SCHEMA_EPS_HK},
+        {"bench_batch", sizeof(eps_hk_t), DLGR_SCHEMA_EPS_HK},
+        {"bench_compressed", sizeof(eps_hk_t), DLGR_SCHEMA_EPS_HK},
+    };
+    memcpy(&channels[3], eps_channels, sizeof(eps_channels));
+    if (dlgr_ArenaInit(channels, sizeof(channels) / sizeof(channels[0])) < 0)
+    {
+        printf("dlgr_ArenaInit failed\n");
+        return -1;
+    }
+
+    // The record generator is the simulated P31u itself, so the data compresses like housekeeping.
+    p31u eps_sim[1];
+    p31u_sim_config_t no_latency = {0, 0};
+    eps_p31u_init(eps_sim, 1, 0x1b);
+    p31u_sim_configure(&no_latency);
+
+    // Set up the log directory first, so that the channels registered below are opened as they register.
+    dlgr_Setup();
+
+    eps_hk_t *generated = malloc(sizeof(eps_hk_t) * (numRecords > 0 ? numRecords : 1));
+    if (generated == NULL)
+    {
+        printf("malloc failed\n");
+        return -1;
+    }
+
+    pthread_t dlgr_tid;
+    pthread_create(&dlgr_tid, NULL, dlgr_thread, NULL);
+
+    // Every module's records are read back and compared before the next one is logged.
+    int failures = 0;
+    uint64_t oldest;
+    int verified;
+
+    printf("dlgr_LogData, %zu-byte eps_hk_t records\n", sizeof(eps_hk_t));
+    int numSync = numRecords < BENCH_SYNC_RECORDS ? numRecords : BENCH_SYNC_RECORDS;
+    bench_log("bench_sync", 1, 0, 1, numSync, generated);
+    failures += bench_verify("bench_sync", generated, numSync, &oldest) < 0;
+    bench_log("bench_batch", EPS_LOG_BATCH, 0, 100, numRecords, generated);
+    verified = bench_verify("bench_batch", generated, numRecords, &oldest);
+    failures += verified < 0 || bench_export("bench_batch", generated, numRecords, verified, oldest) < 0;
+    bench_log("bench_compressed", EPS_LOG_BATCH, EPS_LOG_KEYFRAME, 100, numRecords, generated);
+    verified = bench_verify("bench_compressed", generated, numRecords, &oldest);
+    failures += verified < 0 || bench_export("bench_compressed", generated, numRecords, verified, oldest) < 0;
+    free(generated);
+
+    printf("dlgr_RetrieveData\n");
+    bench_retrieve("bench_batch");
+    bench_retrieve("bench_compressed");
+
+    printf("eps_decode_hk\n");
+    bench_decode("bench_batch");
+
+    printf("eps_thread, %u us per transaction, %u faults per million\n", sim.latency_us, sim.fault_ppm);
+    p31u_sim_configure(&sim);
+    bench_eps_thread(seconds, dlgr_tid);
+
+    printf("eps_stats_update\n");
+    bench_stats();
+
+    dlgr_arena_stats_t arena;
+    dlgr_GetArenaStats(&arena);
+    printf("datalogger arena: %zu of %zu bytes, %d of %d modules\n", arena.used, arena.capacity, arena.modules, arena.maxModules);
+
+    eps_destroy();
+    dlgr_destroy();
+
+    if (failures > 0)
+    {
+        printf("%d module(s) failed verification\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
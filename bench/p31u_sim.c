@@ -0,0 +1,402 @@
+/**
+ * @file p31u_sim.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Simulated P31u, linked in place of drivers/eps_p31u for benchmarks.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "p31u_sim.h"
+#include "eps_extern.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_VBATT_MV 7400      // Battery voltage the model swings around.
+#define SIM_VBATT_SWING_MV 200 // Amplitude of the orbit-period swing.
+#define SIM_ORBIT_S 5400       // Period of the swing.
+#define SIM_WDT_I2C_S 600      // I2C watchdog timeout.
+
+static pthread_mutex_t sim_m[1] = {PTHREAD_MUTEX_INITIALIZER};
+static p31u_sim_config_t sim_config = {0, 0};
+static unsigned int sim_seed = 1;
+static atomic_uint_fast64_t sim_transactions = 0;
+static atomic_uint_fast64_t sim_faults = 0;
+
+/**
+ * @brief The modelled power system.
+ *
+ */
+static eps_hk_t sim_hk;
+static eps_config_t sim_conf;
+static eps_config2_t sim_conf2;
+static struct timespec sim_start;
+static struct timespec sim_last_kick;
+
+static double sim_elapsed(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Small noise, in [-amplitude, amplitude]. Call with sim_m held.
+ *
+ */
+static int sim_noise(int amplitude)
+{
+    return (int)(rand_r(&sim_seed) % (2 * amplitude + 1)) - amplitude;
+}
+
+/**
+ * @brief Takes one transaction's time and decides whether it fails.
+ *
+ * @return int 1 on success, -1 for an injected fault.
+ */
+static int sim_xfer()
+{
+    pthread_mutex_lock(sim_m);
+    p31u_sim_config_t config = sim_config;
+    int fault = config.fault_ppm > 0 && (uint32_t)(rand_r(&sim_seed) % 1000000) < config.fault_ppm;
+    pthread_mutex_unlock(sim_m);
+
+    if (config.latency_us > 0)
+    {
+        struct timespec ts = {config.latency_us / 1000000, (config.latency_us % 1000000) * 1000L};
+        nanosleep(&ts, NULL);
+    }
+
+    atomic_fetch_add_explicit(&sim_transactions, 1, memory_order_relaxed);
+    if (fault)
+    {
+        atomic_fetch_add_explicit(&sim_faults, 1, memory_order_relaxed);
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Advances the model to now and copies its housekeeping out.
+ *
+ */
+static void sim_sample(eps_hk_t *hk)
+{
+    pthread_mutex_lock(sim_m);
+
+    double t = sim_elapsed(&sim_start);
+    double kicked = sim_elapsed(&sim_last_kick);
+
+    sim_hk.vbatt = SIM_VBATT_MV + (int)(SIM_VBATT_SWING_MV * sin(2 * M_PI * t / SIM_ORBIT_S)) + sim_noise(2);
+    for (int i = 0; i < 3; i++)
+    {
+        sim_hk.vboost[i] = 4800 + sim_noise(3);
+        sim_hk.curin[i] = 350 + sim_noise(4);
+    }
+    sim_hk.cursun = 1000 + sim_noise(5);
+    sim_hk.cursys = 600 + sim_noise(5);
+    for (int i = 0; i < 6; i++)
+    {
+        sim_hk.curout[i] = sim_hk.output[i] ? 80 + sim_noise(2) : 0;
+        sim_hk.temp[i] = 20 + (int)(5 * sin(2 * M_PI * t / SIM_ORBIT_S));
+    }
+    sim_hk.wdt_i2c_time_left = kicked < SIM_WDT_I2C_S ? (uint32_t)(SIM_WDT_I2C_S - kicked) : 0;
+    sim_hk.wdt_gnd_time_left = (uint32_t)(172800 - (uint64_t)t % 172800);
+
+    memcpy(hk, &sim_hk, sizeof(eps_hk_t));
+
+    pthread_mutex_unlock(sim_m);
+}
+
+void p31u_sim_configure(const p31u_sim_config_t *config)
+{
+    pthread_mutex_lock(sim_m);
+    sim_config = *config;
+    pthread_mutex_unlock(sim_m);
+}
+
+void p31u_sim_get_stats(p31u_sim_stats_t *stats)
+{
+    stats->transactions = atomic_load_explicit(&sim_transactions, memory_order_relaxed);
+    stats->faults = atomic_load_explicit(&sim_faults, memory_order_relaxed);
+}
+
+int eps_p31u_init(p31u *dev, int id, int addr)
+{
+    // No i2c-dev behind it; eps_xport finds no bus and leaves everything to the driver functions.
+    memset(dev, 0x0, sizeof(p31u));
+    dev->bus->fd = -1;
+
+    pthread_mutex_lock(sim_m);
+    memset(&sim_hk, 0x0, sizeof(eps_hk_t));
+    memset(sim_hk.output, 1, 6);
+    sim_hk.pptmode = 2;
+    sim_hk.battmode = 3;
+    memset(&sim_conf, 0x0, sizeof(eps_config_t));
+    sim_conf.ppt_mode = 2;
+    memset(&sim_conf2, 0x0, sizeof(eps_config2_t));
+    sim_conf2.batt_maxvoltage = 8300;
+    sim_conf2.batt_safevoltage = 6600;
+    sim_conf2.batt_criticalvoltage = 6400;
+    sim_conf2.batt_normalvoltage = 7000;
+    clock_gettime(CLOCK_MONOTONIC, &sim_start);
+    sim_last_kick = sim_start;
+    pthread_mutex_unlock(sim_m);
+
+    return 1;
+}
+
+int eps_p31u_ping(p31u *dev)
+{
+    return sim_xfer();
+}
+
+int eps_p31u_reboot(p31u *dev)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        sim_hk.counter_boot++;
+        sim_hk.bootcause = 1;
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_get_hkparam(p31u *dev, hkparam_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        eps_hk_t full;
+        sim_sample(&full);
+        eps_hk_to_hkparam(&full, hk);
+    }
+    return retval;
+}
+
+int eps_p31u_get_hk(p31u *dev, eps_hk_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        sim_sample(hk);
+    }
+    return retval;
+}
+
+int eps_p31u_get_hk_out(p31u *dev, eps_hk_out_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        eps_hk_t full;
+        sim_sample(&full);
+        eps_hk_to_hk_out(&full, hk);
+    }
+    return retval;
+}
+
+int eps_p31u_get_hk_2_vi(p31u *dev, eps_hk_vi_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        eps_hk_t full;
+        sim_sample(&full);
+        memcpy(hk->vboost, full.vboost, sizeof(hk->vboost));
+        hk->vbatt = full.vbatt;
+        memcpy(hk->curin, full.curin, sizeof(hk->curin));
+        hk->cursun = full.cursun;
+        hk->cursys = full.cursys;
+        hk->reserved1 = 0;
+    }
+    return retval;
+}
+
+int eps_p31u_get_hk_wdt(p31u *dev, eps_hk_wdt_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        eps_hk_t full;
+        sim_sample(&full);
+        hk->wdt_i2c_time_left = full.wdt_i2c_time_left;
+        hk->wdt_gnd_time_left = full.wdt_gnd_time_left;
+        memcpy(hk->wdt_csp_pings_left, full.wdt_csp_pings_left, sizeof(hk->wdt_csp_pings_left));
+        hk->counter_wdt_i2c = full.counter_wdt_i2c;
+        hk->counter_wdt_gnd = full.counter_wdt_gnd;
+        memcpy(hk->counter_wdt_csp, full.counter_wdt_csp, sizeof(hk->counter_wdt_csp));
+    }
+    return retval;
+}
+
+int eps_p31u_get_hk_2_basic(p31u *dev, eps_hk_basic_t *hk)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        eps_hk_t full;
+        sim_sample(&full);
+        hk->counter_boot = full.counter_boot;
+        memcpy(hk->temp, full.temp, sizeof(hk->temp));
+        hk->bootcause = full.bootcause;
+        hk->battmode = full.battmode;
+        hk->pptmode = full.pptmode;
+        hk->reserved2 = 0;
+    }
+    return retval;
+}
+
+int eps_p31u_tgl_lup(p31u *dev, eps_lup_idx lup)
+{
+    int retval = sim_xfer();
+    if (retval > 0 && lup >= 0 && lup < 6)
+    {
+        pthread_mutex_lock(sim_m);
+        sim_hk.output[lup] = !sim_hk.output[lup];
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_lup_set(p31u *dev, eps_lup_idx lup, int pw)
+{
+    int retval = sim_xfer();
+    if (retval > 0 && lup >= 0 && lup < 6)
+    {
+        pthread_mutex_lock(sim_m);
+        sim_hk.output[lup] = pw != 0;
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_battheater_set(p31u *dev, uint64_t tout_ms)
+{
+    return sim_xfer();
+}
+
+int eps_p31u_ks_set(p31u *dev, uint64_t tout_ms)
+{
+    return sim_xfer();
+}
+
+int eps_p31u_hardreset(p31u *dev)
+{
+    return eps_p31u_reboot(dev);
+}
+
+int eps_p31u_get_conf(p31u *dev, eps_config_t *conf)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        memcpy(conf, &sim_conf, sizeof(eps_config_t));
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_set_conf(p31u *dev, eps_config_t *conf)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        memcpy(&sim_conf, conf, sizeof(eps_config_t));
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_get_conf2(p31u *dev, eps_config2_t *conf)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        memcpy(conf, &sim_conf2, sizeof(eps_config2_t));
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_set_conf2(p31u *dev, eps_config2_t *conf)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        memcpy(&sim_conf2, conf, sizeof(eps_config2_t));
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_reset_counters(p31u *dev)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        memset(sim_hk.latchup, 0x0, sizeof(sim_hk.latchup));
+        sim_hk.counter_wdt_i2c = 0;
+        sim_hk.counter_wdt_gnd = 0;
+        memset(sim_hk.counter_wdt_csp, 0x0, sizeof(sim_hk.counter_wdt_csp));
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_set_heater(p31u *dev, unsigned char *reply, uint8_t cmd, uint8_t heater, uint8_t mode)
+{
+    int retval = sim_xfer();
+    if (retval > 0 && reply != NULL)
+    {
+        reply[0] = mode;
+        reply[1] = 0;
+    }
+    return retval;
+}
+
+int eps_p31u_set_pv_auto(p31u *dev, uint8_t mode)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        sim_hk.pptmode = mode;
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+int eps_p31u_set_pv_volt(p31u *dev, uint16_t V1, uint16_t V2, uint16_t V3)
+{
+    return sim_xfer();
+}
+
+int eps_reset_wdt(p31u *dev)
+{
+    int retval = sim_xfer();
+    if (retval > 0)
+    {
+        pthread_mutex_lock(sim_m);
+        clock_gettime(CLOCK_MONOTONIC, &sim_last_kick);
+        pthread_mutex_unlock(sim_m);
+    }
+    return retval;
+}
+
+void eps_p31u_destroy(p31u *dev)
+{
+}
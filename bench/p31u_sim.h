@@ -0,0 +1,56 @@
+/**
+ * @file p31u_sim.h
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Simulated P31u, linked in place of drivers/eps_p31u for benchmarks.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Implements the eps_p31u_* driver functions against a modelled power
+ * system instead of the I2C bus. Every call is one transaction, which takes
+ * the configured latency and fails with the configured probability.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef P31U_SIM_H
+#define P31U_SIM_H
+
+#include "eps_p31u/p31u.h"
+#include <stdint.h>
+
+/**
+ * @brief Behaviour of the simulated bus.
+ *
+ */
+typedef struct
+{
+    uint32_t latency_us; // Duration of every transaction; the caller sleeps, as in an I2C transfer.
+    uint32_t fault_ppm;  // Transactions that fail, per million.
+} p31u_sim_config_t;
+
+/**
+ * @brief Counters of the simulated bus.
+ *
+ */
+typedef struct
+{
+    uint64_t transactions; // Driver calls, failed ones included.
+    uint64_t faults;       // Injected failures.
+} p31u_sim_stats_t;
+
+/**
+ * @brief Replaces the bus behaviour; takes effect with the next transaction.
+ *
+ * @param config The new behaviour.
+ */
+void p31u_sim_configure(const p31u_sim_config_t *config);
+
+/**
+ * @brief Returns the bus counters.
+ *
+ * @param stats Output.
+ */
+void p31u_sim_get_stats(p31u_sim_stats_t *stats);
+
+#endif // P31U_SIM_H
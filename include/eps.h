@@ -17,7 +17,52 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define EPS_CMD_TIMEOUT 5
+/**
+ * @brief Where an EPS board is, see: EPS_DEVICES.
+ *
+ */
+typedef struct
+{
+    int bus;      // i2c-dev bus number.
+    uint8_t addr; // Address on the bus.
+} eps_dev_config_t;
+
+// The EPS boards, EPS_DEV_NUM of them, EPS_DEV_DEFAULT first. Benches with
+// more boards build with e.g. -DEPS_DEV_NUM=2 -DEPS_DEVICES='{{1, 0x1b}, {2, 0x1b}}'.
+#ifndef EPS_DEVICES
+#define EPS_DEVICES {{1, 0x1b}}
+#endif
+#define EPS_DEV_MAX 4 // boards with datalogger channel names, see: EPS_LOG_HK
+
+#define EPS_CMD_TIMEOUT 5 // seconds, longest wait in eps_cmd_submit
+#define EPS_CMD_SLOTS 16  // commands queued or in progress at once
 #define EPS_LOOP_TIMER 1 // seconds
+#define EPS_WDT_PERIOD_MS 1000                   // ground watchdog kicks, by eps_wdt_thread
+#define EPS_WDT_MISS_MS 2500                     // kick interval reported as a miss
+#define EPS_GND_WDT_TIMEOUT_S (48 * 3600)        // the P31u resets the bus after this long without a kick
+#define EPS_HK_PERIOD_MS (EPS_LOOP_TIMER * 1000) // housekeeping polls during a burst
+#define EPS_LOG_PERIOD_MS (EPS_LOOP_TIMER * 1000) // housekeeping records logged outside of bursts
+
+// Defaults of eps_sample_policy_t, see: eps_set_sample_policy.
+#define EPS_SLOW_PERIOD_MS 10000     // full housekeeping while quiescent
+#define EPS_VI_PERIOD_MS 1000        // voltages and currents while quiescent
+#define EPS_BASIC_PERIOD_MS 10000    // basic and watchdog housekeeping
+#define EPS_CONF_PERIOD_MS 600000    // configuration
+#define EPS_BURST_PERIOD_MS 50       // voltages and currents during a burst, 20 Hz
+#define EPS_BURST_DURATION_MS 5000   // burst length after the last trigger
+#define EPS_VBATT_DELTA_MV 100       // battery voltage change that starts a burst
+#define EPS_CURRENT_DELTA_MA 100     // current change that starts a burst
+
+// Defaults of eps_stats_policy_t, see: eps_set_stats_policy.
+#define EPS_STATS_WINDOW_MS 60000        // one EPS_LOG_STATS summary a minute
+#define EPS_STATS_TAU_MS 10000           // time constant of the averages
+#define EPS_ALARM_VBATT_LOW_MV 6800      // battery sag
+#define EPS_ALARM_VBATT_RATE_MV_S 50     // battery voltage falling or rising
+#define EPS_ALARM_CUROUT_RATE_MA_S 20    // output current creeping, e.g. ahead of a latch-up
+#define EPS_ALARM_TEMP_LOW_C -20
+#define EPS_ALARM_TEMP_HIGH_C 60
+#define EPS_LOG_BATCH 10 // housekeeping records per datalogger write
+#define EPS_LOG_MAX_DELAY_MS (EPS_LOG_BATCH * EPS_LOG_PERIOD_MS) // longest a record waits for its batch
+#define EPS_LOG_KEYFRAME 60 // housekeeping records per full (uncompressed) record
 
 #endif // EPS_H
\ No newline at end of file
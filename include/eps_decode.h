@@ -0,0 +1,84 @@
+/**
+ * @file eps_decode.h
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Bulk decoding of logged housekeeping into per-channel columns.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Turns a span of eps_hk_t records, as returned by dlgr_RetrieveData or
+ * dlgr_export_next, into one array per channel in volts, amperes and
+ * degrees Celsius, for analysis on board and on the ground. Records are
+ * converted EPS_DECODE_BLOCK at a time with GCC vector extensions, which
+ * the compiler turns into NEON or SSE/AVX instructions. Build with
+ * -DEPS_DECODE_SCALAR, or with a compiler without them, for the scalar
+ * version.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef EPS_DECODE_H
+#define EPS_DECODE_H
+
+#include "eps_extern.h"
+#include "main.h"
+#include <stdint.h>
+
+#define EPS_DECODE_BLOCK 8 // records converted by one pass of the kernels
+
+#define EPS_DECODE_PACKED 0x1 // Records without FBEGIN and FEND, as exported by dlgr_export_next.
+#define EPS_DECODE_SWAP 0x2   // Records logged on a system of the other byte order.
+
+/**
+ * @brief Columns of eps_hk_t, see: eps_hk_columns_t. Arrays take consecutive columns.
+ *
+ */
+typedef enum
+{
+    EPS_HK_COL_VBOOST = 0,  // vboost[3], V.
+    EPS_HK_COL_VBATT = 3,   // vbatt, V.
+    EPS_HK_COL_CURIN = 4,   // curin[3], A.
+    EPS_HK_COL_CURSUN = 7,  // cursun, A.
+    EPS_HK_COL_CURSYS = 8,  // cursys, A.
+    EPS_HK_COL_CUROUT = 9,  // curout[6], A.
+    EPS_HK_COL_TEMP = 15,   // temp[6], degrees Celsius.
+    EPS_HK_COL_NUM = 21
+} eps_hk_col;
+
+/**
+ * @brief Decoded housekeeping, one array per channel, see: eps_hk_columns_bind.
+ *
+ */
+typedef struct
+{
+    uint64_t *time;                // CLOCK_REALTIME of each record, in nanoseconds.
+    float *col[EPS_HK_COL_NUM];    // col[EPS_HK_COL_CUROUT + 2][i] is curout[2] of record i.
+} eps_hk_columns_t;
+
+/**
+ * @brief Bytes of the columns of numRecords records.
+ *
+ */
+size_t eps_hk_columns_size(int numRecords);
+
+/**
+ * @brief Points the columns into buf.
+ *
+ * @param cols Output.
+ * @param buf At least eps_hk_columns_size(numRecords) bytes, aligned for a uint64_t.
+ * @param numRecords Records the columns hold.
+ */
+void eps_hk_columns_bind(eps_hk_columns_t *cols, void *buf, int numRecords);
+
+/**
+ * @brief Decodes eps_hk_t records into columns.
+ *
+ * @param records numRecords records of DLGR_SCHEMA_EPS_HK, newest first as retrieved.
+ * @param numRecords Records to decode.
+ * @param flags EPS_DECODE_* bits.
+ * @param cols Columns bound for at least numRecords records; record i goes to index i.
+ * @return int The number of records decoded, -1 on invalid input.
+ */
+int eps_decode_hk(const void *records, int numRecords, int flags, eps_hk_columns_t *cols);
+
+#endif // EPS_DECODE_H
@@ -15,11 +15,440 @@
 #include <pthread.h>
 #include <stdarg.h>
 #include "eps_p31u/p31u.h"
+#include "latency.h"
 
-#ifndef EPS_H
-extern __thread pthread_cond_t eps_cmd_wait[1];
-extern __thread pthread_mutex_t eps_cmd_wait_m[1];
+#ifndef EPS_DEV_NUM
+#define EPS_DEV_NUM 1 // EPS boards, see: EPS_DEVICES in eps.h
 #endif
+#define EPS_DEV_DEFAULT 0 // The board the functions without a device argument address.
+
+/**
+ * @brief Periodic tasks of the EPS thread, each on its own grid of absolute deadlines.
+ *
+ */
+typedef enum
+{
+    EPS_TASK_HK = 0,  // Poll all housekeeping, see: eps_sample_policy_t.
+    EPS_TASK_BASIC,   // Poll basic and watchdog housekeeping into EPS_LOG_BASIC and EPS_LOG_WDT.
+    EPS_TASK_VI,      // Poll voltages and currents into EPS_LOG_VI.
+    EPS_TASK_CONF,    // Read the configuration into EPS_LOG_CONF.
+    EPS_TASK_LOG,     // Log the newest full housekeeping into EPS_LOG_HK, every EPS_LOG_PERIOD_MS.
+    EPS_TASK_NUM
+} eps_task_id;
+
+/**
+ * @brief Datalogger channels of the EPS, one per telemetry stream, each with its own record type.
+ *
+ * These are the default device's; device n > 0 logs to the same names
+ * followed by n, e.g. "eps_vi1".
+ *
+ */
+#define EPS_LOG_HK "eps"          // eps_hk_t, DLGR_SCHEMA_EPS_HK
+#define EPS_LOG_VI "eps_vi"       // eps_hk_vi_t, DLGR_SCHEMA_EPS_HK_VI
+#define EPS_LOG_WDT "eps_wdt"     // eps_hk_wdt_t, DLGR_SCHEMA_EPS_HK_WDT
+#define EPS_LOG_BASIC "eps_basic" // eps_hk_basic_t, DLGR_SCHEMA_EPS_HK_BASIC
+#define EPS_LOG_CONF "eps_conf"   // eps_config_t, DLGR_SCHEMA_EPS_CONFIG
+#define EPS_LOG_STATS "eps_stats" // eps_stats_summary_t, DLGR_SCHEMA_EPS_STATS
+
+/**
+ * @brief How the EPS thread adapts its housekeeping sampling, see: eps_set_sample_policy.
+ *
+ * Each stream is read at its own rate into its own datalogger channel:
+ * voltages and currents (eps_get_hk_2_vi) every vi_period_ms, basic and
+ * watchdog housekeeping (eps_get_hk_2_basic, eps_get_hk_wdt) every
+ * basic_period_ms, the configuration every conf_period_ms and full
+ * housekeeping (eps_get_hk) every slow_period_ms. A change of battery
+ * voltage, of any current or of a latch-up counter beyond the thresholds,
+ * a latch-up command or a telemetry alarm (see: eps_stats_policy_t), starts
+ * a burst: voltages and currents are read every burst_period_ms and full
+ * housekeeping every hk_period_ms, until burst_duration_ms pass without
+ * another trigger.
+ *
+ */
+typedef struct
+{
+    uint32_t slow_period_ms;    // Full housekeeping while quiescent.
+    uint32_t vi_period_ms;      // Voltages and currents while quiescent, 0 to disable.
+    uint32_t basic_period_ms;   // Basic and watchdog housekeeping, 0 to disable.
+    uint32_t conf_period_ms;    // Configuration, 0 to disable.
+    uint32_t hk_period_ms;      // Full housekeeping during a burst.
+    uint32_t burst_period_ms;   // Voltages and currents during a burst, 20 -- 100 for 50 -- 10 Hz.
+    uint32_t burst_duration_ms; // Burst length after the last trigger.
+    uint16_t vbatt_delta_mv;    // Battery voltage change between samples that triggers a burst, 0 to disable.
+    uint16_t current_delta_ma;  // Input, solar, system or output current change that triggers a burst, 0 to disable.
+    uint8_t trigger_latchup;    // Trigger a burst when a latch-up counter increments.
+    uint8_t trigger_lup_cmd;    // Trigger a burst after eps_tgl_lup and eps_lup_set.
+    uint8_t trigger_alarm;      // Trigger a burst when a telemetry alarm is raised.
+} eps_sample_policy_t;
+
+/**
+ * @brief Replaces the EPS thread's sampling policy; it takes effect immediately.
+ *
+ * @param policy The new policy.
+ * @return int 1 on success, -1 if a period is out of range.
+ */
+int eps_set_sample_policy(const eps_sample_policy_t *policy);
+
+/**
+ * @brief Returns the EPS thread's sampling policy.
+ *
+ * @param policy Output.
+ * @param bursting Set to 1 during a burst, 0 otherwise. May be NULL.
+ */
+void eps_get_sample_policy(eps_sample_policy_t *policy, int *bursting);
+
+/**
+ * @brief Timing statistics of one EPS task, see: eps_get_sched_stats.
+ *
+ */
+typedef struct
+{
+    uint64_t runs;          // Times the task ran.
+    uint64_t overruns;      // Deadlines skipped because the task was a full period or more late.
+    uint64_t jitter_max_ns; // Largest delay between a deadline and the start of the run.
+    uint64_t jitter_avg_ns; // Mean of the same.
+} eps_sched_task_stats_t;
+
+/**
+ * @brief Returns the timing statistics of an EPS thread task.
+ *
+ * @param task The task.
+ * @param stats Output.
+ * @return int 1 on success, -1 on invalid input.
+ */
+int eps_get_sched_stats(eps_task_id task, eps_sched_task_stats_t *stats);
+
+/**
+ * @brief Commands the EPS threads send in I2C_RDWR transfers with retries, see: eps_get_xport_stats.
+ *
+ */
+typedef enum
+{
+    EPS_XPORT_OP_RESET_WDT = 0, // Kick the ground watchdog.
+    EPS_XPORT_OP_GET_HK,        // Read all housekeeping, eps_hk_t.
+    EPS_XPORT_OP_NUM
+} eps_xport_op_id;
+
+/**
+ * @brief Bus statistics of one command.
+ *
+ */
+typedef struct
+{
+    uint64_t count;          // Times the command was requested.
+    uint64_t transfers;      // I2C transfers of it, retries included.
+    uint64_t retries;        // Transfers after the first that it needed.
+    uint64_t errors;         // Times it still failed after EPS_XPORT_RETRIES retries.
+    uint64_t latency_max_ns; // Longest transfer of it.
+    uint64_t latency_avg_ns; // Mean of the same.
+} eps_xport_stats_t;
+
+/**
+ * @brief Returns the bus statistics of a command.
+ *
+ * Everything stays zero if the bus cannot do I2C_RDWR transfers; the EPS
+ * threads then go through the p31u driver instead.
+ *
+ * @param op The command.
+ * @param stats Output.
+ * @return int 1 on success, -1 on invalid input.
+ */
+int eps_get_xport_stats(eps_xport_op_id op, eps_xport_stats_t *stats);
+
+/**
+ * @brief Telemetry channels the EPS thread keeps statistics of, see: eps_stats_policy_t.
+ *
+ * Arrays take consecutive channels. Values are in the units read: mV, mA
+ * and degrees Celsius.
+ *
+ */
+typedef enum
+{
+    EPS_STAT_CUROUT = 0, // curout[6].
+    EPS_STAT_VBATT = 6,  // vbatt, bv of hkparam_t.
+    EPS_STAT_CURSUN = 7, // cursun, pc of hkparam_t.
+    EPS_STAT_CURSYS = 8, // cursys, sc of hkparam_t.
+    EPS_STAT_TEMP = 9,   // temp[6], the battery's last.
+    EPS_STAT_NUM = 15
+} eps_stat_channel;
+
+#define EPS_ALARM_LOW 0x1  // A sample below the low limit.
+#define EPS_ALARM_HIGH 0x2 // A sample above the high limit.
+#define EPS_ALARM_RATE 0x4 // The average moving faster than the rate limit.
+
+/**
+ * @brief Alarm limits of one channel.
+ *
+ */
+typedef struct
+{
+    float low;      // Lowest normal sample.
+    float high;     // Highest normal sample.
+    float rate;     // Fastest normal change of the average, per second in either direction.
+    uint8_t enable; // EPS_ALARM_* bits of the limits that apply.
+} eps_alarm_t;
+
+/**
+ * @brief How the EPS thread summarizes its telemetry, see: eps_set_stats_policy.
+ *
+ * Every sample updates, per channel, the minimum, maximum, mean and
+ * variance of the current window and an exponentially weighted average
+ * with a time constant of ewma_tau_ms. A window closes with the first
+ * sample window_ms or more after it opened, and its summary is logged to
+ * EPS_LOG_STATS. Voltages and currents are updated by every sample,
+ * output currents and temperatures only by full housekeeping.
+ *
+ * A sample beyond an enabled limit, or an average changing faster than
+ * the rate limit, raises the channel's alarm; a raised alarm starts a
+ * burst if trigger_alarm is set in eps_sample_policy_t. An alarm that
+ * persists is raised only once.
+ *
+ * Every device keeps its own statistics under the one policy.
+ *
+ */
+typedef struct
+{
+    uint32_t window_ms;              // Length of the summary windows.
+    uint32_t ewma_tau_ms;            // Time constant of the averages.
+    eps_alarm_t alarm[EPS_STAT_NUM]; // Limits, per channel.
+} eps_stats_policy_t;
+
+/**
+ * @brief Replaces the EPS thread's statistics policy; it applies from the next sample.
+ *
+ * @param policy The new policy.
+ * @return int 1 on success, -1 if a period or an enabled limit is out of range.
+ */
+int eps_set_stats_policy(const eps_stats_policy_t *policy);
+
+/**
+ * @brief Returns the EPS thread's statistics policy.
+ *
+ * @param policy Output.
+ */
+void eps_get_stats_policy(eps_stats_policy_t *policy);
+
+/**
+ * @brief Statistics of the samples of one window.
+ *
+ */
+typedef struct
+{
+    uint32_t count; // Samples.
+    float min;
+    float max;
+    float mean;
+    float var;      // Sample variance, 0 for fewer than two samples.
+} eps_window_stats_t;
+
+/**
+ * @brief Statistics of one telemetry channel, see: eps_get_channel_stats.
+ *
+ */
+typedef struct
+{
+    eps_window_stats_t window; // The current window, so far.
+    eps_window_stats_t last;   // The last closed window.
+    float ewma;                // Exponentially weighted average.
+    float rate;                // Its change per second.
+    uint8_t alarms;            // EPS_ALARM_* bits of the latest sample.
+    uint32_t raised;           // Samples that raised an alarm.
+} eps_channel_stats_t;
+
+/**
+ * @brief Returns the statistics of a telemetry channel.
+ *
+ * @param channel The channel.
+ * @param stats Output.
+ * @return int 1 on success, -1 on invalid input or if the channel has no samples yet.
+ */
+int eps_get_channel_stats(eps_stat_channel channel, eps_channel_stats_t *stats);
+
+/**
+ * @brief One channel of a window summary, rounded to the units read.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t count;  // Samples, 0 if the summary of the channel is void.
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+    uint16_t stddev;
+    int16_t ewma;    // At the end of the window.
+    uint8_t alarms;  // EPS_ALARM_* bits of any sample of the window.
+} eps_stats_channel_summary_t;
+
+/**
+ * @brief Summary of one window of telemetry, logged to EPS_LOG_STATS.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t duration_ms; // Since the window opened; longer than window_ms only if samples were missing.
+    eps_stats_channel_summary_t channel[EPS_STAT_NUM];
+} eps_stats_summary_t;
+
+/**
+ * @brief Commands executed by the EPS thread, see: eps_cmd_submit.
+ *
+ */
+typedef enum
+{
+    EPS_CMD_PING = 0,
+    EPS_CMD_REBOOT,
+    EPS_CMD_TLUP,          // arg[0]: eps_lup_idx
+    EPS_CMD_SLUP,          // arg[0]: eps_lup_idx, arg[1]: 1 for on, 0 for off
+    EPS_CMD_HARDRESET,
+    EPS_CMD_GET_HK,        // data.hk
+    EPS_CMD_GET_HK_OUT,    // data.hk_out
+    EPS_CMD_GET_HKPARAM,   // data.hkparam
+    EPS_CMD_BATTHEATER_SET,// tout_ms
+    EPS_CMD_KS_SET,        // tout_ms
+    EPS_CMD_GET_CONF,      // data.conf
+    EPS_CMD_SET_CONF,      // data.conf
+    EPS_CMD_GET_CONF2,     // data.conf2
+    EPS_CMD_SET_CONF2,     // data.conf2
+    EPS_CMD_RESET_COUNTERS,
+    EPS_CMD_SET_HEATER,    // arg[0]: cmd, arg[1]: heater, arg[2]: mode, data.reply
+    EPS_CMD_SET_PV_AUTO,   // arg[0]: mode
+    EPS_CMD_SET_PV_VOLT,   // arg[0..2]: V1, V2, V3
+    EPS_CMD_GET_HK_2_VI,   // data.hk_vi
+    EPS_CMD_GET_HK_WDT,    // data.hk_wdt
+    EPS_CMD_GET_HK_2_BASIC,// data.hk_basic
+    EPS_CMD_NUM
+} eps_cmd_id;
+
+/**
+ * @brief Command priorities. Higher priorities are executed first, equal ones in order of submission.
+ *
+ */
+typedef enum
+{
+    EPS_PRIO_ROUTINE = 0, // Housekeeping reads.
+    EPS_PRIO_NORMAL,      // Configuration and everything else.
+    EPS_PRIO_CRITICAL,    // Latch-up control, resets and the kill switch.
+    EPS_PRIO_NUM
+} eps_cmd_prio;
+
+/**
+ * @brief eps_cmd_submit errors, distinct from the driver's return values.
+ *
+ */
+typedef enum
+{
+    EPS_CMD_ERR_INVALID = -100, // Unknown command or priority.
+    EPS_CMD_ERR_FULL = -101,    // Every command slot is in use.
+    EPS_CMD_ERR_TIMEOUT = -102, // Not started within the wait; cancelled, it never executes.
+    EPS_CMD_ERR_STOPPED = -103, // The EPS thread has exited.
+    EPS_CMD_ERR_NODEV = -104,   // No such device, or it failed to initialize.
+    EPS_CMD_ERR_RUNNING = -105  // Still executing when the wait ended; it completes, but its results are dropped.
+} eps_cmd_error;
+
+#define EPS_HEATER_REPLY_SZ 2 // Bytes returned by EPS_CMD_SET_HEATER.
+
+/**
+ * @brief One EPS command, its arguments and, once complete, its results.
+ *
+ */
+typedef struct
+{
+    eps_cmd_id id;
+    int arg[3];
+    uint64_t tout_ms;
+    union
+    {
+        hkparam_t hkparam;
+        eps_hk_t hk;
+        eps_hk_out_t hk_out;
+        eps_hk_vi_t hk_vi;
+        eps_hk_wdt_t hk_wdt;
+        eps_hk_basic_t hk_basic;
+        eps_config_t conf;
+        eps_config2_t conf2;
+        unsigned char reply[EPS_HEATER_REPLY_SZ];
+    } data;
+    int retval; // The driver's return value.
+} eps_cmd_t;
+
+/**
+ * @brief Queues a command for the EPS thread, which alone talks to the EPS.
+ *
+ * The command is copied, so cmd may go out of scope once this returns.
+ * Commands run one at a time, highest priority first, so a critical command
+ * waits for at most the transaction in progress. The eps_* functions below
+ * are wrappers around this with a fixed priority for each command.
+ *
+ * @param cmd The command. Overwritten with its results if it completes within wait_ms.
+ * @param prio Priority of the command.
+ * @param wait_ms Milliseconds to wait for completion, at most EPS_CMD_TIMEOUT seconds; 0 to return once queued.
+ * @return int The driver's return value on completion, 0 if queued without waiting, otherwise an eps_cmd_error.
+ */
+int eps_cmd_submit(eps_cmd_t *cmd, eps_cmd_prio prio, int wait_ms);
+
+/**
+ * @brief Returns the latency of a command, from eps_cmd_submit to its result.
+ *
+ * @param cmd The command.
+ * @param summary Output.
+ * @return int 1 on success, -1 on invalid input or if built with NO_LATENCY_STATS.
+ */
+int eps_get_cmd_latency(eps_cmd_id cmd, lat_summary_t *summary);
+
+/**
+ * @brief Returns the latency of one run of an EPS thread task, bus transactions included.
+ *
+ * @param task The task.
+ * @param summary Output.
+ * @return int 1 on success, -1 on invalid input or if built with NO_LATENCY_STATS.
+ */
+int eps_get_task_latency(eps_task_id task, lat_summary_t *summary);
+
+/**
+ * @brief Returns how late the EPS thread wakes for its deadlines, see: module_t's priority.
+ *
+ * Only sleeps that end at their deadline are counted, not those cut short
+ * by a command. The maximum bounds how late a watchdog kick can start.
+ *
+ * @param summary Output; errors is always 0.
+ * @return int 1 on success, -1 on invalid input or if built with NO_LATENCY_STATS.
+ */
+int eps_get_wake_latency(lat_summary_t *summary);
+
+/**
+ * @brief Watchdog servicing by eps_wdt_thread, see: eps_get_wdt_stats.
+ *
+ * The kicks run on their own thread, on a fixed grid of EPS_WDT_PERIOD_MS
+ * deadlines, and only share the bus with the EPS thread for the length of
+ * one of its transactions.
+ *
+ */
+typedef struct
+{
+    uint64_t kicks;              // Successful kicks.
+    uint64_t failures;           // Kicks whose bus transaction failed.
+    uint64_t misses;             // Intervals between successful kicks longer than EPS_WDT_MISS_MS.
+    uint64_t late_max_ns;        // Largest delay between a deadline and the start of its kick.
+    uint64_t interval_max_ns;    // Longest time between two successful kicks.
+    uint64_t timeout_ns;         // The ground watchdog timeout the interval must stay below.
+    uint32_t gnd_time_left_min;  // Smallest wdt_gnd_time_left read back, in seconds; UINT32_MAX before the first read.
+} eps_wdt_stats_t;
+
+/**
+ * @brief Returns the watchdog kick statistics.
+ *
+ * @param stats Output.
+ * @return int 1 on success, -1 on invalid input.
+ */
+int eps_get_wdt_stats(eps_wdt_stats_t *stats);
+
+/**
+ * @brief Returns the duration of a watchdog kick, waiting for the bus included.
+ *
+ * @param summary Output.
+ * @return int 1 on success, -1 on invalid input or if built with NO_LATENCY_STATS.
+ */
+int eps_get_wdt_latency(lat_summary_t *summary);
 
 /**
   * @brief Pings the EPS.
@@ -60,6 +489,38 @@ int eps_get_hk(eps_hk_t *hk);
   */
 int eps_get_hk_out(eps_hk_out_t *hk_out);
 
+/**
+ * @brief Copies the housekeeping most recently read by eps_thread, without a bus transaction.
+ * 
+ * eps_thread publishes every reply into one of two buffers, so readers never
+ * wait for it or for each other. The snapshot is at most one sampling
+ * period old while eps_thread is running (see: eps_sample_policy_t); use
+ * eps_get_hk when fresher data is required.
+ * 
+ * @param out Output.
+ * @param age_ns Set to the snapshot's age in nanoseconds. May be NULL.
+ * @return int 1 on success, -1 if nothing has been read yet.
+ */
+int eps_get_latest_hk(eps_hk_t *out, uint64_t *age_ns);
+
+/**
+ * @brief Derives the hkparam_t view from a full housekeeping reply, without a bus transaction.
+ * 
+ * sw_errors is not part of eps_hk_t and is set to 0.
+ * 
+ * @param hk Full housekeeping, as returned by eps_get_hk.
+ * @param hkparam Output.
+ */
+void eps_hk_to_hkparam(const eps_hk_t *hk, hkparam_t *hkparam);
+
+/**
+ * @brief Derives the eps_hk_out_t view from a full housekeeping reply, without a bus transaction.
+ * 
+ * @param hk Full housekeeping, as returned by eps_get_hk.
+ * @param hk_out Output.
+ */
+void eps_hk_to_hk_out(const eps_hk_t *hk, eps_hk_out_t *hk_out);
+
 /**
   * @brief Toggle EPS latch up.
   *
@@ -102,7 +563,10 @@ int eps_hardreset();
 
 /**
  * @brief Gets the EPS configuration.
- * 
+ *
+ * Served from the last-known configuration without bus traffic; the EPS is
+ * read only if it is unknown, e.g. after a reboot.
+ *
  * @param conf Pointer to eps_config_t object for output.
  * @return int 
  */
@@ -110,25 +574,27 @@ int eps_get_conf(eps_config_t *conf);
 
 /**
  * @brief Sets the EPS configuration.
- * 
+ *
+ * Nothing is written if no field differs from the last-known configuration.
+ *
  * @param conf Pointer to eps_config_t object for input.
- * @return int 
+ * @return int Value for i2c write, 1 if the write was skipped.
  */
 int eps_set_conf(eps_config_t *conf);
 
 /**
- * @brief 
+ * @brief Gets the EPS battery configuration, cached like eps_get_conf.
  * 
- * @param conf 
+ * @param conf Pointer to eps_config2_t object for output.
  * @return int 
  */
 int eps_get_conf2(eps_config2_t *conf);
 
 /**
- * @brief 
+ * @brief Sets the EPS battery configuration, skipped like eps_set_conf.
  * 
- * @param conf 
- * @return int 
+ * @param conf Pointer to eps_config2_t object for input.
+ * @return int Value for i2c write, 1 if the write was skipped.
  */
 int eps_set_conf2(eps_config2_t *conf);
 
@@ -192,4 +658,50 @@ int eps_get_hk_wdt(eps_hk_wdt_t *hk);
  */
 int eps_get_hk_2_basic(eps_hk_basic_t *hk);
 
-#endif // EPS_EXTERN_H
\ No newline at end of file
+/**
+ * @brief Per-device variants of the functions above.
+ *
+ * Each board has its own command queue, sampling policy, snapshot,
+ * configuration cache, statistics and datalogger channels. Boards on one
+ * I2C bus share a worker of the EPS thread; boards on different buses are
+ * polled in parallel. eps_dev_X(dev, ...) is eps_X(...) on board dev, a
+ * value below EPS_DEV_NUM; eps_X addresses EPS_DEV_DEFAULT. Commands to a
+ * board that does not exist or failed to initialize return
+ * EPS_CMD_ERR_NODEV, the other functions -1.
+ *
+ */
+int eps_dev_set_sample_policy(int dev, const eps_sample_policy_t *policy);
+int eps_dev_get_sample_policy(int dev, eps_sample_policy_t *policy, int *bursting); // 1 on success, -1 on invalid input.
+int eps_dev_get_sched_stats(int dev, eps_task_id task, eps_sched_task_stats_t *stats);
+int eps_dev_get_channel_stats(int dev, eps_stat_channel channel, eps_channel_stats_t *stats);
+int eps_dev_cmd_submit(int dev, eps_cmd_t *cmd, eps_cmd_prio prio, int wait_ms);
+int eps_dev_get_cmd_latency(int dev, eps_cmd_id cmd, lat_summary_t *summary);
+int eps_dev_get_task_latency(int dev, eps_task_id task, lat_summary_t *summary);
+int eps_dev_get_wake_latency(int dev, lat_summary_t *summary); // Of the worker of the device's bus.
+int eps_dev_get_wdt_stats(int dev, eps_wdt_stats_t *stats);
+int eps_dev_get_xport_stats(int dev, eps_xport_op_id op, eps_xport_stats_t *stats);
+int eps_dev_get_wdt_latency(int dev, lat_summary_t *summary);
+int eps_dev_get_latest_hk(int dev, eps_hk_t *out, uint64_t *age_ns);
+int eps_dev_ping(int dev);
+int eps_dev_reboot(int dev);
+int eps_dev_get_hkparam(int dev, hkparam_t *hk);
+int eps_dev_get_hk(int dev, eps_hk_t *hk);
+int eps_dev_get_hk_out(int dev, eps_hk_out_t *hk_out);
+int eps_dev_tgl_lup(int dev, eps_lup_idx lup);
+int eps_dev_lup_set(int dev, eps_lup_idx lup, int pw);
+int eps_dev_battheater_set(int dev, uint64_t tout_ms);
+int eps_dev_ks_set(int dev, uint64_t tout_ms);
+int eps_dev_hardreset(int dev);
+int eps_dev_get_conf(int dev, eps_config_t *conf);
+int eps_dev_set_conf(int dev, eps_config_t *conf);
+int eps_dev_get_conf2(int dev, eps_config2_t *conf);
+int eps_dev_set_conf2(int dev, eps_config2_t *conf);
+int eps_dev_reset_counters(int dev);
+int eps_dev_set_heater(int dev, unsigned char *reply, uint8_t cmd, uint8_t heater, uint8_t mode);
+int eps_dev_set_pv_auto(int dev, uint8_t mode);
+int eps_dev_set_pv_volt(int dev, uint16_t V1, uint16_t V2, uint16_t V3);
+int eps_dev_get_hk_2_vi(int dev, eps_hk_vi_t *hk);
+int eps_dev_get_hk_wdt(int dev, eps_hk_wdt_t *hk);
+int eps_dev_get_hk_2_basic(int dev, eps_hk_basic_t *hk);
+
+#endif // EPS_EXTERN_H
@@ -13,6 +13,51 @@
 #define EPS_IFACE_H
 
 #include <pthread.h>
+#include "eps_extern.h"
+#include "main.h"
+
+/**
+ * @brief Telemetry streams, each logged to its own datalogger channel.
+ *
+ */
+typedef enum
+{
+    EPS_STREAM_HK = 0,
+    EPS_STREAM_VI,
+    EPS_STREAM_WDT,
+    EPS_STREAM_BASIC,
+    EPS_STREAM_CONF,
+    EPS_STREAM_STATS,
+    EPS_STREAM_NUM
+} eps_stream_id;
+
+#define EPS_NUM_CHANNELS (EPS_DEV_NUM * EPS_STREAM_NUM) // Datalogger channels of all devices.
+
+/**
+ * @brief The datalogger channel of every stream of every device, registered by main() before eps_init.
+ *
+ * Device dev's stream s is eps_channels[dev * EPS_STREAM_NUM + s].
+ *
+ */
+extern const dlgr_channel_t eps_channels[EPS_NUM_CHANNELS];
+
+/**
+ * @brief Handles of eps_channels, negative for channels that could not be registered.
+ *
+ */
+extern dlgr_handle_t eps_handles[EPS_NUM_CHANNELS];
+
+/**
+ * @brief Wakes the EPS thread's worker of the default device's bus when a command is queued or the program is exiting.
+ *
+ */
+extern pthread_cond_t eps_cmd_wait[1];
+
+/**
+ * @brief Wakes the watchdog thread when the program is exiting.
+ *
+ */
+extern pthread_cond_t eps_wdt_wait[1];
 
 /**
  * @brief Initializes the devices required to run the electronic power supply.
@@ -24,17 +69,31 @@
 int eps_init();
 
 /**
- * @brief EPS thread.
+ * @brief EPS thread: polls the default device's bus and starts a worker for each other bus.
+ *
+ * The other workers inherit this thread's scheduling policy, priority and
+ * CPUs; they are stopped and joined before it exits.
  *
  * @param tid Pointer to an integer containing the thread ID.
  * @return Void pointer.
  */
 void *eps_thread(void *tid);
 
+/**
+ * @brief Watchdog thread: kicks the EPS ground watchdog every EPS_WDT_PERIOD_MS.
+ *
+ * Runs above the EPS thread, so housekeeping, commands and logging can only
+ * delay a kick by the bus transaction in progress. See: eps_get_wdt_stats.
+ *
+ * @param tid Pointer to an integer containing the thread ID.
+ * @return Void pointer.
+ */
+void *eps_wdt_thread(void *tid);
+
 /**
  * @brief Frees and destroys.
  *
  */
 void eps_destroy();
 
-#endif // EPS_IFACE_H
\ No newline at end of file
+#endif // EPS_IFACE_H
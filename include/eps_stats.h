@@ -0,0 +1,39 @@
+/**
+ * @file eps_stats.h
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Running statistics and alarms of the EPS thread's telemetry.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Folds every housekeeping sample of eps_thread into per-channel window
+ * statistics (Welford's algorithm) and exponentially weighted averages,
+ * each in constant time and memory, and checks the alarm limits. See:
+ * eps_stats_policy_t for what is kept and eps_get_channel_stats for how
+ * to read it.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef EPS_STATS_H
+#define EPS_STATS_H
+
+#include "eps_extern.h"
+#include <stdint.h>
+
+#define EPS_STATS_RAISED 0x1 // The sample raised an alarm.
+#define EPS_STATS_CLOSED 0x2 // The sample closed a window; its summary is returned.
+
+/**
+ * @brief Adds one sample to the statistics. Called by the worker of the device's bus only.
+ *
+ * @param dev The device sampled.
+ * @param hk The sample, partial reads merged into the last full one.
+ * @param full Whether the whole sample was read; otherwise only the eps_hk_vi_t fields are new.
+ * @param now CLOCK_MONOTONIC time of the sample.
+ * @param summary Set to the summary of the window the sample closed, if any.
+ * @return int EPS_STATS_* bits.
+ */
+int eps_stats_update(int dev, const eps_hk_t *hk, int full, uint64_t now, eps_stats_summary_t *summary);
+
+#endif // EPS_STATS_H
@@ -0,0 +1,81 @@
+/**
+ * @file eps_xport.h
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief I2C transport for the EPS thread's periodic transactions.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Sends each periodic command of the EPS threads, a ground watchdog kick
+ * or a full housekeeping read, as one I2C_RDWR transfer of its write and
+ * the read of its reply, and retries a failed command with backoff.
+ * Commands from the command queue still go through the p31u driver.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef EPS_XPORT_H
+#define EPS_XPORT_H
+
+#include "eps_extern.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define EPS_XPORT_RETRIES 3      // further attempts of a failed command
+#define EPS_XPORT_BACKOFF_US 500 // wait before the first retry, doubled for each further one
+
+/**
+ * @brief Errors of eps_xport_run.
+ *
+ */
+typedef enum
+{
+    EPS_XPORT_ERR_INVALID = -110, // Unknown command.
+    EPS_XPORT_ERR_IO = -111,      // The transfer failed.
+    EPS_XPORT_ERR_REPLY = -112,   // The EPS answered a different command or reported an error.
+} eps_xport_error;
+
+/**
+ * @brief The EPS on one I2C bus.
+ *
+ */
+typedef struct
+{
+    int fd;        // i2c-dev file descriptor, owned by the p31u driver.
+    uint16_t addr; // EPS address.
+    pthread_mutex_t stats_m[1];                       // Guards stats, also read by other threads.
+    eps_xport_stats_t stats[EPS_XPORT_OP_NUM];        // Of this EPS only, see: eps_xport_get_stats.
+    uint64_t latency_sum_ns[EPS_XPORT_OP_NUM];
+} eps_xport_t;
+
+/**
+ * @brief Sets up the transport on the p31u driver's bus.
+ *
+ * @param xport The transport.
+ * @param fd i2c-dev file descriptor of the bus.
+ * @param addr EPS address.
+ * @return int 1 on success, -1 if the bus cannot do I2C_RDWR transfers. The statistics are set up and zero either way.
+ */
+int eps_xport_init(eps_xport_t *xport, int fd, uint16_t addr);
+
+/**
+ * @brief Sends a command in one transfer and retries it if it failed. Call with the bus's bus_m held.
+ *
+ * @param xport The transport.
+ * @param id The command.
+ * @param reply Output of the command's type, see: eps_xport_op_id. Unused for EPS_XPORT_OP_RESET_WDT.
+ * @return int 1 on success, eps_xport_error otherwise.
+ */
+int eps_xport_run(eps_xport_t *xport, eps_xport_op_id id, void *reply);
+
+/**
+ * @brief Returns the bus statistics of a command sent through a transport.
+ *
+ * @param xport The transport, set up by eps_xport_init.
+ * @param op The command.
+ * @param stats Output.
+ * @return int 1 on success, -1 on invalid input.
+ */
+int eps_xport_get_stats(eps_xport_t *xport, eps_xport_op_id op, eps_xport_stats_t *stats);
+
+#endif // EPS_XPORT_H
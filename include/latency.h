@@ -0,0 +1,195 @@
+/**
+ * @file latency.h
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Lock-free latency histograms for hot paths.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * Each call adds its CLOCK_MONOTONIC_RAW duration to a bucket of a
+ * log-scale histogram with relaxed atomics, so any number of threads may
+ * record into one histogram without locking. Buckets are four per power of
+ * two, so a reported percentile is at most 25% above the true value.
+ *
+ * Build with -DNO_LATENCY_STATS to compile the instrumentation out; the
+ * summary functions then return -1.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/**
+ * @brief Latency of one call site, see: lat_summarize.
+ *
+ */
+typedef struct
+{
+    uint64_t count;  // Calls.
+    uint64_t errors; // Calls that failed.
+    uint64_t p50_ns; // Median duration.
+    uint64_t p99_ns; // 99th percentile duration.
+    uint64_t max_ns; // Longest duration.
+} lat_summary_t;
+
+#ifndef NO_LATENCY_STATS
+
+#include <stdatomic.h>
+#include <time.h>
+
+#define LAT_SUB_BITS 2                                           // log2 of buckets per power of two
+#define LAT_BUCKETS (((41 - LAT_SUB_BITS) + 1) << LAT_SUB_BITS) // up to 2^41 ns, beyond in the last bucket
+
+typedef struct
+{
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t errors;
+    atomic_uint_fast64_t max_ns;
+    atomic_uint_fast64_t buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+static inline uint64_t lat_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Bucket of a duration: exact below 2^LAT_SUB_BITS ns, then the
+ * top LAT_SUB_BITS + 1 bits of the duration.
+ *
+ */
+static inline int lat_bucket(uint64_t ns)
+{
+    if (ns < (1u << LAT_SUB_BITS))
+    {
+        return (int)ns;
+    }
+
+    int msb = 63 - __builtin_clzll(ns);
+    int idx = ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + (int)((ns >> (msb - LAT_SUB_BITS)) & ((1u << LAT_SUB_BITS) - 1));
+    return idx < LAT_BUCKETS ? idx : LAT_BUCKETS - 1;
+}
+
+/**
+ * @brief Largest duration in a bucket.
+ *
+ */
+static inline uint64_t lat_bucket_max(int idx)
+{
+    if (idx < (1 << LAT_SUB_BITS))
+    {
+        return idx;
+    }
+
+    int shift = (idx >> LAT_SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)((1 << LAT_SUB_BITS) + (idx & ((1 << LAT_SUB_BITS) - 1))) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+/**
+ * @brief Records one duration measured by the caller, on any clock.
+ *
+ * @param hist The call site's histogram.
+ * @param ns The duration.
+ * @param error Nonzero if the call failed.
+ */
+static inline void lat_record_ns(lat_hist_t *hist, uint64_t ns, int error)
+{
+    atomic_fetch_add_explicit(&hist->buckets[lat_bucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    if (error)
+    {
+        atomic_fetch_add_explicit(&hist->errors, 1, memory_order_relaxed);
+    }
+
+    uint_fast64_t max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&hist->max_ns, &max, ns, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Records one call.
+ *
+ * @param hist The call site's histogram.
+ * @param start lat_now() when the call started.
+ * @param error Nonzero if the call failed.
+ */
+static inline void lat_record(lat_hist_t *hist, uint64_t start, int error)
+{
+    lat_record_ns(hist, lat_now() - start, error);
+}
+
+/**
+ * @brief Summarizes a histogram. Concurrent calls may or may not be included.
+ *
+ * @param hist The histogram.
+ * @param summary Output.
+ * @return int 1.
+ */
+static inline int lat_summarize(lat_hist_t *hist, lat_summary_t *summary)
+{
+    uint64_t buckets[LAT_BUCKETS];
+    uint64_t total = 0;
+
+    for (int i = 0; i < LAT_BUCKETS; i++)
+    {
+        buckets[i] = atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+        total += buckets[i];
+    }
+
+    summary->count = total;
+    summary->errors = atomic_load_explicit(&hist->errors, memory_order_relaxed);
+    summary->max_ns = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    summary->p50_ns = 0;
+    summary->p99_ns = 0;
+
+    // The smallest bucket holding the (total * q)th duration, rounded up; never above the maximum.
+    uint64_t rank50 = (total * 50 + 99) / 100;
+    uint64_t rank99 = (total * 99 + 99) / 100;
+    uint64_t seen = 0;
+    int have_p50 = 0;
+    for (int i = 0; i < LAT_BUCKETS && seen < rank99; i++)
+    {
+        seen += buckets[i];
+        if (!have_p50 && seen >= rank50)
+        {
+            summary->p50_ns = lat_bucket_max(i);
+            have_p50 = 1;
+        }
+        if (seen >= rank99)
+        {
+            summary->p99_ns = lat_bucket_max(i);
+        }
+    }
+
+    if (summary->p50_ns > summary->max_ns)
+    {
+        summary->p50_ns = summary->max_ns;
+    }
+    if (summary->p99_ns > summary->max_ns)
+    {
+        summary->p99_ns = summary->max_ns;
+    }
+
+    return 1;
+}
+
+#define LAT_START(var) uint64_t var = lat_now()
+#define LAT_RECORD(hist, var, error) lat_record(hist, var, error)
+#define LAT_RECORD_NS(hist, ns, error) lat_record_ns(hist, ns, error)
+
+#else // NO_LATENCY_STATS
+
+#define LAT_START(var)
+#define LAT_RECORD(hist, var, error) ((void)(error))
+#define LAT_RECORD_NS(hist, ns, error) ((void)(ns), (void)(error))
+
+#endif // NO_LATENCY_STATS
+
+#endif // LATENCY_H
@@ -26,6 +26,8 @@
 #include <signal.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <pthread.h>
+#include "latency.h"
 
 /**
  * @brief Describes ACS (system) states.
@@ -77,7 +79,17 @@ typedef enum
     ERR_CHDIR_FAIL,
     ERR_INDEX_OPEN,
 
-    ERR_MISC
+    ERR_MISC,
+
+    // ERR_INIT ... ERR_MISC fill -20 ... -1, so later codes continue below ERR_INIT.
+    ERR_DATA_WRITE = -21,
+    ERR_DATA_SYNC = -22,
+    ERR_QUEUE_FULL = -23,
+    ERR_UNKNOWN_MODULE = -24,
+    ERR_TOO_MANY_MODULES = -25,
+    ERR_FILE_RENAME = -26,
+    ERR_ARENA = -27,
+    ERR_NOT_READY = -28
 } DLGR_ERRORS;
 
 typedef enum
@@ -86,6 +98,126 @@ typedef enum
     MAX_DIR_SIZE
 } DLGR_SETTINGS;
 
+/**
+ * @brief Size of the delimiters around every record in a .dat file, and in retrieved data.
+ * 
+ */
+#define FBEGIN_SIZE 6
+#define FEND_SIZE 4
+
+/**
+ * @brief Identifies the structure logged in each record, stored in every .dat file header.
+ * 
+ */
+typedef enum
+{
+    DLGR_SCHEMA_RAW = 0,    // Opaque bytes.
+    DLGR_SCHEMA_EPS_HKPARAM,// hkparam_t
+    DLGR_SCHEMA_EPS_HK_OUT, // eps_hk_out_t
+    DLGR_SCHEMA_EPS_HK,     // eps_hk_t
+    DLGR_SCHEMA_EPS_HK_VI,  // eps_hk_vi_t
+    DLGR_SCHEMA_EPS_HK_WDT, // eps_hk_wdt_t
+    DLGR_SCHEMA_EPS_HK_BASIC, // eps_hk_basic_t
+    DLGR_SCHEMA_EPS_CONFIG, // eps_config_t
+    DLGR_SCHEMA_EPS_STATS   // eps_stats_summary_t
+} DLGR_SCHEMA;
+
+/**
+ * @brief Time a record was logged, stored between FBEGIN and the data.
+ * 
+ */
+typedef struct __attribute__((packed))
+{
+    uint64_t monotonic; // CLOCK_MONOTONIC, in nanoseconds.
+    uint64_t realtime;  // CLOCK_REALTIME, in nanoseconds. Zero for records logged before timestamps existed.
+} dlgr_timestamp_t;
+
+/**
+ * @brief Offset of the data within a retrieved record.
+ * 
+ */
+#define DLGR_RECORD_DATA_OFFSET (FBEGIN_SIZE + sizeof(dlgr_timestamp_t))
+
+/**
+ * @brief Bytes per record, delimiters and timestamp included, for records of size bytes.
+ * 
+ */
+#define DLGR_RECORD_STRIDE(size) (DLGR_RECORD_DATA_OFFSET + (size) + FEND_SIZE)
+
+/**
+ * @brief Bytes per record without the delimiters, a dlgr_timestamp_t and the data, as exported by dlgr_export_next.
+ * 
+ */
+#define DLGR_PACKED_STRIDE(size) (sizeof(dlgr_timestamp_t) + (size))
+
+#define DLGR_HEADER_MAGIC "DLGR"
+#define DLGR_HEADER_VERSION 1
+
+#define DLGR_HEADER_TIMESTAMPS 0x1 // Records carry a dlgr_timestamp_t after FBEGIN.
+#define DLGR_HEADER_COMPRESSED 0x2 // Records are keyframes and deltas, see: dlgr_SetCompression.
+
+/**
+ * @brief Header at the start of every .dat file.
+ * 
+ * Records follow at offset headerSize, each stride bytes long: FBEGIN,
+ * a dlgr_timestamp_t if DLGR_HEADER_TIMESTAMPS is set in flags, recordSize
+ * bytes of data and FEND. Record n therefore starts at
+ * headerSize + n * stride, so a reader needs nothing but the .dat file
+ * itself. Files with DLGR_HEADER_COMPRESSED are instead a sequence of
+ * variable length frames (see: dlgr_SetCompression) and stride is that of
+ * the decoded records. Fields are in the byte order of the logging system. Files without
+ * the DLGR_HEADER_MAGIC start with their first FBEGIN and are read with the
+ * module's current record size. A file that reuses the blocks of an older one
+ * (see: dlgr_rotate) is overwritten from the start, without being truncated,
+ * and the records in it end at dataEnd rather than at the file's size.
+ * 
+ */
+typedef struct __attribute__((packed))
+{
+    char magic[4];            // DLGR_HEADER_MAGIC, not NUL terminated.
+    uint16_t version;         // DLGR_HEADER_VERSION.
+    uint16_t headerSize;      // Offset of the first record.
+    uint32_t recordSize;      // Data bytes per record, without delimiters.
+    uint32_t stride;          // Bytes per record on disk, delimiters and timestamp included.
+    uint32_t schemaId;        // See: DLGR_SCHEMA.
+    int32_t bootCount;        // sys_boot_count of the boot that started this file.
+    uint64_t fileIndex;       // N of this N.dat.
+    uint64_t firstRecordTime; // CLOCK_REALTIME of the first record, in nanoseconds.
+    uint32_t flags;           // DLGR_HEADER_* bits.
+    uint32_t dataEnd;         // End of the records of a reused file, 0 if the file ends at its size.
+} dlgr_file_header_t;
+
+/**
+ * @brief Opaque reference to a module registered with dlgr_init.
+ * 
+ */
+typedef int dlgr_handle_t;
+
+/**
+ * @brief Describes when the datalogger flushes a module's open .dat file to storage.
+ * 
+ */
+typedef enum
+{
+    DLGR_SYNC_RECORD = 0, // fdatasync() after every record.
+    DLGR_SYNC_COUNT,      // fdatasync() after every N records.
+    DLGR_SYNC_INTERVAL    // fdatasync() when T milliseconds have passed since the last sync.
+} DLGR_SYNC_POLICY;
+
+/**
+ * @brief Counters describing a module's datalogger queue, used to size DLGR_RING_SLOTS.
+ * 
+ */
+typedef struct
+{
+    uint64_t enqueued;    // Records accepted by dlgr_LogData.
+    uint64_t written;     // Records written to a .dat file by the datalogger thread.
+    uint64_t dropped;     // Records rejected because the queue was full.
+    uint64_t writeErrors; // Records the datalogger thread failed to write.
+    uint32_t highWater;   // Largest number of records ever waiting in the queue.
+    uint32_t capacity;    // Number of slots in the queue.
+} dlgr_queue_stats_t;
+
 /**
  * @brief Thread-local system status variable (similar to errno).
  * 
@@ -107,25 +239,212 @@ extern volatile sig_atomic_t done;
  */
 extern int sys_boot_count;
 
+/**
+ * @brief Starts a further thread of a module from the module's own thread, provided to all modules by main.
+ * 
+ * The thread gets a MAIN_STACK_SIZE stack, prefaulted by main_thread_entry
+ * like those of the modules, and explicitly inherits the calling thread's
+ * scheduling policy and priority. It runs on the calling thread's CPUs.
+ * 
+ * @param thread Output, to be joined by the caller.
+ * @param exec The thread's function.
+ * @param arg Passed to exec.
+ * @return int 0 on success, an error number on failure.
+ */
+int main_start_worker(pthread_t *thread, void *(*exec)(void *), void *arg);
+
+/**
+ * @brief A datalogger channel, declared at compile time by the module that logs to it.
+ * 
+ * The arena is sized from these (see: dlgr_ArenaInit) and main() registers
+ * them with dlgr_OpenChannels before any module's init runs. Fields left zero
+ * keep the datalogger's defaults.
+ * 
+ */
+typedef struct
+{
+    const char *moduleName; // As passed to dlgr_init, a unique directory.
+    ssize_t maxLogSize;     // Size of the record type.
+    uint32_t schemaId;      // See: DLGR_SCHEMA.
+    uint32_t periodMs;      // Nominal interval between records, 0 if irregular. Bounds batchRecords, see: dlgr_OpenChannels.
+    int batchRecords;       // See: dlgr_SetBatching.
+    int maxDelayMs;         // See: dlgr_SetBatching.
+    int keyframeInterval;   // See: dlgr_SetCompression.
+} dlgr_channel_t;
+
+/**
+ * @brief Use of the datalogger arena, see: dlgr_GetArenaStats.
+ * 
+ */
+typedef struct
+{
+    size_t capacity; // Bytes allocated by dlgr_ArenaInit.
+    size_t used;     // Bytes handed out to registered modules and the module tables.
+    int modules;     // Modules registered with dlgr_init.
+    int maxModules;  // Modules the arena was sized for.
+} dlgr_arena_stats_t;
+
+/**
+ * @brief Bytes dlgr_ArenaInit allocates for a set of channels.
+ * 
+ * @param channels Every channel that will be registered with dlgr_init.
+ * @param numChannels Entries in channels.
+ * @return size_t The arena size.
+ */
+size_t dlgr_ArenaSize(const dlgr_channel_t *channels, int numChannels);
+
+/**
+ * @brief Allocates all datalogger state up front. Must precede any dlgr_init.
+ * 
+ * The module tables, staging buffers and queues of every module are carved
+ * from one block, allocated and touched here, so the datalogger allocates
+ * nothing afterwards. Retrieval reads through windows on the caller's stack
+ * (see: dlgr_iter_t). dlgr_destroy releases the arena.
+ * 
+ * @param channels Every channel that will be registered with dlgr_init, e.g. those of modules.h.
+ * @param numChannels Entries in channels.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success. ERR_REREGISTER if the arena already exists.
+ */
+int dlgr_ArenaInit(const dlgr_channel_t *channels, int numChannels);
+
+/**
+ * @brief Reports how much of the datalogger arena is in use.
+ * 
+ * @param stats Output.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_GetArenaStats(dlgr_arena_stats_t *stats);
+
+/**
+ * @brief Registers channels with dlgr_init and applies their batching and compression.
+ * 
+ * A channel with a periodMs writes batches of at most the records it logs
+ * within its maxDelayMs, and one whose period would overrun its queue
+ * between two passes of the datalogger thread is reported on stderr.
+ * 
+ * A channel that fails to register gets a negative handle and is reported on
+ * stderr; the others are registered regardless, so a logging failure does not
+ * keep a module from running.
+ * 
+ * @param channels The channels.
+ * @param numChannels Entries in channels.
+ * @param handles Output, numChannels handles, negative for channels that failed (see: DLGR_ERRORS).
+ * @return int The number of channels registered.
+ */
+int dlgr_OpenChannels(const dlgr_channel_t *channels, int numChannels, dlgr_handle_t *handles);
+
+/**
+ * @brief Registers a module with the datalogger.
+ * 
+ * Registration touches no file: the module can log at once, and its records
+ * wait in its queue until dlgr_Setup has opened its directory. A module
+ * registered after dlgr_Setup is set up here.
+ * Requests to log data must be composed of a data structure of the size 
+ * passed here. Sizes smaller than max_size are allowable (datalogger
+ * provides padding). This value, once set, can not be changed.
+ * 
+ * If the current .dat file of an existing log was logged with another record
+ * size or schemaId (see: dlgr_file_header_t), the module starts a new file,
+ * and older files are no longer retrieved.
+ * 
+ * The module's buffers come from the arena (see: dlgr_ArenaInit), which must
+ * have been sized for a record at least this large.
+ * 
+ * @param moduleName The calling module's name for which this datalogger is being initialized, shorter than DLGR_STATE_NAME_MAX.
+ * @param maxLogSize The maximum desired log size for this module's logs.
+ * @param schemaId What the records contain, stored in every .dat header (see: DLGR_SCHEMA).
+ * @return dlgr_handle_t Negative on failure (see: datalogger_extern.h's ERROR enum), the module's handle on success. ERR_ARENA if the arena is missing or full.
+ */
+dlgr_handle_t dlgr_init(char* moduleName, ssize_t maxLogSize, uint32_t schemaId);
+
+/**
+ * @brief Opens the log directories and loads the datalogger state. Run by dlgr_thread before its first write, unless already done.
+ * 
+ * The boot count (sys_boot_count) and every module's index and settings are
+ * kept together in log/DLGR_STATE_FNAME. This reads it, opens the directory
+ * of every registered module and stores the state back with the next boot
+ * count, with one fdatasync(). Directories from before the state file have
+ * their index.inf and settings.cfg, and the old bootcount file, read once
+ * instead. Until it is done, retrieval returns ERR_NOT_READY.
+ * 
+ * Call it directly, before dlgr_thread starts, for logs that are ready when
+ * it returns.
+ * 
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success. ERR_REREGISTER if already done.
+ */
+int dlgr_Setup(void);
+
+/**
+ * @brief Looks up the handle of a module registered with dlgr_init.
+ * 
+ * @param moduleName The name the module was registered under.
+ * @return dlgr_handle_t The module's handle, ERR_UNKNOWN_MODULE if it was never registered.
+ */
+dlgr_handle_t dlgr_GetHandle(char *moduleName);
+
 /**
  * @brief Logs passed data to a file.
  * 
  * Logs the data passed to it as binary in a .dat file, which is
- * located in /log/<MODULE>/. It follows the settings set in
- * /log/<MODULE>/settings.cfg, which means it will
+ * located in /log/<MODULE>/. It follows the module's settings
+ * (see: dlgr_EditSettings), which means it will
  * create a new .dat file when the file size exceeds maxFileSize
- * (line 2) and will begin deleting old .dat files when the 
- * directory size exceeds maxDirSize (line 3). It also stores
+ * and will begin deleting old .dat files when the 
+ * directory size exceeds maxDirSize. It also stores
  * the .dat file's index for naming (ie: 42.dat). Encapsulates
  * each section of written data between FBEGIN and FEND.
  * 
+ * The current .dat file stays open between calls and is only reopened when
+ * it rotates. Durability is governed by the module's sync policy, see
+ * dlgr_SetSyncPolicy().
+ * 
+ * The data is copied into the module's queue and written by the datalogger
+ * thread, so this call never blocks on storage. Each module's queue has a
+ * single producer: only one thread may log under a given moduleName.
+ * 
  * @param size The size of the data to be logged.
  * @param dataIn The data to be logged.
  * @param moduleName The calling module's name, a unique directory.
- * @return int Negative on failure (see: datalogger_extern.h's ERROR enum), 1 on success.
+ * @return int Negative on failure (see: datalogger_extern.h's ERROR enum), 1 on success. ERR_QUEUE_FULL if the record was dropped.
  */
 int dlgr_LogData(char *moduleName, ssize_t size, void *data);
 
+/**
+ * @brief dlgr_LogData for a handle returned by dlgr_init, without the name lookup.
+ * 
+ * @param handle The calling module's handle.
+ * @param size The size of the data to be logged.
+ * @param dataIn The data to be logged.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_LogDataH(dlgr_handle_t handle, ssize_t size, void *dataIn);
+
+/**
+ * @brief Logs several records of the same size with a single queue update.
+ * 
+ * The records are read back-to-back from dataIn, each size bytes long, and are
+ * written exactly as if dlgr_LogData had been called for each of them. Records
+ * that do not fit in the module's queue are dropped.
+ * 
+ * @param moduleName The calling module's name, a unique directory.
+ * @param size The size of each record, 1 to the module's maxLogSize.
+ * @param dataIn numRecords records of size bytes.
+ * @param numRecords Number of records in dataIn.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records queued. ERR_INVALID_INPUT for a size out of range.
+ */
+int dlgr_LogBatch(char *moduleName, ssize_t size, void *dataIn, int numRecords);
+
+/**
+ * @brief dlgr_LogBatch for a handle returned by dlgr_init, without the name lookup.
+ * 
+ * @param handle The calling module's handle.
+ * @param size The size of each record.
+ * @param dataIn numRecords records of size bytes.
+ * @param numRecords Number of records in dataIn.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records queued.
+ */
+int dlgr_LogBatchH(dlgr_handle_t handle, ssize_t size, void *dataIn, int numRecords);
+
 /**
  * @brief Retrieves logged data.
  * 
@@ -134,13 +453,60 @@ int dlgr_LogData(char *moduleName, ssize_t size, void *data);
  * of memory that needs to be allocated to store the number of logs that are
  * being requested.
  * 
+ * Records are copied newest first, each still framed by FBEGIN and FEND,
+ * so the n-th record's data starts at output + n * stride + DLGR_RECORD_DATA_OFFSET.
+ * Only the requested records are read, walking back across older .dat
+ * files as needed, through a dlgr_iter_t on the stack; nothing is allocated.
+ * Records not yet written by the datalogger thread are not included.
+ * 
  * @param output The location in memory where the data will be stored.
  * @param numRequestedLogs How many logs would you like?
  * @param moduleName The name of the caller module.
- * @return int Negative on error (see: datalogger_extern.h's ERROR enum), 1 on success.
+ * @return int Negative on error (see: datalogger_extern.h's ERROR enum), 1 on success. ERR_READ_NUM if fewer logs exist; those that do are still in output.
  */
 int dlgr_RetrieveData(char *moduleName, char *output, int numRequestedLogs);
 
+/**
+ * @brief dlgr_RetrieveData for a handle returned by dlgr_init, without the name lookup.
+ * 
+ * @param handle The calling module's handle.
+ * @param output The location in memory where the data will be stored.
+ * @param numRequestedLogs How many logs would you like?
+ * @return int Negative on error (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_RetrieveDataH(dlgr_handle_t handle, char *output, int numRequestedLogs);
+
+/**
+ * @brief Retrieves the records logged within a CLOCK_REALTIME interval, newest first.
+ * 
+ * Records are laid out in output like dlgr_RetrieveData's and read the same
+ * way. Files whose header's firstRecordTime is after tEnd are skipped unread.
+ * Within a file, the newest record up to tEnd is found by binary search, or
+ * in a compressed file by the time of each keyframe group, and reading
+ * stops at the first record before tStart. Records logged before
+ * timestamps existed are never returned.
+ * 
+ * @param moduleName The name of the caller module.
+ * @param tStart Start of the interval in nanoseconds, inclusive.
+ * @param tEnd End of the interval in nanoseconds, inclusive.
+ * @param output Destination, see: dlgr_QueryMemorySize.
+ * @param maxLogs Largest number of records output can hold.
+ * @return int Negative on error (see: DLGR_ERRORS), otherwise the number of records retrieved.
+ */
+int dlgr_RetrieveRange(char *moduleName, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs);
+
+/**
+ * @brief dlgr_RetrieveRange for a handle returned by dlgr_init, without the name lookup.
+ * 
+ * @param handle The calling module's handle.
+ * @param tStart Start of the interval in nanoseconds, inclusive.
+ * @param tEnd End of the interval in nanoseconds, inclusive.
+ * @param output Destination, see: dlgr_QueryMemorySize.
+ * @param maxLogs Largest number of records output can hold.
+ * @return int Negative on error (see: DLGR_ERRORS), otherwise the number of records retrieved.
+ */
+int dlgr_RetrieveRangeH(dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs);
+
 /**
  * @brief Provides the memory size necessary to store some number of logs.
  * 
@@ -156,33 +522,312 @@ int dlgr_RetrieveData(char *moduleName, char *output, int numRequestedLogs);
 ssize_t dlgr_QueryMemorySize(char *moduleName, int numRequestedLogs);
 
 /**
- * @brief Used to edit settings.cfg.
+ * @brief dlgr_QueryMemorySize for a handle returned by dlgr_init.
+ * 
+ * @param handle The calling module's handle.
+ * @param numRequestedLogs The number of logs that will be requested for retrieval.
+ * @return ssize_t The size necessary to store a number of logs, negative if the handle is invalid.
+ */
+ssize_t dlgr_QueryMemorySizeH(dlgr_handle_t handle, int numRequestedLogs);
+
+/**
+ * @brief Bytes of a .dat file a dlgr_iter_t reads at a time; records must fit.
+ * 
+ */
+#define DLGR_ITER_WINDOW 4096
+
+/**
+ * @brief Keyframe groups of a compressed file a dlgr_iter_t holds at a time.
  * 
- * This function sets a setting to a value within a module's own datalogger directory.
+ */
+#define DLGR_ITER_KEYFRAMES 64
+
+/**
+ * @brief A cursor over a module's records, newest to oldest, see: dlgr_iter_open.
+ * 
+ * Owned by the caller, typically on the stack, and used by one thread at a
+ * time. Its fields are private to the datalogger.
+ * 
+ */
+typedef struct
+{
+    dlgr_handle_t handle;
+    uint64_t fileIndex; // N of the N.dat being read.
+    int fd;             // Descriptor of N.dat, -1 once every file has been read.
+    int hasTimestamps;  // Records in N.dat carry a dlgr_timestamp_t.
+    int compressed;     // N.dat holds keyframes and deltas, see: dlgr_SetCompression.
+    ssize_t stride;     // Bytes per record in N.dat, if not compressed.
+    off_t dataStart;    // Offset of the first record or frame.
+    off_t dataEnd;      // End of the last complete record or valid frame.
+    int next;           // Record returned next, counting down; plain files only.
+    int packed;         // Records are returned without FBEGIN and FEND, see: DLGR_PACKED_STRIDE.
+    ssize_t outStride;  // Bytes per returned record.
+    uint64_t newest;    // Records newer than this CLOCK_REALTIME are skipped, see: dlgr_iter_search.
+    struct
+    {
+        off_t offset;   // Of the keyframe.
+        int numRecords; // The keyframe and the deltas following it.
+    } keys[DLGR_ITER_KEYFRAMES]; // Unreturned groups of a compressed N.dat, oldest first, ending with the newest one.
+    int numKeys;        // Groups in keys.
+    int groupLeft;      // Records of keys[numKeys - 1] still to return.
+    off_t winStart;     // File offset of window.
+    ssize_t winLen;     // Valid bytes in window.
+    char window[DLGR_ITER_WINDOW];
+} dlgr_iter_t;
+
+/**
+ * @brief Starts walking a module's records, newest to oldest, across its .dat files.
+ * 
+ * Unlike dlgr_RetrieveData, the iterator allocates nothing: files are read
+ * through the DLGR_ITER_WINDOW bytes inside iter, and records are copied
+ * straight into the buffers passed to dlgr_iter_next. Compressed files are
+ * decoded one keyframe group at a time. Files rotated in after this call and
+ * records not yet written by the datalogger thread are not included; a file
+ * recycled by the datalogger thread while it is read ends early.
+ * 
+ * @param iter The cursor, released with dlgr_iter_close.
+ * @param moduleName The name of the calling module.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success. ERR_MAXLOGSIZE_EXCEEDED if a record does not fit in DLGR_ITER_WINDOW.
+ */
+int dlgr_iter_open(dlgr_iter_t *iter, char *moduleName);
+
+/**
+ * @brief dlgr_iter_open for a handle returned by dlgr_init.
+ * 
+ * @param iter The cursor, released with dlgr_iter_close.
+ * @param handle The calling module's handle.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_iter_openH(dlgr_iter_t *iter, dlgr_handle_t handle);
+
+/**
+ * @brief Copies the next records of an iterator, in the layout of dlgr_RetrieveData.
+ * 
+ * @param iter The cursor.
+ * @param output Room for maxRecords records, see: dlgr_QueryMemorySize.
+ * @param maxRecords Largest number of records to copy.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records copied; 0 once every record has been returned.
+ */
+int dlgr_iter_next(dlgr_iter_t *iter, char *output, int maxRecords);
+
+/**
+ * @brief Releases an iterator. Safe to call on one that failed to open or was already closed.
+ * 
+ * @param iter The cursor.
+ */
+void dlgr_iter_close(dlgr_iter_t *iter);
+
+#define DLGR_EXPORT_MAGIC 0x5844 // "DX" in little-endian byte order.
+#define DLGR_EXPORT_VERSION 1
+
+#define DLGR_EXPORT_LAST 0x1 // The final frame of a pass, holding fewer than the most records.
+
+/**
+ * @brief Bytes of the CRC-16/CCITT-FALSE (see: dlgr_crc16) after the records of an export frame.
+ * 
+ */
+#define DLGR_EXPORT_CRC_SIZE 2
+
+/**
+ * @brief Header of a frame made by dlgr_export_next.
+ * 
+ * numRecords records of DLGR_PACKED_STRIDE(recordSize) bytes follow, newest
+ * first, and then the CRC of header and records. Every frame of a pass but the
+ * last holds the same number of records, so frame n starts with the
+ * (n * records per frame)-th record of the pass. Fields are in the byte order
+ * of the logging system.
+ * 
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;      // DLGR_EXPORT_MAGIC.
+    uint8_t version;     // DLGR_EXPORT_VERSION.
+    uint8_t flags;       // DLGR_EXPORT_* bits.
+    uint32_t sequence;   // Frame number within the pass, from 0.
+    uint32_t schemaId;   // See: DLGR_SCHEMA.
+    uint16_t recordSize; // Data bytes per record.
+    uint8_t numRecords;  // Records in this frame.
+    uint8_t reserved;    // Reserved, 0.
+} dlgr_export_header_t;
+
+/**
+ * @brief A pass over a time range of a module's records, cut into frames, see: dlgr_export_open.
+ * 
+ * Owned by the caller, like dlgr_iter_t; its fields are private to the datalogger.
+ * 
+ */
+typedef struct
+{
+    dlgr_iter_t iter;     // Returns packed records, see: DLGR_PACKED_STRIDE.
+    uint64_t tStart;      // CLOCK_REALTIME of the oldest record to export, in nanoseconds.
+    uint64_t tEnd;        // CLOCK_REALTIME of the newest record to export, in nanoseconds.
+    uint32_t schemaId;    // Copied to every frame.
+    uint16_t recordSize;  // Copied to every frame.
+    int perFrame;         // Records in every frame but the last.
+    uint32_t sequence;    // Of the next frame.
+    uint64_t skip;        // Records still to skip before the first frame, when resuming.
+    int exhausted;        // No record of the range is left.
+    int finished;         // The DLGR_EXPORT_LAST frame was made.
+} dlgr_export_t;
+
+/**
+ * @brief Starts cutting the records logged between tStart and tEnd into frames of at most mtu bytes.
+ * 
+ * Records are read into each frame in place, through the window of a
+ * dlgr_iter_t, and lose their FBEGIN and FEND. Files starting after tEnd are
+ * skipped without being read, and the pass ends at the first record before
+ * tStart. A pass cut short, e.g. by the end of a ground station pass, is
+ * resumed by opening the same range again with the sequence of the first
+ * frame that was not received; as long as none of these records have been
+ * recycled, the frames are the same as the first time.
+ * 
+ * @param exp The pass, released with dlgr_export_close.
+ * @param moduleName The name of the module whose records are exported.
+ * @param tStart CLOCK_REALTIME of the oldest record to export, in nanoseconds.
+ * @param tEnd CLOCK_REALTIME of the newest record to export, in nanoseconds.
+ * @param mtu Bytes per frame; room for at least one record, at most 255 records are sent per frame.
+ * @param firstSequence Sequence of the first frame, 0 for a new pass.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_export_open(dlgr_export_t *exp, char *moduleName, uint64_t tStart, uint64_t tEnd, int mtu, uint32_t firstSequence);
+
+/**
+ * @brief dlgr_export_open for a handle returned by dlgr_init.
+ * 
+ */
+int dlgr_export_openH(dlgr_export_t *exp, dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, int mtu, uint32_t firstSequence);
+
+/**
+ * @brief Makes the next frame of a pass.
+ * 
+ * @param exp The pass.
+ * @param frame Destination of at most mtu bytes, e.g. a slot of the radio queue.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the length of the frame; 0 after the DLGR_EXPORT_LAST frame.
+ */
+int dlgr_export_next(dlgr_export_t *exp, void *frame);
+
+/**
+ * @brief Releases a pass. Safe to call on one that failed to open or was already closed.
+ * 
+ * @param exp The pass.
+ */
+void dlgr_export_close(dlgr_export_t *exp);
+
+/**
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xffff), as appended to export frames.
+ * 
+ * @param data Bytes to check.
+ * @param len Number of bytes.
+ * @return uint16_t The CRC.
+ */
+uint16_t dlgr_crc16(const void *data, size_t len);
+
+/**
+ * @brief Edits a module's file and directory size limits.
+ * 
+ * The new value is stored in the datalogger state file (see: dlgr_Setup).
+ * The directory must hold at least one file: a change that would make the
+ * directory size smaller than the file size is rejected with ERR_SETTINGS_SET.
  * 
  * @param value The value to be written.
  * @param setting The setting to edit (see: datalogger_extern.h's SETTING enum).
  * @param directory The calling module's name, a unique directory.
- * @return int Negative on failure (see: datalogger_extern.h's ERROR enum), 1 on success.
+ * @return int Negative on failure (see: datalogger_extern.h's ERROR enum), 1 on success. ERR_NOT_READY before dlgr_Setup.
  */
 int dlgr_EditSettings(char *moduleName, int value, int setting);
 
-#ifdef MAIN_PRIVATE
+/**
+ * @brief Sets how often a module's open .dat file is flushed to storage.
+ * 
+ * The default is DLGR_SYNC_RECORD, which calls fdatasync() on the module's
+ * file after every record. DLGR_SYNC_COUNT and DLGR_SYNC_INTERVAL trade
+ * durability of the last few records for fewer flash writes.
+ * 
+ * @param moduleName The name of the calling module.
+ * @param policy The sync policy (see: DLGR_SYNC_POLICY).
+ * @param value Records between syncs for DLGR_SYNC_COUNT, milliseconds for DLGR_SYNC_INTERVAL. Ignored for DLGR_SYNC_RECORD.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_SetSyncPolicy(char *moduleName, int policy, int value);
 
 /**
- * @brief Name of the file where bootcount is stored on the file system.
+ * @brief Coalesces a module's records into larger writes.
  * 
+ * Framed records are staged in memory and written as one contiguous block
+ * once numRecords of them are staged or the oldest has waited maxDelayMs,
+ * whichever comes first. The on-disk FBEGIN/FEND framing is unchanged.
+ * Staged records are lost on power failure and are not yet visible to
+ * dlgr_RetrieveData. The default, numRecords = 1, writes every record
+ * immediately.
+ * 
+ * @param moduleName The name of the calling module.
+ * @param numRecords Records per write, 1 to DLGR_BATCH_MAX_RECORDS.
+ * @param maxDelayMs Longest time a record may stay staged, in milliseconds.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
  */
-#define BOOTCOUNT_FNAME "bootcount_fname.txt"
+int dlgr_SetBatching(char *moduleName, int numRecords, int maxDelayMs);
+
+/**
+ * @brief Stores a module's records as periodic keyframes and deltas.
+ * 
+ * A keyframe holds one record as is. Every other record is stored as the
+ * change of each 16-bit word from the previous record, zig-zag varint
+ * encoded, with runs of unchanged words collapsed; a record in which only
+ * a few counters moved takes a handful of bytes. Every file starts with a
+ * keyframe, so files are still deleted and read independently. Switching
+ * modes starts a new file. Retrieval decodes transparently, one keyframe
+ * group at a time, so a shorter interval reads and decodes less of a file.
+ * 
+ * @param moduleName The name of the calling module.
+ * @param keyframeInterval Records per keyframe, including the keyframe. 0 turns compression off, the default.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_SetCompression(char *moduleName, int keyframeInterval);
+
+/**
+ * @brief Fetches the queue counters of a module.
+ * 
+ * @param moduleName The name of the calling module.
+ * @param stats Output for the counters.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_GetQueueStats(char *moduleName, dlgr_queue_stats_t *stats);
 
 /**
- * @brief Function that returns the current bootcount of the system.
- * Returns current boot count, and increases by 1 and stores it in nvmem.
- * Expected to be invoked only by _main()
+ * @brief Datalogger call sites timed for dlgr_GetLatency.
  * 
- * @return int Current boot count (C-style)
  */
-int bootCount(void);
+typedef enum
+{
+    DLGR_LAT_LOG = 0,        // dlgr_LogData and dlgr_LogBatch, both forms.
+    DLGR_LAT_RETRIEVE,       // dlgr_RetrieveData, both forms.
+    DLGR_LAT_RETRIEVE_RANGE, // dlgr_RetrieveRange, both forms.
+    DLGR_LAT_FLUSH,          // Writing one batch to its .dat file, on the datalogger thread.
+    DLGR_LAT_ITER,           // dlgr_iter_next.
+    DLGR_LAT_NUM
+} DLGR_LATENCY;
+
+/**
+ * @brief Fetches the latency of a datalogger call site, across all modules.
+ * 
+ * @param site The call site.
+ * @param summary Output.
+ * @return int 1 on success, ERR_INVALID_INPUT on invalid input or if built with NO_LATENCY_STATS.
+ */
+int dlgr_GetLatency(DLGR_LATENCY site, lat_summary_t *summary);
+
+#ifdef MAIN_PRIVATE
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Name of the file where bootcount was stored before the datalogger state file, read once by dlgr_Setup.
+ * 
+ */
+#define BOOTCOUNT_FNAME "bootcount_fname.txt"
 
 // interrupt handler for SIGINT
 void catch_sigint(int);
@@ -191,42 +836,535 @@ void catch_sigint(int);
 #define SIZE_FILE_HARDLIMIT 1048576 // 1MB
 #define SIZE_DIR_HARDLIMIT 16777216 // 16MB
 
-typedef struct DATALOGGER
+/**
+ * @brief Number of records each module can have waiting for the datalogger thread. Must be a power of 2.
+ * 
+ */
+#define DLGR_RING_SLOTS 64
+
+/**
+ * @brief Longest time the datalogger thread sleeps between queue checks, in milliseconds.
+ * 
+ */
+#define DLGR_WRITER_PERIOD_MS 100
+
+/**
+ * @brief Time a module keeps appending to its full .dat file after a rotation failed, in milliseconds.
+ * 
+ */
+#define DLGR_ROTATE_RETRY_MS 1000
+
+/**
+ * @brief Largest number of records dlgr_SetBatching can coalesce into one write.
+ * 
+ */
+#define DLGR_BATCH_MAX_RECORDS 64
+
+/**
+ * @brief Limits of a module without stored settings, see: dlgr_EditSettings.
+ * 
+ */
+#define DLGR_DEFAULT_FILE_SIZE 8192
+#define DLGR_DEFAULT_DIR_SIZE 4194304
+
+/**
+ * @brief The datalogger state file, in DLGR_LOG_DIR, see: dlgr_Setup.
+ * 
+ * Two slots of DLGR_STATE_SLOT_SIZE bytes, each a dlgr_state_header_t,
+ * numEntries dlgr_state_entry_t and the dlgr_crc16 of both. Writes go to
+ * the slot of the other one, so the newest valid slot survives a torn write.
+ * 
+ */
+#define DLGR_LOG_DIR "log"
+#define DLGR_STATE_FNAME "state.bin"
+#define DLGR_STATE_MAGIC 0x54534c44 // "DLST"
+#define DLGR_STATE_VERSION 1
+#define DLGR_STATE_SLOT_SIZE 4096
+#define DLGR_STATE_NAME_MAX 32
+
+typedef struct __attribute__((packed))
 {
+    uint32_t magic;      // DLGR_STATE_MAGIC.
+    uint16_t version;    // DLGR_STATE_VERSION.
+    uint16_t numEntries; // Modules following.
+    uint32_t sequence;   // Incremented by every write; the slot is sequence & 1.
+    int32_t bootCount;   // sys_boot_count of the next boot.
+} dlgr_state_header_t;
+
+typedef struct __attribute__((packed))
+{
+    char moduleName[DLGR_STATE_NAME_MAX]; // NUL padded.
     uint64_t logIndex;
+    int32_t maxFileSize;
+    int32_t maxDirSize;
+} dlgr_state_entry_t;
+
+#define DLGR_STATE_MAX_ENTRIES ((DLGR_STATE_SLOT_SIZE - sizeof(dlgr_state_header_t) - sizeof(uint16_t)) / sizeof(dlgr_state_entry_t))
+
+// Two ints of a setting that another thread changes, packed into one atomic word.
+#define DLGR_SETTING_PACK(first, second) (((uint64_t)(uint32_t)(first) << 32) | (uint32_t)(second))
+#define DLGR_SETTING_FIRST(setting) ((int)(uint32_t)((setting) >> 32))
+#define DLGR_SETTING_SECOND(setting) ((int)(uint32_t)(setting))
+
+typedef struct DATALOGGER
+{
+    _Atomic uint64_t logIndex; // Index of the current .dat file, only changed under dlgr_state_m once stored, see: dlgr_save_state.
     ssize_t moduleLogSize;
-    int maxFileSize;
-    int maxDirSize;
+    ssize_t recordStride; // DLGR_RECORD_STRIDE(moduleLogSize).
+    _Atomic uint64_t sizeSetting; // maxFileSize and maxDirSize in one word, so the datalogger thread never sees half of a change, see: dlgr_EditSettings.
+    int dirFd;           // Open descriptor of log/<moduleName>/, every file operation is relative to it.
+    int dataFd;          // Open descriptor of <logIndex>.dat, -1 when closed.
+    ssize_t fileSize;    // End of the records in <logIndex>.dat in bytes, where the next write goes.
+    int fileReused;      // <logIndex>.dat is a recycled file; fileSize is also kept in its header's dataEnd.
+    uint32_t fileFlags;  // DLGR_HEADER_* of <logIndex>.dat, records are only appended to a file of the same layout.
+    uint64_t rotateRetryMs; // CLOCK_MONOTONIC time before which a full file is not rotated again, see: DLGR_ROTATE_RETRY_MS.
+    _Atomic uint64_t syncSetting; // DLGR_SYNC_POLICY and its value in one word, so the datalogger thread never sees half of a change, see: dlgr_SetSyncPolicy.
+    int unsyncedRecords; // Records written since the last fdatasync().
+    uint64_t lastSyncMs; // CLOCK_MONOTONIC time of the last fdatasync().
+    char *batch;         // Staging buffer of up to DLGR_BATCH_MAX_RECORDS framed (FBEGIN + timestamp + data + FEND) or compressed records.
+    int batchCount;      // Records currently staged in batch.
+    ssize_t batchBytes;  // Bytes currently staged in batch.
+    int batchCompressed; // Staged records are compressed frames; latched from keyframeInterval when a batch starts.
+    int batchKeyframeInterval; // keyframeInterval latched when a batch starts, used by its records.
+    uint64_t batchSizeSetting; // sizeSetting latched when a batch starts, used when it is flushed.
+    _Atomic uint64_t batchSetting; // Staged records that trigger a write and the longest time one may stay staged, in one word, see: dlgr_SetBatching.
+    uint64_t batchFirstMs; // CLOCK_MONOTONIC time the oldest staged record was staged.
+    uint64_t batchFirstTime; // CLOCK_REALTIME stamp of the oldest staged record.
+    uint32_t schemaId;   // See: DLGR_SCHEMA.
+    _Atomic int keyframeInterval; // Set by any thread, see: dlgr_SetCompression.
+    int framesSinceKey;   // Records since the last keyframe, 0 to force one.
+    uint16_t *compressPrev;            // Previous record as DLGR_RECORD_WORDS words, the base of the next delta.
+    dlgr_timestamp_t compressPrevTime; // Timestamp of the same.
+
+    // Single-producer/single-consumer queue between the logging module and the datalogger thread.
+    char *ring;                       // DLGR_RING_SLOTS records of moduleLogSize bytes.
+    ssize_t *ringSize;                // Size of the record held in each slot.
+    dlgr_timestamp_t *ringTime;       // Time the record in each slot was logged.
+    _Atomic uint32_t ringHead;        // Slots filled by the producer, free running.
+    _Atomic uint32_t ringTail;        // Slots drained by the datalogger thread, free running.
+    _Atomic uint32_t ringHighWater;   // See: dlgr_queue_stats_t.
+    _Atomic uint64_t ringEnqueued;    // See: dlgr_queue_stats_t.
+    _Atomic uint64_t ringDropped;     // See: dlgr_queue_stats_t.
+    _Atomic uint64_t ringWritten;     // See: dlgr_queue_stats_t.
+    _Atomic uint64_t ringWriteErrors; // See: dlgr_queue_stats_t.
 } datalogger_t;
 
 /**
- * @brief Initializes the datalogger and its files.
+ * @brief The layout of one .dat file, see: dlgr_describe_data.
  * 
- * If files such as index.inf exist, init will set dlgr's variables
- * to match. If they do not exist, init will create them.
- * Requests to log data must be composed of a data structure of the size 
- * passed here. Sizes smaller than max_size are allowable (datalogger
- * provides padding). This value, once set, can not be changed.
+ */
+typedef struct
+{
+    dlgr_file_header_t header;  // Zeroed for files without a header.
+    ssize_t dataStart;          // Offset of the first record.
+    ssize_t stride;             // Bytes per record in this file.
+    int hasTimestamps;          // Records carry a dlgr_timestamp_t.
+} dlgr_file_desc_t;
+
+// Compressed frames, see: dlgr_SetCompression.
+#define DLGR_FRAME_KEY 0x4b   // 'K', a dlgr_timestamp_t and the record as is.
+#define DLGR_FRAME_DELTA 0x44 // 'D', varint timestamp deltas and per-word deltas.
+
+// Number of 16-bit words delta frames split a record of size bytes into.
+#define DLGR_RECORD_WORDS(size) (((size) + 1) / 2)
+
+// Largest compressed frame of a record of size bytes: type, two timestamp varints, a 3-byte varint per word.
+#define DLGR_FRAME_MAX(size) (1 + 10 + 10 + 3 * DLGR_RECORD_WORDS(size))
+
+#define DLGR_ZIGZAG16(x) ((uint16_t)(((uint16_t)(x) << 1) ^ (uint16_t)((x) >> 15)))
+#define DLGR_UNZIGZAG16(z) ((uint16_t)(((z) >> 1) ^ (~((z) & 1) + 1)))
+#define DLGR_ZIGZAG64(x) (((uint64_t)(x) << 1) ^ (uint64_t)((x) >> 63))
+#define DLGR_UNZIGZAG64(z) (((z) >> 1) ^ (~((z) & 1) + 1))
+
+/**
+ * @brief Registered modules: dlgr_idx of them, by handle. Both arrays are carved from the arena by dlgr_ArenaInit.
+ * 
+ * dlgr_idx is published with release once a module's entries are complete; read it with acquire.
  * 
- * @param moduleName The calling module's name for which this datalogger is being initialized.
- * @param maxLogSize The maximum desired log size for this module's logs.
- * @return int Negative on failure (see: datalogger_extern.h's ERROR enum), 1 on success.
  */
-int dlgr_init(char* moduleName, ssize_t maxLogSize);
+extern _Atomic int dlgr_idx;
+extern datalogger_t *dlgr_settings;
+extern char **dlgr_modname;
 
 /**
- * @brief A helper function for dlgr_retrieveData
+ * @brief Woken by dlgr_LogData and the SIGINT handler to have the datalogger thread drain the queues.
  * 
- * @param output A char* to store the output.
- * @param numRequestedLogs The number of logs to be fetched.
- * @param moduleName The name of the calling module.
- * @param indexOffset Essentially, the number of files we've had to go through already.
- * @return int The number of logs added to output.
  */
-int dlgr_retrieve(char *moduleName, char *output, int numRequestedLogs, int indexOffset);
+extern pthread_cond_t dlgr_wakeup[1];
+
+/**
+ * @brief Bytes of the arena one module's buffers take, see: dlgr_init.
+ * 
+ * @param maxLogSize The module's record size.
+ * @return size_t Bytes, each buffer rounded up to the arena's alignment.
+ */
+size_t dlgr_module_footprint(ssize_t maxLogSize);
+
+/**
+ * @brief Opens a registered module's directory and restores its index and settings, see: dlgr_Setup.
+ * 
+ * @param handle The module's handle.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_open_module(dlgr_handle_t handle);
+
+/**
+ * @brief dlgr_init once its input is checked, with dlgr_state_m held.
+ * 
+ * Fills the next entry of dlgr_settings, opens the module if dlgr_Setup is
+ * done, and only then publishes it by advancing dlgr_idx.
+ * 
+ */
+dlgr_handle_t dlgr_register(char *moduleName, ssize_t maxLogSize, uint32_t schemaId);
+
+/**
+ * @brief Reads the newest valid slot of the state file.
+ * 
+ * @return int 1 if one was found, 0 otherwise.
+ */
+int dlgr_load_state(void);
+
+/**
+ * @brief The state file's entry of a module, NULL if it has none.
+ * 
+ */
+dlgr_state_entry_t *dlgr_find_state(const char *moduleName);
+
+/**
+ * @brief Writes the boot count and every set up module's index and settings to the state file, and syncs it.
+ * 
+ * @param pending A module whose index advances with this write, or NULL.
+ * @param pendingIndex The index stored for pending, which becomes its logIndex once the write succeeds.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_save_state(datalogger_t *pending, uint64_t pendingIndex);
+
+/**
+ * @brief dlgr_save_state, with dlgr_state_m already held.
+ * 
+ */
+int dlgr_store_state(datalogger_t *pending, uint64_t pendingIndex);
+
+/**
+ * @brief Hands out the next size bytes of the arena, zeroed.
+ * 
+ * @param size Bytes needed.
+ * @return void* The block, NULL if the arena cannot hold it.
+ */
+void *dlgr_arena_alloc(size_t size);
+
+/**
+ * @brief dlgr_LogBatchH, dlgr_RetrieveDataH, dlgr_RetrieveRangeH and dlgr_iter_next without their timing.
+ * 
+ */
+int dlgr_log_batch(dlgr_handle_t handle, ssize_t size, void *dataIn, int numRecords);
+int dlgr_retrieve_data(dlgr_handle_t handle, char *output, int numRequestedLogs);
+int dlgr_retrieve_range(dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs);
+int dlgr_iter_read(dlgr_iter_t *iter, char *output, int maxRecords);
+
+/**
+ * @brief dlgr_iter_openH with the options of dlgr_export_open.
+ * 
+ * @param iter The cursor.
+ * @param handle The module's handle.
+ * @param packed Return records without FBEGIN and FEND.
+ * @param newest Skip files whose first record is newer, UINT64_MAX for none.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_iter_start(dlgr_iter_t *iter, dlgr_handle_t handle, int packed, uint64_t newest);
+
+/**
+ * @brief Reads up to maxRecords records of an iterator, keeping those within [tStart, tEnd].
+ * 
+ * @param iter The cursor.
+ * @param tStart Start of the interval in nanoseconds, inclusive.
+ * @param tEnd End of the interval in nanoseconds, inclusive.
+ * @param output Destination of maxRecords records.
+ * @param maxRecords Records read from iter.
+ * @param exhausted Set once no older record can be within the interval.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records kept.
+ */
+int dlgr_iter_read_range(dlgr_iter_t *iter, uint64_t tStart, uint64_t tEnd, char *output, int maxRecords, int *exhausted);
+
+/**
+ * @brief Opens the next older .dat file holding records, or the first one if first is set.
+ * 
+ * @param iter The cursor.
+ * @param first Open iter->fileIndex itself rather than the file before it.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 if a file was opened, 0 once there are none left.
+ */
+int dlgr_iter_advance(dlgr_iter_t *iter, int first);
+
+/**
+ * @brief Copies up to maxRecords of the newest unreturned records of a plain file.
+ * 
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records copied, 0 once the file is done.
+ */
+int dlgr_iter_read_plain(dlgr_iter_t *iter, char *output, int maxRecords);
+
+/**
+ * @brief Binary searches a plain file with timestamps for the records up to iter->newest.
+ * 
+ * Takes O(log numRecords) reads, through the iterator's window; the window is
+ * left holding the records around the newest one found. Files are skipped
+ * by their header's firstRecordTime instead, and compressed files by the
+ * time of each keyframe group during dlgr_iter_scan, as their frames can
+ * only be found from the start of the file.
+ * 
+ * @param iter The cursor, on the file to search.
+ * @param numRecords Complete records in the file.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records, oldest first, not after iter->newest.
+ */
+int dlgr_iter_search(dlgr_iter_t *iter, int numRecords);
+
+/**
+ * @brief Copies up to maxRecords of the newest unreturned records of a compressed file.
+ * 
+ * @return int The number of records copied, 0 once the file is done.
+ */
+int dlgr_iter_read_frames(dlgr_iter_t *iter, char *output, int maxRecords);
+
+/**
+ * @brief Finds the newest DLGR_ITER_KEYFRAMES keyframe groups of a compressed file before end.
+ * 
+ * Frames are walked from the start of the file, as they can only be told
+ * apart going forward. The walk stops at the first keyframe after
+ * iter->newest, so the groups after it are never decoded. A scan up to
+ * dataEnd also moves dataEnd back to the end of the last valid frame.
+ * 
+ * @param iter The cursor.
+ * @param end Offset the groups must start before.
+ * @return int Number of groups found.
+ */
+int dlgr_iter_scan(dlgr_iter_t *iter, off_t end);
+
+/**
+ * @brief Reads the file into an iterator's window so that it holds a whole frame at offset, if the file does.
+ * 
+ * @param iter The cursor.
+ * @param offset File offset of the frame.
+ * @param avail Output, bytes available at the returned pointer.
+ * @return const char* The frame within the window, NULL if offset is past what can be read.
+ */
+const char *dlgr_iter_window(dlgr_iter_t *iter, off_t offset, ssize_t *avail);
+
+/**
+ * @brief Checks whether the datalogger thread has reused the file being read since it was opened.
+ * 
+ * A reused file gets a new header before any of its records are
+ * overwritten, so data read before this returns 0 is from the file opened.
+ * 
+ * @param iter The cursor.
+ * @return int 1 if the file has been reused or its header cannot be read, otherwise 0.
+ */
+int dlgr_iter_reused(dlgr_iter_t *iter);
+
+/**
+ * @brief Datalogger thread. Drains every module's queue into its .dat file.
+ * 
+ * @param tid Pointer to an integer containing the thread ID.
+ * @return Void pointer.
+ */
+void *dlgr_thread(void *tid);
+
+/**
+ * @brief Writes every record waiting in a module's queue.
+ * 
+ * Must only be called by the datalogger thread, or once it has exited.
+ * 
+ * @param mod_idx Index of the module in dlgr_settings.
+ * @return int Number of records drained.
+ */
+int dlgr_drain(int mod_idx);
+
+/**
+ * @brief Frames one record into a module's staging buffer and flushes it once the batch is full.
+ * 
+ * @param mod_idx Index of the module in dlgr_settings.
+ * @param size The size of the data to be logged.
+ * @param dataIn The data to be logged.
+ * @param timestamp Time the record was logged.
+ * @return int Negative on failure (see: DLGR_ERRORS), positive on success.
+ */
+int dlgr_write(int mod_idx, ssize_t size, void *dataIn, const dlgr_timestamp_t *timestamp);
+
+/**
+ * @brief Writes every staged record of a module to its current .dat file, rotating it as needed.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records written.
+ */
+int dlgr_flush(datalogger_t *dlgr);
+
+/**
+ * @brief writev() that retries after short writes and EINTR.
+ * 
+ * @param fd Destination descriptor.
+ * @param iov Buffers to write; modified on short writes.
+ * @param iovcnt Number of buffers.
+ * @return ssize_t Bytes written, -1 if nothing could be written.
+ */
+ssize_t dlgr_writev_all(int fd, struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Fills in the header for a module's current .dat file.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param header Output.
+ */
+void dlgr_make_header(datalogger_t *dlgr, dlgr_file_header_t *header);
+
+/**
+ * @brief Reads and validates the header of a .dat file.
+ * 
+ * @param fd Descriptor of the .dat file.
+ * @param header Output.
+ * @return int 1 if the file has a valid header, 0 if it has none (empty or written before headers existed), negative on failure.
+ */
+int dlgr_read_header(int fd, dlgr_file_header_t *header);
+
+/**
+ * @brief DLGR_HEADER_* flags of a file holding the module's staged batch.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @return uint32_t The flags.
+ */
+uint32_t dlgr_file_flags(datalogger_t *dlgr);
+
+/**
+ * @brief Writes an unsigned LEB128 varint.
+ * 
+ * @param out Destination, at least 10 bytes.
+ * @param value Value to write.
+ * @return int Bytes written.
+ */
+int dlgr_put_varint(uint8_t *out, uint64_t value);
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ * 
+ * @param in Source.
+ * @param avail Bytes available at in.
+ * @param value Output.
+ * @return int Bytes read, 0 if the varint is truncated or too long.
+ */
+int dlgr_get_varint(const uint8_t *in, ssize_t avail, uint64_t *value);
+
+/**
+ * @brief Encodes one record as a keyframe or delta frame and advances the module's compressor.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param dataIn The record.
+ * @param size Size of the record, at most moduleLogSize.
+ * @param timestamp Time the record was logged.
+ * @param frame Destination, at least DLGR_FRAME_MAX(moduleLogSize) bytes.
+ * @return ssize_t Bytes written to frame.
+ */
+ssize_t dlgr_encode_record(datalogger_t *dlgr, const void *dataIn, ssize_t size, const dlgr_timestamp_t *timestamp, char *frame);
+
+/**
+ * @brief Decodes one keyframe or delta frame.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param in The frame.
+ * @param avail Bytes at in.
+ * @param prev The previous record as DLGR_RECORD_WORDS words; replaced by this one.
+ * @param prevTime Timestamp of the previous record; replaced by this one's.
+ * @param haveKey Non-zero if prev holds a record, without which a delta frame is invalid.
+ * @param packed Write the record without FBEGIN and FEND, see: DLGR_PACKED_STRIDE.
+ * @param record Destination in the plain or packed layout, or NULL to only advance prev.
+ * @return int Bytes of the frame, 0 if it is truncated or invalid.
+ */
+int dlgr_decode_frame(datalogger_t *dlgr, const char *in, ssize_t avail, uint16_t *prev, dlgr_timestamp_t *prevTime, int haveKey, int packed, char *record);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC time in milliseconds.
+ * 
+ * @return uint64_t Milliseconds since an arbitrary, fixed point.
+ */
+uint64_t dlgr_now_ms();
+
+/**
+ * @brief Reads both clocks into a record timestamp.
+ * 
+ * @param timestamp Output.
+ */
+void dlgr_now_timestamp(dlgr_timestamp_t *timestamp);
+
+/**
+ * @brief Fills in desc from an open .dat file.
+ * 
+ * Files written before headers or timestamps existed are described as such,
+ * so dlgr_copy_plain can return their records in the current layout.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param fd Descriptor of the .dat file.
+ * @param desc Output; must be zeroed, as a file without a header leaves all but stride alone.
+ * @return int 1 if the file has a header, 0 if not, negative on failure (see: DLGR_ERRORS). ERR_LOG_SIZE if it holds other records.
+ */
+int dlgr_describe_data(datalogger_t *dlgr, int fd, dlgr_file_desc_t *desc);
+
+/**
+ * @brief Copies one record as stored in a plain .dat file to output in the current record layout.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param record The record, FBEGIN first.
+ * @param hasTimestamps The record carries a dlgr_timestamp_t.
+ * @param packed Leave out FBEGIN and FEND, see: DLGR_PACKED_STRIDE.
+ * @param output Destination of dlgr->recordStride bytes, or DLGR_PACKED_STRIDE(moduleLogSize) if packed.
+ */
+void dlgr_copy_plain(datalogger_t *dlgr, const char *record, int hasTimestamps, int packed, char *output);
+
+/**
+ * @brief Applies a module's sync policy to its open .dat file.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param force Sync regardless of the policy if non-zero.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_sync(datalogger_t *dlgr, int force);
+
+/**
+ * @brief Opens <logIndex>.dat of a module for writing and caches its descriptor and size.
+ * 
+ * The descriptor is positioned at the end of the records, which in a reused
+ * file is its header's dataEnd rather than the file's size.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @param flags Additional open() flags, such as O_TRUNC.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success.
+ */
+int dlgr_open_data(datalogger_t *dlgr, int flags);
+
+/**
+ * @brief Closes a full .dat file, advances the module's index and opens the next file.
+ * 
+ * Once the directory holds maxDirSize / maxFileSize files, the oldest one is
+ * renamed to the next index and reused rather than deleted. The reused file
+ * keeps its blocks: it is not truncated, its header is rewritten with an
+ * empty dataEnd and it is overwritten from the start. A new file is
+ * preallocated instead. The new index is committed last through
+ * dlgr_save_state, so a power failure at any point leaves either the old
+ * or the new index together with its file. Once committed, files older than
+ * the recycled one, left over from larger limits, are deleted.
+ * 
+ * @param dlgr The module's datalogger settings.
+ * @return int Negative on failure (see: DLGR_ERRORS), 1 on success. ERR_DATA_REMOVE if an old file could not be recycled or deleted; the next file is open regardless. On other failures the full file is open again, if it can be.
+ */
+int dlgr_rotate(datalogger_t *dlgr);
+
+/**
+ * @brief fopen() relative to a directory descriptor instead of the working directory.
+ * 
+ * @param dirFd Descriptor of the directory containing the file.
+ * @param fileName Name of the file inside the directory.
+ * @param mode fopen() mode; "r", "w" and "a" (optionally with "b" or "+") are supported.
+ * @return FILE* The opened stream, NULL on failure.
+ */
+FILE *dlgr_fopenat(int dirFd, const char *fileName, const char *mode);
 
 /**
- * @brief WIP
+ * @brief Flushes and closes every open .dat file and frees datalogger buffers.
  * 
  */
 void dlgr_destroy();
@@ -13,51 +13,103 @@
 #define __SH_MODULES_H
 #ifdef MAIN_PRIVATE
 #include <pthread.h>
+#include <stddef.h>
 #include "eps_iface.h"
 #include "eps_test_iface.h"
-typedef int (*init_func)(void);     // typedef to create array of init functions
-typedef void (*destroy_func)(void); // typedef to create array of destroy functions
+typedef int (*init_func)(void);       // typedef of a module's init function
+typedef void *(*exec_func)(void *);   // typedef of a module's thread
+typedef void (*destroy_func)(void);   // typedef of a module's destroy function
 
 /**
- * @brief Registers init functions of a given module
+ * @brief Describes a module to main(), entirely at compile time.
+ * 
+ * main() registers every module's datalogger channels, sized into the arena,
+ * then runs the init functions in order, starts one thread per exec function
+ * and, once every thread has joined, runs the destroy functions in reverse.
+ * 
+ * All memory is locked with mlockall, and every thread gets a stack of
+ * stack_size bytes whose first MAIN_STACK_PREFAULT bytes are touched before
+ * exec runs, so that neither the exec function nor a page fault on its
+ * stack waits for the SD card.
  */
-init_func module_init[] = {
-    eps_init,
-};
+typedef struct
+{
+    const char *name;               // For messages.
+    init_func init;                 // NULL if none.
+    exec_func exec;                 // The module's thread, NULL if none.
+    destroy_func destroy;           // NULL if none.
+    pthread_cond_t *wakeup;         // Broadcast by the SIGINT handler, NULL if none.
+    int priority;                   // SCHED_FIFO priority of the thread, 0 for the default policy.
+    unsigned long cpus;             // Mask of the CPUs the thread may run on, 0 for any.
+    size_t stack_size;              // Stack of the thread, 0 for MAIN_STACK_SIZE.
+    const dlgr_channel_t *channels; // The module's datalogger channels and their record types.
+    int num_channels;               // Entries in channels.
+    dlgr_handle_t *handles;         // num_channels handles, set by main() before init.
+} module_t;
+
+#define MAIN_STACK_SIZE (256 * 1024)   // default thread stack, locked in memory as a whole
+#define MAIN_STACK_PREFAULT (64 * 1024) // stack touched before a thread's exec function runs
+
 /**
- * @brief Number of modules with an associated init function
+ * @brief What main_thread_entry runs: a module's exec function and its argument.
  */
-const int num_init = sizeof(module_init) / sizeof(init_func);
+typedef struct
+{
+    const module_t *module; // NULL for a worker, see: main_start_worker.
+    int id;                 // Thread ID passed to the module's exec.
+    exec_func exec;         // A worker's function, run instead of a module's.
+    void *arg;              // Passed to a worker's exec.
+} main_thread_t;
 
 /**
- * @brief Registers init functions of a given module
+ * @brief Starts a module's thread, see: module_t.
  */
-destroy_func module_destroy[] = {
-    eps_destroy,
-};
+int main_start_thread(main_thread_t *start, pthread_t *thread);
+
 /**
- * @brief Number of modules with an associated destroy function
+ * @brief Prefaults the thread's stack, then runs the module's exec function, or the worker's.
  */
-const int num_destroy = sizeof(module_destroy) / sizeof(destroy_func);
+void *main_thread_entry(void *arg);
 
 /**
- * @brief Registers exec functions of a given module
+ * @brief Registers every module. The datalogger comes first so that it is destroyed last.
  */
-void *module_exec[] = {
-    eps_thread,
-    eps_test,
+const module_t modules[] = {
+    {
+        .name = "datalogger",
+        .exec = dlgr_thread,
+        .destroy = dlgr_destroy,
+        .wakeup = dlgr_wakeup,
+        .priority = 10,
+        .cpus = 0x1, // SD card writes stay off the EPS thread's CPU.
+    },
+    {
+        .name = "eps",
+        .init = eps_init,
+        .exec = eps_thread,
+        .destroy = eps_destroy,
+        .wakeup = eps_cmd_wait,
+        .priority = 20,
+        .cpus = 0x2,
+        .channels = eps_channels,
+        .num_channels = EPS_NUM_CHANNELS,
+        .handles = eps_handles,
+    },
+    {
+        .name = "eps_watchdog",
+        .exec = eps_wdt_thread,
+        .wakeup = eps_wdt_wait,
+        .priority = 30, // Above the EPS thread, so a poll cannot delay a kick.
+        .cpus = 0x2,
+    },
+    {
+        .name = "eps_test",
+        .exec = eps_test,
+    },
 };
 /**
- * @brief Number of enabled modules
- */
-const int num_systems = sizeof(module_exec) / sizeof(void *);
-
-/**
- * @brief List of condition locks for modules to be woken up by signal handler
+ * @brief Number of registered modules
  */
-pthread_cond_t *wakeups[] = {
-
-};
-const int num_wakeups = sizeof(wakeups) / sizeof(pthread_cond_t *);
+const int num_modules = sizeof(modules) / sizeof(module_t);
 #endif
 #endif // __SH_MODULES_H
\ No newline at end of file
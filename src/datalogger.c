@@ -0,0 +1,2163 @@
+/**
+ * @file datalogger.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief The datalogger: per-module queues, the writer thread, .dat files and retrieval.
+ * @version 0.3
+ * @date 2021-03-17
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#define _GNU_SOURCE        // fallocate()
+#define MAIN_PRIVATE       // enable prototypes in main.h
+#define DATALOGGER_PRIVATE //
+#include <main.h>
+#undef MAIN_PRIVATE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+char FBEGIN[6] = {'F', 'B', 'E', 'G', 'I', 'N'};
+char FEND[4] = {'F', 'E', 'N', 'D'};
+
+_Atomic int dlgr_idx = 0;
+datalogger_t *dlgr_settings = NULL;
+char **dlgr_modname = NULL;
+
+pthread_cond_t dlgr_wakeup[1] = {PTHREAD_COND_INITIALIZER};
+pthread_mutex_t dlgr_wakeup_m[1] = {PTHREAD_MUTEX_INITIALIZER};
+
+#ifndef NO_LATENCY_STATS
+lat_hist_t dlgr_lat[DLGR_LAT_NUM];
+#endif
+
+/**
+ * @brief The one block every datalogger buffer is carved from, see: dlgr_ArenaInit.
+ * 
+ */
+static char *dlgr_arena = NULL;
+static size_t dlgr_arena_capacity = 0;
+static size_t dlgr_arena_used = 0;
+static int dlgr_arena_modules = 0; // Entries of dlgr_settings and dlgr_modname.
+
+/**
+ * @brief The datalogger state file, see: dlgr_Setup. Written under dlgr_state_m,
+ * which also serializes module registration, see: dlgr_register.
+ * 
+ */
+static int dlgr_log_fd = -1;   // log/
+static int dlgr_state_fd = -1; // log/DLGR_STATE_FNAME
+static dlgr_state_header_t dlgr_state;
+static dlgr_state_entry_t dlgr_state_entries[DLGR_STATE_MAX_ENTRIES];
+static pthread_mutex_t dlgr_state_m[1] = {PTHREAD_MUTEX_INITIALIZER};
+static _Atomic int dlgr_setup_done = 0;
+
+#define MODULE_FNAME_SZ 128
+
+// Progress messages of the write and retrieval paths, compiled in with -DDLGR_DEBUG.
+#ifdef DLGR_DEBUG
+#define dlgr_debug(str, ...) do { eprintf(str, ##__VA_ARGS__); } while (0)
+#else
+#define dlgr_debug(str, ...) do { } while (0)
+#endif
+
+#define DLGR_ARENA_ALIGN 16
+#define DLGR_ARENA_ROUND(size) (((size_t)(size) + DLGR_ARENA_ALIGN - 1) & ~(size_t)(DLGR_ARENA_ALIGN - 1))
+
+size_t dlgr_module_footprint(ssize_t maxLogSize)
+{
+    // The staging buffer fits the largest batch dlgr_SetBatching allows, in either
+    // layout; a compressed frame can be larger than a plain one only for tiny records.
+    ssize_t frameMax = DLGR_FRAME_MAX(maxLogSize);
+    if (frameMax < (ssize_t)DLGR_RECORD_STRIDE(maxLogSize)){
+        frameMax = DLGR_RECORD_STRIDE(maxLogSize);
+    }
+
+    return DLGR_ARENA_ROUND(frameMax * DLGR_BATCH_MAX_RECORDS) +
+           DLGR_ARENA_ROUND(DLGR_RECORD_WORDS(maxLogSize) * sizeof(uint16_t)) +
+           DLGR_ARENA_ROUND(maxLogSize * DLGR_RING_SLOTS) +
+           DLGR_ARENA_ROUND(sizeof(ssize_t) * DLGR_RING_SLOTS) +
+           DLGR_ARENA_ROUND(sizeof(dlgr_timestamp_t) * DLGR_RING_SLOTS);
+}
+
+void *dlgr_arena_alloc(size_t size)
+{
+    if (dlgr_arena_capacity - dlgr_arena_used < DLGR_ARENA_ROUND(size)){
+        return NULL;
+    }
+
+    void *block = dlgr_arena + dlgr_arena_used;
+    dlgr_arena_used += DLGR_ARENA_ROUND(size);
+    return block;
+}
+
+size_t dlgr_ArenaSize(const dlgr_channel_t *channels, int numChannels)
+{
+    size_t size = DLGR_ARENA_ROUND(sizeof(datalogger_t) * numChannels) + DLGR_ARENA_ROUND(sizeof(char *) * numChannels);
+
+    for (int i = 0; i < numChannels; i++){
+        size += dlgr_module_footprint(channels[i].maxLogSize);
+    }
+
+    return size;
+}
+
+int dlgr_ArenaInit(const dlgr_channel_t *channels, int numChannels)
+{
+    if (dlgr_arena != NULL){
+        return ERR_REREGISTER;
+    }
+
+    if (numChannels < 0 || (channels == NULL && numChannels > 0)){
+        return ERR_INVALID_INPUT;
+    }
+
+    for (int i = 0; i < numChannels; i++){
+        if (channels[i].maxLogSize < 1){
+            return ERR_INVALID_INPUT;
+        }
+    }
+
+    size_t size = dlgr_ArenaSize(channels, numChannels);
+    dlgr_arena = malloc(size > 0 ? size : 1);
+    if (dlgr_arena == NULL){
+        return ERR_MALLOC;
+    }
+
+    // Touch every page now rather than on the first record. Carved blocks start zeroed.
+    memset(dlgr_arena, 0x0, size);
+    dlgr_arena_capacity = size;
+    dlgr_arena_used = 0;
+
+    dlgr_settings = dlgr_arena_alloc(sizeof(datalogger_t) * numChannels);
+    dlgr_modname = dlgr_arena_alloc(sizeof(char *) * numChannels);
+    dlgr_arena_modules = numChannels;
+    atomic_store_explicit(&dlgr_idx, 0, memory_order_relaxed);
+
+    return 1;
+}
+
+int dlgr_GetArenaStats(dlgr_arena_stats_t *stats)
+{
+    if (stats == NULL){
+        return ERR_INVALID_INPUT;
+    }
+
+    stats->capacity = dlgr_arena_capacity;
+    stats->used = dlgr_arena_used;
+    stats->modules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    stats->maxModules = dlgr_arena_modules;
+
+    return 1;
+}
+
+int dlgr_OpenChannels(const dlgr_channel_t *channels, int numChannels, dlgr_handle_t *handles)
+{
+    int numOpen = 0;
+
+    for (int i = 0; i < numChannels; i++){
+        const dlgr_channel_t *channel = &channels[i];
+        char *moduleName = (char *)channel->moduleName;
+
+        handles[i] = dlgr_init(moduleName, channel->maxLogSize, channel->schemaId);
+        if (handles[i] < 0){
+            eprintf("Datalogger init failed for %s: %d", moduleName, handles[i]);
+            continue;
+        }
+        numOpen++;
+
+        // A channel logging faster than the datalogger thread drains its queue loses records.
+        if (channel->periodMs > 0 && (uint64_t)channel->periodMs * DLGR_RING_SLOTS < DLGR_WRITER_PERIOD_MS){
+            eprintf("Datalogger queue of %s overruns at a %" PRIu32 " ms period", moduleName, channel->periodMs);
+        }
+
+        // At its nominal rate a batch holds no more records than arrive within maxDelayMs;
+        // a larger one would only ever be cut by the delay.
+        int batchRecords = channel->batchRecords;
+        if (batchRecords > 1 && channel->periodMs > 0 && (uint64_t)(batchRecords - 1) * channel->periodMs > (uint64_t)channel->maxDelayMs){
+            batchRecords = channel->maxDelayMs / channel->periodMs + 1;
+        }
+        if (batchRecords > 0){
+            dlgr_SetBatching(moduleName, batchRecords, channel->maxDelayMs);
+        }
+        if (channel->keyframeInterval > 0){
+            dlgr_SetCompression(moduleName, channel->keyframeInterval);
+        }
+    }
+
+    return numOpen;
+}
+
+dlgr_handle_t dlgr_init(char* moduleName, ssize_t maxLogSize, uint32_t schemaId)
+{
+    dlgr_debug("DEBUG: dlgr_init called...");
+
+    if (maxLogSize < 1 || moduleName == NULL){
+        // A log must contain at least 1 byte.
+        return ERR_INVALID_INPUT;
+    }
+
+    // The state file holds the name NUL terminated.
+    if (strnlen(moduleName, DLGR_STATE_NAME_MAX) >= DLGR_STATE_NAME_MAX){
+        return ERR_INVALID_INPUT;
+    }
+
+    // Registrations, also late ones racing dlgr_Setup, carve the arena one at a time.
+    pthread_mutex_lock(dlgr_state_m);
+    dlgr_handle_t mod_idx = dlgr_register(moduleName, maxLogSize, schemaId);
+    pthread_mutex_unlock(dlgr_state_m);
+
+    return mod_idx;
+}
+
+dlgr_handle_t dlgr_register(char *moduleName, ssize_t maxLogSize, uint32_t schemaId)
+{
+    if (dlgr_GetHandle(moduleName) >= 0){
+        return ERR_REREGISTER;
+    }
+
+    if (dlgr_arena == NULL){
+        return ERR_ARENA;
+    }
+
+    // dlgr_settings holds an entry for every module dlgr_ArenaInit was given.
+    dlgr_handle_t mod_idx = atomic_load_explicit(&dlgr_idx, memory_order_relaxed);
+    if (mod_idx >= dlgr_arena_modules){
+        return ERR_TOO_MANY_MODULES;
+    }
+
+    // Store the moduleName into dlgr_modname[mod_idx];
+    dlgr_modname[mod_idx] = moduleName;
+
+    // The data file is opened lazily by the first dlgr_LogData call.
+    dlgr_settings[mod_idx].dirFd = -1;
+    dlgr_settings[mod_idx].dataFd = -1;
+    dlgr_settings[mod_idx].fileSize = 0;
+    dlgr_settings[mod_idx].fileReused = 0;
+    dlgr_settings[mod_idx].fileFlags = 0;
+    dlgr_settings[mod_idx].rotateRetryMs = 0;
+    atomic_init(&dlgr_settings[mod_idx].syncSetting, DLGR_SETTING_PACK(DLGR_SYNC_RECORD, 1));
+    dlgr_settings[mod_idx].unsyncedRecords = 0;
+    dlgr_settings[mod_idx].lastSyncMs = dlgr_now_ms();
+    dlgr_settings[mod_idx].batch = NULL;
+    dlgr_settings[mod_idx].batchCount = 0;
+    atomic_init(&dlgr_settings[mod_idx].batchSetting, DLGR_SETTING_PACK(1, 0));
+    dlgr_settings[mod_idx].batchFirstMs = 0;
+    dlgr_settings[mod_idx].batchFirstTime = 0;
+    dlgr_settings[mod_idx].batchBytes = 0;
+    dlgr_settings[mod_idx].batchCompressed = 0;
+    dlgr_settings[mod_idx].schemaId = schemaId;
+    atomic_store_explicit(&dlgr_settings[mod_idx].keyframeInterval, 0, memory_order_relaxed);
+    dlgr_settings[mod_idx].batchKeyframeInterval = 0;
+    dlgr_settings[mod_idx].batchSizeSetting = DLGR_SETTING_PACK(DLGR_DEFAULT_FILE_SIZE, DLGR_DEFAULT_DIR_SIZE);
+    dlgr_settings[mod_idx].framesSinceKey = 0;
+    dlgr_settings[mod_idx].compressPrev = NULL;
+    dlgr_settings[mod_idx].compressPrevTime.monotonic = 0;
+    dlgr_settings[mod_idx].compressPrevTime.realtime = 0;
+    dlgr_settings[mod_idx].ring = NULL;
+    dlgr_settings[mod_idx].ringSize = NULL;
+    dlgr_settings[mod_idx].ringTime = NULL;
+    atomic_init(&dlgr_settings[mod_idx].ringHead, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringTail, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringHighWater, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringEnqueued, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringDropped, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringWritten, 0);
+    atomic_init(&dlgr_settings[mod_idx].ringWriteErrors, 0);
+
+    // The directory, the index and the settings are read by dlgr_Setup, off the
+    // starting thread; until then records wait in the queue.
+    atomic_store_explicit(&dlgr_settings[mod_idx].logIndex, 0, memory_order_relaxed);
+    dlgr_settings[mod_idx].moduleLogSize = maxLogSize;
+    atomic_init(&dlgr_settings[mod_idx].sizeSetting, DLGR_SETTING_PACK(DLGR_DEFAULT_FILE_SIZE, DLGR_DEFAULT_DIR_SIZE));
+
+    // One record is always framed as FBEGIN + timestamp + moduleLogSize bytes + FEND.
+    ssize_t moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
+    dlgr_settings[mod_idx].recordStride = DLGR_RECORD_STRIDE(moduleLogSize);
+
+    // The buffers come out of the arena at once, see: dlgr_module_footprint.
+    if (dlgr_arena_capacity - dlgr_arena_used < dlgr_module_footprint(moduleLogSize)){
+        return ERR_ARENA;
+    }
+
+    ssize_t frameMax = DLGR_FRAME_MAX(moduleLogSize);
+    if (frameMax < dlgr_settings[mod_idx].recordStride){
+        frameMax = dlgr_settings[mod_idx].recordStride;
+    }
+    dlgr_settings[mod_idx].batch = dlgr_arena_alloc(frameMax * DLGR_BATCH_MAX_RECORDS);
+
+    // The previous record, padded to whole 16-bit words, is what delta frames are relative to.
+    dlgr_settings[mod_idx].compressPrev = dlgr_arena_alloc(DLGR_RECORD_WORDS(moduleLogSize) * sizeof(uint16_t));
+
+    // The queue exists up front so that dlgr_LogData never allocates.
+    dlgr_settings[mod_idx].ring = dlgr_arena_alloc(moduleLogSize * DLGR_RING_SLOTS);
+    dlgr_settings[mod_idx].ringSize = dlgr_arena_alloc(sizeof(ssize_t) * DLGR_RING_SLOTS);
+    dlgr_settings[mod_idx].ringTime = dlgr_arena_alloc(sizeof(dlgr_timestamp_t) * DLGR_RING_SLOTS);
+
+    dlgr_debug("DEBUG: Reached end of initialization.");
+
+    // Registered after dlgr_Setup: open the directory now, before any other thread sees the module.
+    // dlgr_Setup holds dlgr_state_m until it is done, so it opens the module otherwise.
+    int opened = 1;
+    if (atomic_load_explicit(&dlgr_setup_done, memory_order_acquire)){
+        opened = dlgr_open_module(mod_idx);
+    }
+
+    // The handle is simply this module's index in dlgr_settings. The slot is complete
+    // before the count that makes other threads walk it is published.
+    atomic_store_explicit(&dlgr_idx, mod_idx + 1, memory_order_release);
+
+    if (atomic_load_explicit(&dlgr_setup_done, memory_order_relaxed)){
+        if (opened >= 0){
+            opened = dlgr_store_state(NULL, 0);
+        }
+        if (opened < 0){
+            eprintf("Datalogger setup failed for %s: %d", moduleName, opened);
+        }
+    }
+
+    return mod_idx;
+}
+
+int dlgr_Setup()
+{
+    if (atomic_load_explicit(&dlgr_setup_done, memory_order_acquire)){
+        return ERR_REREGISTER;
+    }
+
+    dlgr_debug("DEBUG: dlgr_Setup called...");
+
+    // EEXIST is fine, anything else shows up when the directory is opened.
+    mkdir(DLGR_LOG_DIR, S_IRWXU);
+
+    int retval = 1;
+    dlgr_log_fd = open(DLGR_LOG_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dlgr_log_fd < 0){
+        retval = ERR_CHDIR_FAIL;
+    }
+
+    int created = 0;
+    if (retval >= 0){
+        dlgr_state_fd = openat(dlgr_log_fd, DLGR_STATE_FNAME, O_RDWR | O_CLOEXEC);
+        if (dlgr_state_fd < 0 && errno == ENOENT){
+            dlgr_state_fd = openat(dlgr_log_fd, DLGR_STATE_FNAME, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+            created = 1;
+        }
+        if (dlgr_state_fd < 0){
+            retval = ERR_SETTINGS_OPEN;
+        }
+    }
+
+    if (retval >= 0 && !dlgr_load_state()){
+        // First boot with a state file: carry the boot count over from its old file.
+        FILE *fp = fopen(BOOTCOUNT_FNAME, "r");
+        int bootCount = 0;
+        if (fp != NULL){
+            if (fscanf(fp, "%d", &bootCount) != 1 || bootCount < 0){
+                bootCount = 0;
+            }
+            fclose(fp);
+        }
+        dlgr_state.bootCount = bootCount;
+    }
+    sys_boot_count = dlgr_state.bootCount;
+
+    // A module registered meanwhile is either opened here or, once this is done, by dlgr_init.
+    pthread_mutex_lock(dlgr_state_m);
+
+    int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    for (int mod_idx = 0; retval >= 0 && mod_idx < numModules; mod_idx++){
+        int opened = dlgr_open_module(mod_idx);
+        if (opened < 0){
+            // The other modules still log; this one counts write errors.
+            eprintf("Datalogger setup failed for %s: %d", dlgr_modname[mod_idx], opened);
+        }
+    }
+
+    // The next boot's count and every module's index and settings, in one synced write.
+    if (retval >= 0){
+        dlgr_state.bootCount = sys_boot_count + 1;
+        retval = dlgr_store_state(NULL, 0);
+    }
+
+    // A new state file, and the directories made with it, need their entries made durable too.
+    if (retval >= 0 && created && fsync(dlgr_log_fd) < 0){
+        retval = ERR_DATA_SYNC;
+    }
+
+    // Retrieval may start now, even after a failure, which then shows as ERR_DATA_OPEN.
+    atomic_store_explicit(&dlgr_setup_done, 1, memory_order_release);
+
+    pthread_mutex_unlock(dlgr_state_m);
+
+    dlgr_debug("DEBUG: dlgr_Setup finished, boot %d.", sys_boot_count);
+
+    return retval;
+}
+
+int dlgr_open_module(dlgr_handle_t handle)
+{
+    datalogger_t *dlgr = &dlgr_settings[handle];
+    char *moduleName = dlgr_modname[handle];
+
+    if (dlgr_log_fd < 0){
+        return ERR_CHDIR_FAIL;
+    }
+
+    // Check if moduleName directory exists. If not, create it.
+    mkdirat(dlgr_log_fd, moduleName, S_IRWXU);
+
+    // Every later file operation of this module is relative to this descriptor, never the working directory.
+    int dirFd = openat(dlgr_log_fd, moduleName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0){
+        return ERR_CHDIR_FAIL;
+    }
+
+    int maxFileSize = 0;
+    int maxDirSize = 0;
+    dlgr_state_entry_t *entry = dlgr_find_state(moduleName);
+    if (entry != NULL){
+        atomic_store_explicit(&dlgr->logIndex, entry->logIndex, memory_order_relaxed);
+        maxFileSize = entry->maxFileSize;
+        maxDirSize = entry->maxDirSize;
+    } else {
+        // Directories from before the state file keep their index and settings in
+        // index.inf and settings.cfg, read once and carried over by dlgr_save_state.
+        char line[20];
+        FILE *fp = dlgr_fopenat(dirFd, "index.inf", "r");
+        if (fp != NULL){
+            if (fgets(line, sizeof(line), fp) != NULL){
+                atomic_store_explicit(&dlgr->logIndex, strtoull(line, NULL, 10), memory_order_relaxed);
+            }
+            fclose(fp);
+        }
+
+        fp = dlgr_fopenat(dirFd, "settings.cfg", "r");
+        if (fp != NULL){
+            char line2[20];
+            if (fgets(line, sizeof(line), fp) != NULL && fgets(line2, sizeof(line2), fp) != NULL){
+                maxFileSize = atoi(line);
+                maxDirSize = atoi(line2);
+            }
+            fclose(fp);
+        }
+    }
+
+    if (maxFileSize < 1 || maxDirSize < maxFileSize){
+        maxFileSize = DLGR_DEFAULT_FILE_SIZE;
+        maxDirSize = DLGR_DEFAULT_DIR_SIZE;
+    }
+    atomic_store_explicit(&dlgr->sizeSetting, DLGR_SETTING_PACK(maxFileSize, maxDirSize), memory_order_relaxed);
+
+    // Records are only appended to the current .dat file if it has the same
+    // layout (see: dlgr_flush). One logged with another record size or schemaId
+    // keeps fileFlags at 0, which never matches: the module then starts a new
+    // file, and retrieval stops at the old one.
+    char dataFileName[MODULE_FNAME_SZ] = {0x0, };
+    snprintf(dataFileName, sizeof(dataFileName), "%" PRIu64 ".dat", atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed));
+
+    dlgr_file_header_t header;
+    int fDataCur = openat(dirFd, dataFileName, O_RDONLY | O_CLOEXEC);
+    if (fDataCur >= 0){
+        if (dlgr_read_header(fDataCur, &header) > 0 && header.recordSize == dlgr->moduleLogSize && header.schemaId == dlgr->schemaId){
+            dlgr->fileFlags = header.flags;
+        }
+        close(fDataCur);
+    }
+
+    // Published last: the writer and retrieval use the directory once it is set.
+    dlgr->dirFd = dirFd;
+
+    return 1;
+}
+
+int dlgr_load_state()
+{
+    // Both slots in one read; the newer valid one wins.
+    char slots[2][DLGR_STATE_SLOT_SIZE];
+    ssize_t len = pread(dlgr_state_fd, slots, sizeof(slots), 0);
+    int found = 0;
+
+    for (int i = 0; i < 2 && len > 0; i++){
+        if (len < (ssize_t)(DLGR_STATE_SLOT_SIZE * (i + 1))){
+            break;
+        }
+
+        dlgr_state_header_t header;
+        memcpy(&header, slots[i], sizeof(header));
+        if (header.magic != DLGR_STATE_MAGIC || header.version != DLGR_STATE_VERSION || header.numEntries > DLGR_STATE_MAX_ENTRIES){
+            continue;
+        }
+
+        size_t body = sizeof(header) + header.numEntries * sizeof(dlgr_state_entry_t);
+        uint16_t crc;
+        memcpy(&crc, slots[i] + body, sizeof(crc));
+        if (crc != dlgr_crc16(slots[i], body)){
+            continue;
+        }
+
+        if (found && (int32_t)(header.sequence - dlgr_state.sequence) <= 0){
+            continue;
+        }
+
+        dlgr_state = header;
+        memcpy(dlgr_state_entries, slots[i] + sizeof(header), header.numEntries * sizeof(dlgr_state_entry_t));
+        found = 1;
+    }
+
+    return found;
+}
+
+dlgr_state_entry_t *dlgr_find_state(const char *moduleName)
+{
+    for (int i = 0; i < dlgr_state.numEntries; i++){
+        if (strncmp(dlgr_state_entries[i].moduleName, moduleName, DLGR_STATE_NAME_MAX) == 0){
+            return &dlgr_state_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+int dlgr_save_state(datalogger_t *pending, uint64_t pendingIndex)
+{
+    pthread_mutex_lock(dlgr_state_m);
+    int retval = dlgr_store_state(pending, pendingIndex);
+    pthread_mutex_unlock(dlgr_state_m);
+
+    return retval;
+}
+
+int dlgr_store_state(datalogger_t *pending, uint64_t pendingIndex)
+{
+    char slot[DLGR_STATE_SLOT_SIZE];
+    int retval = 1;
+
+    // Modules that are set up overwrite their entries; those of modules not
+    // registered this boot are kept as they are.
+    int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    for (int mod_idx = 0; mod_idx < numModules; mod_idx++){
+        datalogger_t *dlgr = &dlgr_settings[mod_idx];
+        if (dlgr->dirFd < 0){
+            continue;
+        }
+
+        dlgr_state_entry_t *entry = dlgr_find_state(dlgr_modname[mod_idx]);
+        if (entry == NULL && dlgr_state.numEntries < DLGR_STATE_MAX_ENTRIES){
+            entry = &dlgr_state_entries[dlgr_state.numEntries++];
+            memset(entry, 0x0, sizeof(*entry));
+            strncpy(entry->moduleName, dlgr_modname[mod_idx], DLGR_STATE_NAME_MAX);
+        }
+        if (entry == NULL){
+            retval = ERR_TOO_MANY_MODULES;
+            continue;
+        }
+
+        uint64_t sizes = atomic_load_explicit(&dlgr->sizeSetting, memory_order_relaxed);
+        entry->logIndex = dlgr == pending ? pendingIndex : atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed);
+        entry->maxFileSize = DLGR_SETTING_FIRST(sizes);
+        entry->maxDirSize = DLGR_SETTING_SECOND(sizes);
+    }
+
+    dlgr_state.magic = DLGR_STATE_MAGIC;
+    dlgr_state.version = DLGR_STATE_VERSION;
+    dlgr_state.sequence++;
+
+    memset(slot, 0x0, sizeof(slot));
+    size_t body = sizeof(dlgr_state) + dlgr_state.numEntries * sizeof(dlgr_state_entry_t);
+    memcpy(slot, &dlgr_state, sizeof(dlgr_state));
+    memcpy(slot + sizeof(dlgr_state), dlgr_state_entries, dlgr_state.numEntries * sizeof(dlgr_state_entry_t));
+    uint16_t crc = dlgr_crc16(slot, body);
+    memcpy(slot + body, &crc, sizeof(crc));
+
+    // The slot not holding the newest state is overwritten, so a torn write leaves the other one valid.
+    off_t offset = (off_t)(dlgr_state.sequence & 1) * DLGR_STATE_SLOT_SIZE;
+    if (pwrite(dlgr_state_fd, slot, sizeof(slot), offset) != (ssize_t)sizeof(slot)){
+        retval = ERR_DATA_WRITE;
+    } else if (fdatasync(dlgr_state_fd) < 0){
+        retval = ERR_DATA_SYNC;
+    }
+
+    // Published only once stored, and under the lock, so no other save can store it first.
+    if (pending != NULL && retval >= 0){
+        atomic_store_explicit(&pending->logIndex, pendingIndex, memory_order_relaxed);
+    }
+
+    return retval;
+}
+
+dlgr_handle_t dlgr_GetHandle(char *moduleName)
+{
+    if (moduleName == NULL){
+        return ERR_INVALID_INPUT;
+    }
+
+    int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    for (int mod_idx = 0; mod_idx < numModules; mod_idx++){
+        if (dlgr_modname[mod_idx] == moduleName || strcmp(dlgr_modname[mod_idx], moduleName) == 0){
+            return mod_idx;
+        }
+    }
+
+    return ERR_UNKNOWN_MODULE;
+}
+
+int dlgr_LogData(char* moduleName, ssize_t size, void *dataIn)
+{
+    return dlgr_LogDataH(dlgr_GetHandle(moduleName), size, dataIn);
+}
+
+int dlgr_LogDataH(dlgr_handle_t handle, ssize_t size, void *dataIn)
+{
+    int retval = dlgr_LogBatchH(handle, size, dataIn, 1);
+
+    if (retval == 0){
+        return ERR_QUEUE_FULL;
+    }
+
+    return retval;
+}
+
+int dlgr_LogBatch(char *moduleName, ssize_t size, void *dataIn, int numRecords)
+{
+    return dlgr_LogBatchH(dlgr_GetHandle(moduleName), size, dataIn, numRecords);
+}
+
+int dlgr_LogBatchH(dlgr_handle_t handle, ssize_t size, void *dataIn, int numRecords)
+{
+    LAT_START(start);
+    int retval = dlgr_log_batch(handle, size, dataIn, numRecords);
+    LAT_RECORD(&dlgr_lat[DLGR_LAT_LOG], start, retval < 0 || (retval == 0 && numRecords > 0));
+    return retval;
+}
+
+int dlgr_log_batch(dlgr_handle_t handle, ssize_t size, void *dataIn, int numRecords)
+{
+    if (handle < 0 || handle >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    datalogger_t *dlgr = &dlgr_settings[handle];
+
+    // Each record holds at least 1 byte and fits in a queue slot.
+    if (size < 1 || size > dlgr->moduleLogSize){
+        return ERR_INVALID_INPUT;
+    }
+
+    if (numRecords < 0 || (numRecords > 0 && dataIn == NULL)){
+        return ERR_INVALID_INPUT;
+    }
+
+    // Only this thread moves ringHead, so a relaxed load is enough.
+    uint32_t head = atomic_load_explicit(&dlgr->ringHead, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&dlgr->ringTail, memory_order_acquire);
+
+    // Queue as many records as there are free slots and drop the rest.
+    int numQueued = DLGR_RING_SLOTS - (head - tail);
+    if (numQueued > numRecords){
+        numQueued = numRecords;
+    }
+
+    // Records are stamped when they are logged, not when they reach the disk.
+    dlgr_timestamp_t now;
+    dlgr_now_timestamp(&now);
+
+    for (int i = 0; i < numQueued; i++){
+        uint32_t slot = (head + i) & (DLGR_RING_SLOTS - 1);
+        memcpy(dlgr->ring + slot * dlgr->moduleLogSize, (char *)dataIn + i * size, size);
+        dlgr->ringSize[slot] = size;
+        dlgr->ringTime[slot] = now;
+    }
+
+    if (numQueued < numRecords){
+        atomic_fetch_add_explicit(&dlgr->ringDropped, numRecords - numQueued, memory_order_relaxed);
+    }
+
+    if (numQueued == 0){
+        return 0;
+    }
+
+    // Publishes the records to the datalogger thread.
+    head += numQueued;
+    atomic_store_explicit(&dlgr->ringHead, head, memory_order_release);
+    atomic_fetch_add_explicit(&dlgr->ringEnqueued, numQueued, memory_order_relaxed);
+
+    if (head - tail > atomic_load_explicit(&dlgr->ringHighWater, memory_order_relaxed)){
+        atomic_store_explicit(&dlgr->ringHighWater, head - tail, memory_order_relaxed);
+    }
+
+    // Signalling without the mutex never blocks; a missed wakeup costs at most DLGR_WRITER_PERIOD_MS.
+    pthread_cond_signal(dlgr_wakeup);
+
+    return numQueued;
+}
+
+void *dlgr_thread(void *tid)
+{
+    // Records logged meanwhile wait in the queues.
+    if (!atomic_load_explicit(&dlgr_setup_done, memory_order_acquire)){
+        dlgr_Setup();
+    }
+
+    while (!done)
+    {
+        int drained = 0;
+        uint64_t now = dlgr_now_ms();
+        int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+        for (int mod_idx = 0; mod_idx < numModules; mod_idx++){
+            datalogger_t *dlgr = &dlgr_settings[mod_idx];
+
+            drained += dlgr_drain(mod_idx);
+
+            // Staged records go out once the batch is full or has waited its longest delay.
+            // The drain may start a batch after now was read, so the delay is added, not subtracted.
+            uint64_t batching = atomic_load_explicit(&dlgr->batchSetting, memory_order_relaxed);
+            if (dlgr->batchCount > 0 && (dlgr->batchCount >= DLGR_SETTING_FIRST(batching) || now >= dlgr->batchFirstMs + (uint64_t)DLGR_SETTING_SECOND(batching))){
+                dlgr_flush(dlgr);
+            }
+
+            // Lets DLGR_SYNC_INTERVAL expire even when nothing new arrives.
+            dlgr_sync(dlgr, 0);
+        }
+
+        if (drained > 0){
+            continue;
+        }
+
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += DLGR_WRITER_PERIOD_MS * 1000000L;
+        timeout.tv_sec += timeout.tv_nsec / 1000000000L;
+        timeout.tv_nsec %= 1000000000L;
+
+        pthread_mutex_lock(dlgr_wakeup_m);
+        pthread_cond_timedwait(dlgr_wakeup, dlgr_wakeup_m, &timeout);
+        pthread_mutex_unlock(dlgr_wakeup_m);
+    }
+
+    // Whatever was queued before shutdown still goes to disk.
+    int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    for (int mod_idx = 0; mod_idx < numModules; mod_idx++){
+        dlgr_drain(mod_idx);
+        dlgr_flush(&dlgr_settings[mod_idx]);
+    }
+
+    pthread_exit(NULL);
+}
+
+int dlgr_drain(int mod_idx)
+{
+    datalogger_t *dlgr = &dlgr_settings[mod_idx];
+
+    if (dlgr->ring == NULL){
+        return 0;
+    }
+
+    // Only this thread moves ringTail.
+    uint32_t tail = atomic_load_explicit(&dlgr->ringTail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&dlgr->ringHead, memory_order_acquire);
+    int drained = 0;
+
+    for (; tail != head; tail++, drained++){
+        uint32_t slot = tail & (DLGR_RING_SLOTS - 1);
+        int retval = dlgr_write(mod_idx, dlgr->ringSize[slot], dlgr->ring + slot * dlgr->moduleLogSize, &dlgr->ringTime[slot]);
+        if (retval < 0){
+            eprintf("Failed to log record for %s: %d", dlgr_modname[mod_idx], retval);
+        }
+
+        // Hands the slot back to the producer.
+        atomic_store_explicit(&dlgr->ringTail, tail + 1, memory_order_release);
+    }
+
+    return drained;
+}
+
+int dlgr_GetLatency(DLGR_LATENCY site, lat_summary_t *summary)
+{
+#ifndef NO_LATENCY_STATS
+    if (site < 0 || site >= DLGR_LAT_NUM || summary == NULL){
+        return ERR_INVALID_INPUT;
+    }
+
+    return lat_summarize(&dlgr_lat[site], summary);
+#else
+    return ERR_INVALID_INPUT;
+#endif
+}
+
+int dlgr_GetQueueStats(char *moduleName, dlgr_queue_stats_t *stats)
+{
+    dlgr_handle_t mod_idx = dlgr_GetHandle(moduleName);
+    if (mod_idx < 0){
+        return mod_idx;
+    }
+
+    if (stats == NULL){
+        return ERR_INVALID_INPUT;
+    }
+
+    datalogger_t *dlgr = &dlgr_settings[mod_idx];
+
+    stats->enqueued = atomic_load_explicit(&dlgr->ringEnqueued, memory_order_relaxed);
+    stats->written = atomic_load_explicit(&dlgr->ringWritten, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&dlgr->ringDropped, memory_order_relaxed);
+    stats->writeErrors = atomic_load_explicit(&dlgr->ringWriteErrors, memory_order_relaxed);
+    stats->highWater = atomic_load_explicit(&dlgr->ringHighWater, memory_order_relaxed);
+    stats->capacity = DLGR_RING_SLOTS;
+
+    return 1;
+}
+
+int dlgr_write(int mod_idx, ssize_t size, void *dataIn, const dlgr_timestamp_t *timestamp)
+{
+    datalogger_t *dlgr = &dlgr_settings[mod_idx];
+    int moduleLogSize = dlgr->moduleLogSize;
+    char *frame = dlgr->batch + dlgr->batchBytes;
+
+    // A batch is written to a single file in a single layout, fixed by its first record.
+    if (dlgr->batchCount == 0){
+        dlgr->batchFirstMs = dlgr_now_ms();
+        dlgr->batchFirstTime = timestamp->realtime;
+        dlgr->batchKeyframeInterval = atomic_load_explicit(&dlgr->keyframeInterval, memory_order_relaxed);
+        dlgr->batchCompressed = dlgr->batchKeyframeInterval > 0;
+        // The batch is flushed, and the file rotated, against the limits it started with.
+        dlgr->batchSizeSetting = atomic_load_explicit(&dlgr->sizeSetting, memory_order_relaxed);
+
+        // Every file must decode on its own, so a batch that may start one starts with a keyframe.
+        int maxFileSize = DLGR_SETTING_FIRST(dlgr->batchSizeSetting);
+        if (dlgr->dataFd < 0 || dlgr->fileSize == 0 || dlgr->fileSize >= maxFileSize || dlgr->fileFlags != dlgr_file_flags(dlgr)){
+            dlgr->framesSinceKey = 0;
+        }
+    }
+
+    if (dlgr->batchCompressed){
+        dlgr->batchBytes += dlgr_encode_record(dlgr, dataIn, size, timestamp, frame);
+    } else {
+        // Frame the data as FBEGIN, the timestamp, the data, zero padding up to moduleLogSize
+        // and then FEND, directly behind the records already staged.
+        memcpy(frame, FBEGIN, FBEGIN_SIZE);
+        memcpy(frame + FBEGIN_SIZE, timestamp, sizeof(dlgr_timestamp_t));
+        memcpy(frame + DLGR_RECORD_DATA_OFFSET, dataIn, size);
+        memset(frame + DLGR_RECORD_DATA_OFFSET + size, 0x0, moduleLogSize - size);
+        memcpy(frame + DLGR_RECORD_DATA_OFFSET + moduleLogSize, FEND, FEND_SIZE);
+        dlgr->batchBytes += dlgr->recordStride;
+    }
+    dlgr->batchCount++;
+
+    if (dlgr->batchCount >= DLGR_SETTING_FIRST(atomic_load_explicit(&dlgr->batchSetting, memory_order_relaxed))){
+        return dlgr_flush(dlgr);
+    }
+
+    return 1;
+}
+
+int dlgr_flush(datalogger_t *dlgr)
+{
+    if (dlgr->batchCount == 0){
+        return 0;
+    }
+
+    dlgr_debug("DEBUG: dlgr_flush called...");
+
+    LAT_START(start);
+
+    int numRecords = dlgr->batchCount;
+    ssize_t blockSize = dlgr->batchBytes;
+    int retval = 1;
+
+    // The batch is consumed whether or not it makes it to disk.
+    dlgr->batchCount = 0;
+    dlgr->batchBytes = 0;
+
+    // Reopen the current .dat file if this is the first record since init.
+    if (dlgr->dataFd < 0){
+        retval = dlgr_open_data(dlgr, 0);
+    }
+
+    // Make a new .dat file and iterate the index if the current one is full or in another layout.
+    // A full file is rotated again only DLGR_ROTATE_RETRY_MS after a failed rotation.
+    int maxFileSize = DLGR_SETTING_FIRST(dlgr->batchSizeSetting);
+    int otherLayout = dlgr->fileSize > 0 && dlgr->fileFlags != dlgr_file_flags(dlgr);
+    if (retval >= 0 && (otherLayout || (dlgr->fileSize >= maxFileSize && dlgr_now_ms() >= dlgr->rotateRetryMs))){
+        retval = dlgr_rotate(dlgr);
+        // The new file is open even if the oldest one could not be deleted; keep the batch.
+        if (retval == ERR_DATA_REMOVE){
+            retval = 1;
+        }
+        // A rotation that was not committed reopens the full file, where records of the same layout still go.
+        if (retval < 0 && dlgr->dataFd >= 0 && !otherLayout){
+            dlgr->rotateRetryMs = dlgr_now_ms() + DLGR_ROTATE_RETRY_MS;
+            retval = 1;
+        }
+    }
+
+    // A new file starts with its header, written together with its first records.
+    dlgr_file_header_t header;
+    struct iovec iov[2];
+    int iovcnt = 0;
+
+    if (retval >= 0 && dlgr->fileSize == 0){
+        dlgr_make_header(dlgr, &header);
+        dlgr->fileFlags = header.flags;
+        iov[iovcnt].iov_base = &header;
+        iov[iovcnt++].iov_len = sizeof(header);
+    }
+    iov[iovcnt].iov_base = dlgr->batch;
+    iov[iovcnt++].iov_len = blockSize;
+
+    // One write for the whole contiguous block; the descriptor is at the end of the records.
+    if (retval >= 0){
+        ssize_t expected = 0;
+        for (int i = 0; i < iovcnt; i++){
+            expected += iov[i].iov_len;
+        }
+
+        ssize_t written = dlgr_writev_all(dlgr->dataFd, iov, iovcnt);
+        if (written == expected){
+            dlgr->fileSize += written;
+        } else {
+            // Drop a partial batch so that the next write starts where this one did:
+            // records stay on the stride grid. A reused file ends at its dataEnd, so it is
+            // only rewound; the size of any other file is where its records end.
+            if (written > 0 && !dlgr->fileReused){
+                ftruncate(dlgr->dataFd, dlgr->fileSize);
+            }
+            lseek(dlgr->dataFd, dlgr->fileSize, SEEK_SET);
+            retval = ERR_DATA_WRITE;
+        }
+    }
+
+    // The records of a reused file end where its header says, not at its size.
+    if (retval >= 0 && dlgr->fileReused){
+        uint32_t dataEnd = dlgr->fileSize;
+        if (pwrite(dlgr->dataFd, &dataEnd, sizeof(dataEnd), offsetof(dlgr_file_header_t, dataEnd)) != sizeof(dataEnd)){
+            retval = ERR_DATA_WRITE;
+        }
+    }
+
+    if (retval < 0){
+        // Later delta frames must not refer to a record that never made it to disk.
+        dlgr->framesSinceKey = 0;
+        atomic_fetch_add_explicit(&dlgr->ringWriteErrors, numRecords, memory_order_relaxed);
+        LAT_RECORD(&dlgr_lat[DLGR_LAT_FLUSH], start, 1);
+        return retval;
+    }
+
+    atomic_fetch_add_explicit(&dlgr->ringWritten, numRecords, memory_order_relaxed);
+    dlgr->unsyncedRecords += numRecords;
+
+    // A due sync is part of the write's cost.
+    int synced = dlgr_sync(dlgr, 0);
+    LAT_RECORD(&dlgr_lat[DLGR_LAT_FLUSH], start, synced < 0);
+    if (synced < 0){
+        return ERR_DATA_SYNC;
+    }
+
+    dlgr_debug("DEBUG: Finished data log.");
+
+    return numRecords;
+}
+
+ssize_t dlgr_writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t total = 0;
+
+    while (iovcnt > 0){
+        ssize_t ret = writev(fd, iov, iovcnt);
+        if (ret < 0 && errno == EINTR){
+            continue;
+        }
+        if (ret <= 0){
+            return total > 0 ? total : -1;
+        }
+        total += ret;
+
+        // Skip what was written and retry the remainder after a short write.
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len){
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0){
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return total;
+}
+
+void dlgr_make_header(datalogger_t *dlgr, dlgr_file_header_t *header)
+{
+    memset(header, 0x0, sizeof(*header));
+    memcpy(header->magic, DLGR_HEADER_MAGIC, sizeof(header->magic));
+    header->version = DLGR_HEADER_VERSION;
+    header->headerSize = sizeof(*header);
+    header->recordSize = dlgr->moduleLogSize;
+    header->stride = dlgr->recordStride;
+    header->schemaId = dlgr->schemaId;
+    header->bootCount = sys_boot_count;
+    header->fileIndex = atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed);
+    header->flags = dlgr_file_flags(dlgr);
+
+    // The header is written with the first staged record, whose realtime stamp it repeats.
+    header->firstRecordTime = dlgr->batchFirstTime;
+}
+
+uint32_t dlgr_file_flags(datalogger_t *dlgr)
+{
+    return DLGR_HEADER_TIMESTAMPS | (dlgr->batchCompressed ? DLGR_HEADER_COMPRESSED : 0);
+}
+
+int dlgr_put_varint(uint8_t *out, uint64_t value)
+{
+    int len = 0;
+    while (value >= 0x80){
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+int dlgr_get_varint(const uint8_t *in, ssize_t avail, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int len = 0; len < avail && len < 10; len++){
+        result |= (uint64_t)(in[len] & 0x7f) << (7 * len);
+        if ((in[len] & 0x80) == 0){
+            *value = result;
+            return len + 1;
+        }
+    }
+    return 0;
+}
+
+ssize_t dlgr_encode_record(datalogger_t *dlgr, const void *dataIn, ssize_t size, const dlgr_timestamp_t *timestamp, char *frame)
+{
+    uint8_t *out = (uint8_t *)frame;
+    int numWords = DLGR_RECORD_WORDS(dlgr->moduleLogSize);
+    uint16_t *prev = dlgr->compressPrev;
+    ssize_t len = 0;
+
+    // Records shorter than moduleLogSize are zero padded, exactly as in a plain file.
+    uint8_t padded[2 * numWords];
+    memcpy(padded, dataIn, size);
+    memset(padded + size, 0x0, sizeof(padded) - size);
+
+    if (dlgr->framesSinceKey == 0 || dlgr->framesSinceKey >= dlgr->batchKeyframeInterval){
+        out[len++] = DLGR_FRAME_KEY;
+        memcpy(out + len, timestamp, sizeof(*timestamp));
+        len += sizeof(*timestamp);
+        memcpy(out + len, padded, dlgr->moduleLogSize);
+        len += dlgr->moduleLogSize;
+
+        for (int i = 0; i < numWords; i++){
+            prev[i] = padded[2 * i] | (padded[2 * i + 1] << 8);
+        }
+        dlgr->framesSinceKey = 1;
+    } else {
+        out[len++] = DLGR_FRAME_DELTA;
+        len += dlgr_put_varint(out + len, timestamp->monotonic - dlgr->compressPrevTime.monotonic);
+        len += dlgr_put_varint(out + len, DLGR_ZIGZAG64((int64_t)(timestamp->realtime - dlgr->compressPrevTime.realtime)));
+
+        // Each 16-bit word is stored as the zig-zag varint of its change. A zero
+        // is followed by the number of further unchanged words, so a run of
+        // untouched counters costs two bytes.
+        for (int i = 0; i < numWords;){
+            uint16_t word = padded[2 * i] | (padded[2 * i + 1] << 8);
+            uint16_t zigzag = DLGR_ZIGZAG16((int16_t)(word - prev[i]));
+            prev[i] = word;
+            i++;
+
+            if (zigzag != 0){
+                len += dlgr_put_varint(out + len, zigzag);
+                continue;
+            }
+
+            int run = 0;
+            while (i < numWords && (uint16_t)(padded[2 * i] | (padded[2 * i + 1] << 8)) == prev[i]){
+                run++;
+                i++;
+            }
+            out[len++] = 0;
+            len += dlgr_put_varint(out + len, run);
+        }
+        dlgr->framesSinceKey++;
+    }
+
+    dlgr->compressPrevTime = *timestamp;
+
+    return len;
+}
+
+int dlgr_decode_frame(datalogger_t *dlgr, const char *in, ssize_t avail, uint16_t *prev, dlgr_timestamp_t *prevTime, int haveKey, int packed, char *record)
+{
+    const uint8_t *data = (const uint8_t *)in;
+    int moduleLogSize = dlgr->moduleLogSize;
+    int numWords = DLGR_RECORD_WORDS(moduleLogSize);
+    dlgr_timestamp_t timestamp;
+    uint64_t value, value2;
+    int used;
+    ssize_t next = 1;
+
+    if (avail < 1){
+        return 0;
+    }
+
+    if (data[0] == DLGR_FRAME_KEY){
+        if (avail - next < (ssize_t)sizeof(timestamp) + moduleLogSize){
+            return 0;
+        }
+        memcpy(&timestamp, data + next, sizeof(timestamp));
+        next += sizeof(timestamp);
+
+        uint8_t padded[2 * numWords];
+        memset(padded, 0x0, sizeof(padded));
+        memcpy(padded, data + next, moduleLogSize);
+        next += moduleLogSize;
+        for (int i = 0; i < numWords; i++){
+            prev[i] = padded[2 * i] | (padded[2 * i + 1] << 8);
+        }
+    } else if (data[0] == DLGR_FRAME_DELTA && haveKey){
+        if ((used = dlgr_get_varint(data + next, avail - next, &value)) == 0){
+            return 0;
+        }
+        next += used;
+        if ((used = dlgr_get_varint(data + next, avail - next, &value2)) == 0){
+            return 0;
+        }
+        next += used;
+        timestamp.monotonic = prevTime->monotonic + value;
+        timestamp.realtime = prevTime->realtime + DLGR_UNZIGZAG64(value2);
+
+        // Counts come from the file; a corrupt one must not take i past the record.
+        int i = 0;
+        while (i < numWords){
+            if ((used = dlgr_get_varint(data + next, avail - next, &value)) == 0){
+                return 0;
+            }
+            next += used;
+
+            if (value != 0){
+                prev[i++] += (uint16_t)DLGR_UNZIGZAG16(value);
+                continue;
+            }
+
+            // An unchanged word, followed by the number of further unchanged words.
+            if ((used = dlgr_get_varint(data + next, avail - next, &value)) == 0){
+                return 0;
+            }
+            next += used;
+            if (value > (uint64_t)(numWords - i - 1)){
+                return 0;
+            }
+            i += 1 + (int)value;
+        }
+    } else {
+        // Not a frame, or a delta without a keyframe to apply it to.
+        return 0;
+    }
+
+    // Emit the record in the plain layout, as dlgr_RetrieveData returns it, or without delimiters.
+    if (record != NULL){
+        char *out = packed ? record : record + FBEGIN_SIZE;
+        memcpy(out, &timestamp, sizeof(timestamp));
+        out += sizeof(timestamp);
+        for (int i = 0; i < numWords; i++){
+            uint8_t word[2] = {prev[i] & 0xff, prev[i] >> 8};
+            memcpy(out + 2 * i, word, (2 * i + 1 < moduleLogSize) ? 2 : 1);
+        }
+        if (!packed){
+            memcpy(record, FBEGIN, FBEGIN_SIZE);
+            memcpy(out + moduleLogSize, FEND, FEND_SIZE);
+        }
+    }
+
+    *prevTime = timestamp;
+    return next;
+}
+
+int dlgr_read_header(int fd, dlgr_file_header_t *header)
+{
+    ssize_t ret = pread(fd, header, sizeof(*header), 0);
+    if (ret < 0){
+        return ERR_DATA_READ;
+    }
+
+    // Files written before headers existed start straight with FBEGIN.
+    if (ret < (ssize_t)sizeof(header->magic) || memcmp(header->magic, DLGR_HEADER_MAGIC, sizeof(header->magic)) != 0){
+        return 0;
+    }
+
+    ssize_t stride = header->recordSize + FBEGIN_SIZE + FEND_SIZE;
+    if (header->flags & DLGR_HEADER_TIMESTAMPS){
+        stride += sizeof(dlgr_timestamp_t);
+    }
+
+    if (ret < (ssize_t)sizeof(*header) || header->headerSize < sizeof(*header) || header->stride != stride){
+        return ERR_DATA_READ;
+    }
+
+    return 1;
+}
+
+int dlgr_SetBatching(char *moduleName, int numRecords, int maxDelayMs)
+{
+    dlgr_handle_t mod_idx = dlgr_GetHandle(moduleName);
+    if (mod_idx < 0){
+        return mod_idx;
+    }
+
+    if (numRecords < 1 || numRecords > DLGR_BATCH_MAX_RECORDS || maxDelayMs < 0){
+        return ERR_INVALID_INPUT;
+    }
+
+    // The datalogger thread applies the new limits on its next pass, both at once.
+    atomic_store_explicit(&dlgr_settings[mod_idx].batchSetting, DLGR_SETTING_PACK(numRecords, maxDelayMs), memory_order_relaxed);
+
+    return 1;
+}
+
+int dlgr_SetCompression(char *moduleName, int keyframeInterval)
+{
+    dlgr_handle_t mod_idx = dlgr_GetHandle(moduleName);
+    if (mod_idx < 0){
+        return mod_idx;
+    }
+
+    if (keyframeInterval < 0){
+        return ERR_INVALID_INPUT;
+    }
+
+    // The datalogger thread switches modes at the start of its next batch,
+    // which then goes to a new file if the current one is in the other mode.
+    atomic_store_explicit(&dlgr_settings[mod_idx].keyframeInterval, keyframeInterval, memory_order_relaxed);
+
+    return 1;
+}
+
+int dlgr_SetSyncPolicy(char *moduleName, int policy, int value)
+{
+    dlgr_handle_t mod_idx = dlgr_GetHandle(moduleName);
+    if (mod_idx < 0){
+        return mod_idx;
+    }
+
+    switch (policy){
+        case DLGR_SYNC_RECORD:
+            value = 1;
+            break;
+        case DLGR_SYNC_COUNT:
+        case DLGR_SYNC_INTERVAL:
+            if (value < 1){
+                return ERR_INVALID_INPUT;
+            }
+            break;
+        default:
+            return ERR_DEFAULT_CASE;
+    }
+
+    // The datalogger thread applies the new policy on its next pass, with its value.
+    atomic_store_explicit(&dlgr_settings[mod_idx].syncSetting, DLGR_SETTING_PACK(policy, value), memory_order_relaxed);
+
+    return 1;
+}
+
+void dlgr_now_timestamp(dlgr_timestamp_t *timestamp)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    timestamp->monotonic = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    timestamp->realtime = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t dlgr_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+int dlgr_sync(datalogger_t *dlgr, int force)
+{
+    if (dlgr->dataFd < 0 || dlgr->unsyncedRecords == 0){
+        return 1;
+    }
+
+    uint64_t now = dlgr_now_ms();
+    int due = force;
+    uint64_t setting = atomic_load_explicit(&dlgr->syncSetting, memory_order_relaxed);
+    int value = DLGR_SETTING_SECOND(setting);
+
+    switch (DLGR_SETTING_FIRST(setting)){
+        case DLGR_SYNC_COUNT:
+            due |= dlgr->unsyncedRecords >= value;
+            break;
+        case DLGR_SYNC_INTERVAL:
+            due |= (now - dlgr->lastSyncMs) >= (uint64_t)value;
+            break;
+        case DLGR_SYNC_RECORD:
+        default:
+            due = 1;
+            break;
+    }
+
+    if (!due){
+        return 1;
+    }
+
+    // Only this module's file is flushed, not the whole file system.
+    if (fdatasync(dlgr->dataFd) < 0){
+        return ERR_DATA_SYNC;
+    }
+
+    dlgr->unsyncedRecords = 0;
+    dlgr->lastSyncMs = now;
+
+    return 1;
+}
+
+int dlgr_open_data(datalogger_t *dlgr, int flags)
+{
+    // Construct n.dat directory.
+    char dataFileName[MODULE_FNAME_SZ] = {0x0, };
+    snprintf(dataFileName, sizeof(dataFileName), "%" PRIu64 ".dat", atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed));
+
+    // Read access for the header of a reused file.
+    dlgr->dataFd = openat(dlgr->dirFd, dataFileName, O_RDWR | O_CREAT | O_CLOEXEC | flags, S_IRUSR | S_IWUSR);
+    if (dlgr->dataFd < 0){
+        return ERR_DATA_OPEN;
+    }
+
+    // Fetch the current file size, or where the records of a reused file end, and write from there.
+    struct stat sb;
+    dlgr_file_header_t header;
+    if (fstat(dlgr->dataFd, &sb) < 0){
+        close(dlgr->dataFd);
+        dlgr->dataFd = -1;
+        return ERR_DATA_OPEN;
+    }
+    dlgr->fileReused = dlgr_read_header(dlgr->dataFd, &header) > 0 && header.dataEnd > 0 && header.dataEnd <= sb.st_size;
+    dlgr->fileSize = dlgr->fileReused ? (ssize_t)header.dataEnd : sb.st_size;
+
+    if (lseek(dlgr->dataFd, dlgr->fileSize, SEEK_SET) < 0){
+        close(dlgr->dataFd);
+        dlgr->dataFd = -1;
+        return ERR_DATA_OPEN;
+    }
+
+    return 1;
+}
+
+int dlgr_rotate(datalogger_t *dlgr)
+{
+    dlgr_debug("DEBUG: Rotating data file.");
+
+    // Everything in the full file is made durable before it is closed.
+    dlgr_sync(dlgr, 1);
+    close(dlgr->dataFd);
+    dlgr->dataFd = -1;
+
+    // Both limits as the batch being flushed started with; dlgr_EditSettings keeps maxDirSize >= maxFileSize, so at least one file.
+    uint64_t sizes = dlgr->batchSizeSetting;
+    int maxFileSize = DLGR_SETTING_FIRST(sizes);
+    uint64_t nextIndex = atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed) + 1;
+    int64_t numFiles = DLGR_SETTING_SECOND(sizes) / maxFileSize;
+
+    char dataFileNewName[MODULE_FNAME_SZ] = {0x0, };
+    snprintf(dataFileNewName, sizeof(dataFileNewName), "%" PRIu64 ".dat", nextIndex);
+
+    // Once the directory is full, the oldest file is recycled as the next one
+    // instead of being deleted. Until the state file says otherwise the recycled file
+    // is past the newest one, where nothing reads it.
+    int retval = 1;
+    if ((int64_t)nextIndex >= numFiles){
+        char dataFileOldName[MODULE_FNAME_SZ] = {0x0, };
+        snprintf(dataFileOldName, sizeof(dataFileOldName), "%" PRIu64 ".dat", nextIndex - numFiles);
+
+        if (renameat(dlgr->dirFd, dataFileOldName, dlgr->dirFd, dataFileNewName) != 0 && errno != ENOENT){
+            retval = ERR_DATA_REMOVE;
+        }
+    }
+
+    // Not truncated: a recycled file keeps its blocks and is overwritten from the start.
+    int fd = openat(dlgr->dirFd, dataFileNewName, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0){
+        eprintf("Could not open %s, keeping the full file.", dataFileNewName);
+        // Keep appending to the full file rather than losing records.
+        dlgr_open_data(dlgr, 0);
+        return ERR_DATA_OPEN;
+    }
+
+    struct stat sb;
+    int reused = fstat(fd, &sb) == 0 && sb.st_size > 0;
+
+    // Reserve the whole file now so that writes never allocate; a recycled file
+    // already has most of it. The size is kept, as readers of a new file count
+    // records by it. Not every file system supports this.
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, maxFileSize + DLGR_FRAME_MAX(dlgr->moduleLogSize) * DLGR_BATCH_MAX_RECORDS);
+
+    // The old records of a recycled file are cut off by a new header with an
+    // empty dataEnd, made durable before the file becomes the current one.
+    dlgr_file_header_t header;
+    int headerOk = 1;
+    if (reused){
+        dlgr_make_header(dlgr, &header);
+        header.fileIndex = nextIndex;
+        header.dataEnd = sizeof(header);
+        headerOk = write(fd, &header, sizeof(header)) == sizeof(header) && fdatasync(fd) == 0;
+    }
+
+    // Commit the rotation: the new file's directory entry first, then the index.
+    // A power failure before this leaves the previous index, and its file, intact.
+    // The index is only advanced by dlgr_save_state, once it is stored.
+    if (!headerOk || fsync(dlgr->dirFd) < 0 || dlgr_save_state(dlgr, nextIndex) < 0){
+        close(fd);
+        unlinkat(dlgr->dirFd, dataFileNewName, 0);
+        eprintf("Could not commit %s, keeping the full file.", dataFileNewName);
+        // Keep appending to the full file rather than losing records.
+        dlgr_open_data(dlgr, 0);
+        return ERR_INDEX_OPEN;
+    }
+
+    dlgr->dataFd = fd;
+    dlgr->fileReused = reused;
+    dlgr->fileSize = reused ? (ssize_t)sizeof(header) : 0;
+    if (reused){
+        dlgr->fileFlags = header.flags;
+    }
+
+    // Smaller limits shrink the ring: files older than the recycled one are
+    // over the budget. They run down without gaps to the oldest, so the first
+    // missing one ends the sweep; usually that is the first.
+    uint64_t oldIndex = (int64_t)nextIndex > numFiles ? nextIndex - numFiles : 0;
+    while (oldIndex > 0){
+        char dataFileOldName[MODULE_FNAME_SZ] = {0x0, };
+        snprintf(dataFileOldName, sizeof(dataFileOldName), "%" PRIu64 ".dat", --oldIndex);
+        if (unlinkat(dlgr->dirFd, dataFileOldName, 0) != 0){
+            if (errno != ENOENT){
+                retval = ERR_DATA_REMOVE;
+            }
+            break;
+        }
+    }
+
+    dlgr_debug("DEBUG: Rotated to %s.", dataFileNewName);
+
+    return retval;
+}
+
+FILE *dlgr_fopenat(int dirFd, const char *fileName, const char *mode)
+{
+    int flags = O_CLOEXEC;
+
+    switch (mode[0]){
+        case 'r':
+            flags |= O_RDONLY;
+            break;
+        case 'w':
+            flags |= O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case 'a':
+            flags |= O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        default:
+            return NULL;
+    }
+
+    if (strchr(mode, '+') != NULL){
+        flags = (flags & ~(O_RDONLY | O_WRONLY)) | O_RDWR;
+    }
+
+    int fd = openat(dirFd, fileName, flags, S_IRUSR | S_IWUSR);
+    if (fd < 0){
+        return NULL;
+    }
+
+    FILE *fp = fdopen(fd, mode);
+    if (fp == NULL){
+        close(fd);
+    }
+
+    return fp;
+}
+
+int dlgr_RetrieveData(char *moduleName, char *output, int numRequestedLogs)
+{
+    return dlgr_RetrieveDataH(dlgr_GetHandle(moduleName), output, numRequestedLogs);
+}
+
+int dlgr_RetrieveDataH(dlgr_handle_t handle, char *output, int numRequestedLogs)
+{
+    LAT_START(start);
+    int retval = dlgr_retrieve_data(handle, output, numRequestedLogs);
+    LAT_RECORD(&dlgr_lat[DLGR_LAT_RETRIEVE], start, retval < 0);
+    return retval;
+}
+
+int dlgr_retrieve_data(dlgr_handle_t handle, char *output, int numRequestedLogs)
+{
+    dlgr_debug("DEBUG: dlgr_RetrieveData called...");
+
+    if (handle < 0 || handle >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    if (output == NULL || numRequestedLogs < 0){
+        return ERR_INVALID_INPUT;
+    }
+
+    // The records are read through a window on the stack; nothing is allocated.
+    dlgr_iter_t iter;
+    int numReadLogs = dlgr_iter_openH(&iter, handle);
+    if (numReadLogs >= 0){
+        numReadLogs = dlgr_iter_read(&iter, output, numRequestedLogs);
+    }
+    dlgr_iter_close(&iter);
+
+    if (numReadLogs < 0){
+        return numReadLogs;
+    }
+
+    if (numReadLogs != numRequestedLogs){
+        return ERR_READ_NUM;
+    }
+
+    dlgr_debug("DEBUG: Finished data retrieval.");
+
+    return 1;
+}
+
+int dlgr_RetrieveRange(char *moduleName, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs)
+{
+    return dlgr_RetrieveRangeH(dlgr_GetHandle(moduleName), tStart, tEnd, output, maxLogs);
+}
+
+int dlgr_RetrieveRangeH(dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs)
+{
+    LAT_START(start);
+    int retval = dlgr_retrieve_range(handle, tStart, tEnd, output, maxLogs);
+    LAT_RECORD(&dlgr_lat[DLGR_LAT_RETRIEVE_RANGE], start, retval < 0);
+    return retval;
+}
+
+int dlgr_retrieve_range(dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, char *output, int maxLogs)
+{
+    dlgr_debug("DEBUG: dlgr_RetrieveRange called...");
+
+    if (handle < 0 || handle >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    if (output == NULL || maxLogs < 0 || tStart > tEnd){
+        return ERR_INVALID_INPUT;
+    }
+
+    // Files that start after tEnd are not opened at all.
+    dlgr_iter_t iter;
+    int numReadLogs = dlgr_iter_start(&iter, handle, 0, tEnd);
+    if (numReadLogs >= 0){
+        int exhausted = 0;
+        numReadLogs = 0;
+        while (numReadLogs < maxLogs && !exhausted){
+            int retval = dlgr_iter_read_range(&iter, tStart, tEnd, output + (size_t)numReadLogs * iter.outStride, maxLogs - numReadLogs, &exhausted);
+            if (retval < 0){
+                numReadLogs = retval;
+                break;
+            }
+            numReadLogs += retval;
+        }
+    }
+    dlgr_iter_close(&iter);
+
+    dlgr_debug("DEBUG: dlgr_RetrieveRange finished.");
+
+    return numReadLogs;
+}
+
+int dlgr_iter_read_range(dlgr_iter_t *iter, uint64_t tStart, uint64_t tEnd, char *output, int maxRecords, int *exhausted)
+{
+    ssize_t stride = iter->outStride;
+    ssize_t timeOffset = iter->packed ? 0 : FBEGIN_SIZE;
+
+    int retval = dlgr_iter_read(iter, output, maxRecords);
+    if (retval <= 0){
+        *exhausted = 1;
+        return retval;
+    }
+
+    // Newest first: drop records after tEnd and stop at the first one before tStart.
+    int numRecords = 0;
+    for (int i = 0; i < retval; i++){
+        dlgr_timestamp_t timestamp;
+        memcpy(&timestamp, output + i * stride + timeOffset, sizeof(timestamp));
+
+        if (timestamp.realtime > tEnd){
+            continue;
+        }
+        // Records from before timestamps read as zero and are older than any timestamped record.
+        if (timestamp.realtime < tStart || timestamp.realtime == 0){
+            *exhausted = 1;
+            break;
+        }
+        if (i != numRecords){
+            memmove(output + numRecords * stride, output + i * stride, stride);
+        }
+        numRecords++;
+    }
+
+    return numRecords;
+}
+
+int dlgr_describe_data(datalogger_t *dlgr, int fd, dlgr_file_desc_t *desc)
+{
+    // The header, if any, says where the records start and how long they are.
+    int hasHeader = dlgr_read_header(fd, &desc->header);
+    if (hasHeader < 0){
+        return hasHeader;
+    }
+
+    if (hasHeader > 0){
+        if (desc->header.recordSize != dlgr->moduleLogSize || desc->header.schemaId != dlgr->schemaId){
+            return ERR_LOG_SIZE;
+        }
+        desc->dataStart = desc->header.headerSize;
+        desc->stride = desc->header.stride;
+        desc->hasTimestamps = (desc->header.flags & DLGR_HEADER_TIMESTAMPS) != 0;
+    } else {
+        desc->stride = dlgr->moduleLogSize + FBEGIN_SIZE + FEND_SIZE;
+    }
+
+    return hasHeader;
+}
+
+void dlgr_copy_plain(datalogger_t *dlgr, const char *record, int hasTimestamps, int packed, char *output)
+{
+    if (!packed){
+        if (hasTimestamps){
+            memcpy(output, record, dlgr->recordStride);
+            return;
+        }
+        memcpy(output, record, FBEGIN_SIZE);
+        output += FBEGIN_SIZE;
+    }
+
+    if (hasTimestamps){
+        memcpy(output, record + FBEGIN_SIZE, sizeof(dlgr_timestamp_t) + dlgr->moduleLogSize);
+        return;
+    }
+
+    // Records from before timestamps are returned in the current layout with a zero timestamp.
+    memset(output, 0x0, sizeof(dlgr_timestamp_t));
+    memcpy(output + sizeof(dlgr_timestamp_t), record + FBEGIN_SIZE, dlgr->moduleLogSize + (packed ? 0 : FEND_SIZE));
+}
+
+int dlgr_iter_open(dlgr_iter_t *iter, char *moduleName)
+{
+    return dlgr_iter_openH(iter, dlgr_GetHandle(moduleName));
+}
+
+int dlgr_iter_openH(dlgr_iter_t *iter, dlgr_handle_t handle)
+{
+    return dlgr_iter_start(iter, handle, 0, UINT64_MAX);
+}
+
+int dlgr_iter_start(dlgr_iter_t *iter, dlgr_handle_t handle, int packed, uint64_t newest)
+{
+    if (iter == NULL){
+        return ERR_INVALID_INPUT;
+    }
+    iter->fd = -1;
+
+    if (handle < 0 || handle >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    if (!atomic_load_explicit(&dlgr_setup_done, memory_order_acquire)){
+        return ERR_NOT_READY;
+    }
+
+    datalogger_t *dlgr = &dlgr_settings[handle];
+
+    // Every record and frame must fit in the window.
+    if (dlgr->recordStride > DLGR_ITER_WINDOW || DLGR_FRAME_MAX(dlgr->moduleLogSize) > DLGR_ITER_WINDOW){
+        return ERR_MAXLOGSIZE_EXCEEDED;
+    }
+
+    iter->handle = handle;
+    iter->packed = packed;
+    iter->outStride = packed ? DLGR_PACKED_STRIDE(dlgr->moduleLogSize) : dlgr->recordStride;
+    iter->newest = newest;
+    // The datalogger thread may rotate concurrently; newer files are not walked.
+    iter->fileIndex = atomic_load_explicit(&dlgr->logIndex, memory_order_relaxed);
+
+    int retval = dlgr_iter_advance(iter, 1);
+    return retval < 0 ? retval : 1;
+}
+
+int dlgr_iter_next(dlgr_iter_t *iter, char *output, int maxRecords)
+{
+    LAT_START(start);
+    int retval = dlgr_iter_read(iter, output, maxRecords);
+    LAT_RECORD(&dlgr_lat[DLGR_LAT_ITER], start, retval < 0);
+    return retval;
+}
+
+void dlgr_iter_close(dlgr_iter_t *iter)
+{
+    if (iter != NULL && iter->fd >= 0){
+        close(iter->fd);
+        iter->fd = -1;
+    }
+}
+
+int dlgr_iter_read(dlgr_iter_t *iter, char *output, int maxRecords)
+{
+    if (iter == NULL || output == NULL || maxRecords < 0){
+        return ERR_INVALID_INPUT;
+    }
+
+    // Every file has been read.
+    if (iter->fd < 0){
+        return 0;
+    }
+
+    int numRecords = 0;
+
+    while (numRecords < maxRecords && iter->fd >= 0){
+        int retval = iter->compressed ? dlgr_iter_read_frames(iter, output + (size_t)numRecords * iter->outStride, maxRecords - numRecords)
+                                      : dlgr_iter_read_plain(iter, output + (size_t)numRecords * iter->outStride, maxRecords - numRecords);
+        if (retval < 0){
+            return retval;
+        }
+        numRecords += retval;
+
+        // The file is done, or ended early because it was recycled while being read.
+        if (retval == 0 && (retval = dlgr_iter_advance(iter, 0)) < 0){
+            return retval;
+        }
+    }
+
+    return numRecords;
+}
+
+int dlgr_iter_advance(dlgr_iter_t *iter, int first)
+{
+    datalogger_t *dlgr = &dlgr_settings[iter->handle];
+
+    for (;; first = 0){
+        if (!first){
+            dlgr_iter_close(iter);
+            if (iter->fileIndex == 0){
+                return 0;
+            }
+            iter->fileIndex--;
+        }
+
+        char dataFileName[MODULE_FNAME_SZ] = {0x0, };
+        snprintf(dataFileName, sizeof(dataFileName), "%" PRIu64 ".dat", iter->fileIndex);
+
+        iter->fd = openat(dlgr->dirFd, dataFileName, O_RDONLY | O_CLOEXEC);
+        if (iter->fd < 0){
+            // Past the oldest file still on disk.
+            return errno == ENOENT ? 0 : ERR_DATA_OPEN;
+        }
+
+        struct stat sb;
+        dlgr_file_desc_t desc;
+        memset(&desc, 0x0, sizeof(desc));
+        int hasHeader = fstat(iter->fd, &sb) < 0 ? ERR_DATA_READ : dlgr_describe_data(dlgr, iter->fd, &desc);
+        if (hasHeader < 0){
+            dlgr_iter_close(iter);
+            // Files before a change of schema (see: dlgr_init) hold other records.
+            return hasHeader == ERR_LOG_SIZE ? 0 : hasHeader;
+        }
+
+        // Every record of a file is at least as new as its first one.
+        if (hasHeader > 0 && desc.hasTimestamps && desc.header.firstRecordTime > iter->newest){
+            continue;
+        }
+
+        iter->hasTimestamps = desc.hasTimestamps;
+        iter->compressed = hasHeader > 0 && (desc.header.flags & DLGR_HEADER_COMPRESSED);
+        iter->stride = desc.stride;
+        iter->dataStart = desc.dataStart;
+        iter->winStart = 0;
+        iter->winLen = 0;
+
+        // The records of a reused file end at its header's dataEnd, ahead of the old ones.
+        off_t end = sb.st_size;
+        if (hasHeader > 0 && desc.header.dataEnd > 0 && desc.header.dataEnd < end){
+            end = desc.header.dataEnd;
+        }
+
+        if (iter->compressed){
+            iter->dataEnd = end;
+            // The first scan also finds where the valid frames end.
+            if (dlgr_iter_scan(iter, end) > 0){
+                return 1;
+            }
+        } else {
+            // A partially written record at the end of the file is ignored.
+            int numRecords = end > iter->dataStart ? (end - iter->dataStart) / iter->stride : 0;
+            iter->dataEnd = iter->dataStart + (off_t)numRecords * iter->stride;
+            // Records after newest are skipped without being read.
+            if (numRecords > 0 && iter->hasTimestamps && iter->newest != UINT64_MAX){
+                numRecords = dlgr_iter_search(iter, numRecords);
+                if (numRecords < 0){
+                    dlgr_iter_close(iter);
+                    return numRecords;
+                }
+            }
+            iter->next = numRecords - 1;
+            if (numRecords > 0){
+                return 1;
+            }
+        }
+    }
+}
+
+int dlgr_iter_search(dlgr_iter_t *iter, int numRecords)
+{
+    int lo = 0, hi = numRecords;
+
+    // Records are in time order: find the first one after newest.
+    while (lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        off_t offset = iter->dataStart + (off_t)mid * iter->stride;
+
+        // Fill the window with the records around mid, which also holds the last steps of the search.
+        if (offset < iter->winStart || offset + iter->stride > iter->winStart + iter->winLen){
+            int count = DLGR_ITER_WINDOW / iter->stride;
+            if (count > numRecords){
+                count = numRecords;
+            }
+            int first = mid - count / 2;
+            if (first < 0){
+                first = 0;
+            } else if (first + count > numRecords){
+                first = numRecords - count;
+            }
+            iter->winStart = iter->dataStart + (off_t)first * iter->stride;
+            iter->winLen = pread(iter->fd, iter->window, (size_t)count * iter->stride, iter->winStart);
+            if (iter->winLen < 0){
+                iter->winLen = 0;
+                return ERR_DATA_READ;
+            }
+            if (dlgr_iter_reused(iter)){
+                iter->winLen = 0;
+                return 0;
+            }
+            if (offset + iter->stride > iter->winStart + iter->winLen){
+                // Shorter than when it was opened; only what is left is searched.
+                hi = mid;
+                continue;
+            }
+        }
+
+        dlgr_timestamp_t timestamp;
+        memcpy(&timestamp, iter->window + (offset - iter->winStart) + FBEGIN_SIZE, sizeof(timestamp));
+        if (timestamp.realtime <= iter->newest){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int dlgr_iter_read_plain(dlgr_iter_t *iter, char *output, int maxRecords)
+{
+    datalogger_t *dlgr = &dlgr_settings[iter->handle];
+    int numRecords = 0;
+
+    for (; numRecords < maxRecords && iter->next >= 0; iter->next--, numRecords++){
+        off_t offset = iter->dataStart + (off_t)iter->next * iter->stride;
+
+        // Fill the window with this record and as many older ones as fit.
+        if (offset < iter->winStart || offset + iter->stride > iter->winStart + iter->winLen){
+            int count = DLGR_ITER_WINDOW / iter->stride;
+            if (count > iter->next + 1){
+                count = iter->next + 1;
+            }
+            iter->winStart = offset + iter->stride - (off_t)count * iter->stride;
+            iter->winLen = pread(iter->fd, iter->window, (size_t)count * iter->stride, iter->winStart);
+            if (iter->winLen < 0){
+                iter->winLen = 0;
+                return ERR_DATA_READ;
+            }
+            if (offset + iter->stride > iter->winStart + iter->winLen || dlgr_iter_reused(iter)){
+                // Shorter than when it was opened, or reused: recycled by the datalogger thread.
+                iter->next = -1;
+                break;
+            }
+        }
+
+        dlgr_copy_plain(dlgr, iter->window + (offset - iter->winStart), iter->hasTimestamps, iter->packed, output + (size_t)numRecords * iter->outStride);
+    }
+
+    return numRecords;
+}
+
+const char *dlgr_iter_window(dlgr_iter_t *iter, off_t offset, ssize_t *avail)
+{
+    datalogger_t *dlgr = &dlgr_settings[iter->handle];
+    off_t winEnd = iter->winStart + iter->winLen;
+
+    // Refill unless the window holds a whole frame at offset, or everything up to the end.
+    if (offset < iter->winStart || offset >= winEnd || (offset + DLGR_FRAME_MAX(dlgr->moduleLogSize) > winEnd && winEnd < iter->dataEnd)){
+        ssize_t len = iter->dataEnd - offset < DLGR_ITER_WINDOW ? iter->dataEnd - offset : DLGR_ITER_WINDOW;
+        iter->winStart = offset;
+        iter->winLen = len > 0 ? pread(iter->fd, iter->window, len, offset) : 0;
+        if (iter->winLen <= 0 || dlgr_iter_reused(iter)){
+            iter->winLen = 0;
+            return NULL;
+        }
+        winEnd = iter->winStart + iter->winLen;
+    }
+
+    *avail = winEnd - offset;
+    return iter->window + (offset - iter->winStart);
+}
+
+int dlgr_iter_reused(dlgr_iter_t *iter)
+{
+    dlgr_file_header_t header;
+    ssize_t ret = pread(iter->fd, &header, sizeof(header), 0);
+
+    // A file without a header only gets one when it is reused.
+    if (iter->dataStart == 0){
+        return ret >= (ssize_t)sizeof(header.magic) && memcmp(header.magic, DLGR_HEADER_MAGIC, sizeof(header.magic)) == 0;
+    }
+
+    return ret != (ssize_t)sizeof(header) || header.fileIndex != iter->fileIndex;
+}
+
+int dlgr_iter_scan(dlgr_iter_t *iter, off_t end)
+{
+    datalogger_t *dlgr = &dlgr_settings[iter->handle];
+    uint16_t prev[DLGR_RECORD_WORDS(dlgr->moduleLogSize)];
+    dlgr_timestamp_t prevTime = {0, 0};
+    off_t offset = iter->dataStart;
+
+    iter->numKeys = 0;
+
+    while (offset < end){
+        ssize_t avail;
+        const char *frame = dlgr_iter_window(iter, offset, &avail);
+        int used = frame == NULL ? 0 : dlgr_decode_frame(dlgr, frame, avail, prev, &prevTime, iter->numKeys > 0, 0, NULL);
+        if (used == 0){
+            // Truncated or corrupt; everything before it is still good.
+            break;
+        }
+
+        if (frame[0] == DLGR_FRAME_KEY){
+            // Groups are in time order: one starting after newest ends the groups wanted.
+            dlgr_timestamp_t keyTime;
+            memcpy(&keyTime, frame + 1, sizeof(keyTime));
+            if (keyTime.realtime > iter->newest){
+                break;
+            }
+
+            // Only the newest DLGR_ITER_KEYFRAMES groups are kept; older ones are found by a later scan.
+            if (iter->numKeys == DLGR_ITER_KEYFRAMES){
+                memmove(&iter->keys[0], &iter->keys[1], sizeof(iter->keys[0]) * (DLGR_ITER_KEYFRAMES - 1));
+                iter->numKeys--;
+            }
+            iter->keys[iter->numKeys].offset = offset;
+            iter->keys[iter->numKeys].numRecords = 0;
+            iter->numKeys++;
+        }
+        iter->keys[iter->numKeys - 1].numRecords++;
+        offset += used;
+    }
+
+    if (end == iter->dataEnd){
+        iter->dataEnd = offset;
+    }
+    iter->groupLeft = iter->numKeys > 0 ? iter->keys[iter->numKeys - 1].numRecords : 0;
+
+    return iter->numKeys;
+}
+
+int dlgr_iter_read_frames(dlgr_iter_t *iter, char *output, int maxRecords)
+{
+    datalogger_t *dlgr = &dlgr_settings[iter->handle];
+    uint16_t prev[DLGR_RECORD_WORDS(dlgr->moduleLogSize)];
+    int numRecords = 0;
+
+    while (numRecords < maxRecords){
+        if (iter->numKeys == 0){
+            // Look for older groups before the oldest one returned.
+            off_t end = iter->keys[0].offset;
+            if (end <= iter->dataStart || dlgr_iter_scan(iter, end) == 0){
+                break;
+            }
+        }
+
+        // A group's records can only be decoded oldest first, from its keyframe, so
+        // they are written straight to their newest-first place in output.
+        int take = maxRecords - numRecords < iter->groupLeft ? maxRecords - numRecords : iter->groupLeft;
+        dlgr_timestamp_t prevTime = {0, 0};
+        off_t offset = iter->keys[iter->numKeys - 1].offset;
+
+        for (int n = 0; n < iter->groupLeft; n++){
+            int slot = iter->groupLeft - 1 - n;
+            ssize_t avail;
+            const char *frame = dlgr_iter_window(iter, offset, &avail);
+            int used = frame == NULL ? 0 : dlgr_decode_frame(dlgr, frame, avail, prev, &prevTime, n > 0, iter->packed, slot < take ? output + (size_t)(numRecords + slot) * iter->outStride : NULL);
+            if (used == 0){
+                // Rewritten since the scan: recycled by the datalogger thread.
+                iter->numKeys = 0;
+                iter->keys[0].offset = iter->dataStart;
+                return numRecords;
+            }
+            offset += used;
+        }
+
+        numRecords += take;
+        iter->groupLeft -= take;
+        if (iter->groupLeft == 0){
+            // keys[0].offset stays as the end of the next scan once the last group is done.
+            if (--iter->numKeys > 0){
+                iter->groupLeft = iter->keys[iter->numKeys - 1].numRecords;
+            }
+        }
+    }
+
+    return numRecords;
+}
+
+ssize_t dlgr_QueryMemorySize(char *moduleName, int numRequestedLogs)
+{
+    return dlgr_QueryMemorySizeH(dlgr_GetHandle(moduleName), numRequestedLogs);
+}
+
+ssize_t dlgr_QueryMemorySizeH(dlgr_handle_t mod_idx, int numRequestedLogs)
+{
+    dlgr_debug("DEBUG: dlgr_QueryMemorySize called...");
+
+    if (mod_idx < 0 || mod_idx >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    dlgr_debug("DEBUG: dlgr_QueryMemorySize finished.");
+    return numRequestedLogs * dlgr_settings[mod_idx].recordStride;
+}
+
+int dlgr_EditSettings(char *moduleName, int value, int setting)
+{
+    dlgr_debug("DEBUG: dlgr_EditSettings called...");
+
+    dlgr_handle_t mod_idx = dlgr_GetHandle(moduleName);
+    if (mod_idx < 0){
+        return mod_idx;
+    }
+
+    // Until then dlgr_Setup would replace the settings with the stored ones.
+    if (!atomic_load_explicit(&dlgr_setup_done, memory_order_acquire)){
+        return ERR_NOT_READY;
+    }
+
+    //int moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
+
+    switch (setting){
+        case MAX_FILE_SIZE:
+            if (value > SIZE_FILE_HARDLIMIT || value < 1){
+                return ERR_SETTINGS_SET;
+            }
+            break;
+        case MAX_DIR_SIZE:
+            if (value > SIZE_DIR_HARDLIMIT || value < 1){
+                return ERR_SETTINGS_SET;
+            }
+            break;
+        default:
+            return ERR_DEFAULT_CASE;
+    }
+
+    // The datalogger thread reads both limits from one word, so it never sees
+    // half of a change. The directory must hold at least one file.
+    _Atomic uint64_t *sizeSetting = &dlgr_settings[mod_idx].sizeSetting;
+    uint64_t sizes = atomic_load_explicit(sizeSetting, memory_order_relaxed);
+    uint64_t newSizes;
+    do {
+        int maxFileSize = setting == MAX_FILE_SIZE ? value : DLGR_SETTING_FIRST(sizes);
+        int maxDirSize = setting == MAX_DIR_SIZE ? value : DLGR_SETTING_SECOND(sizes);
+        if (maxDirSize < maxFileSize){
+            return ERR_SETTINGS_SET;
+        }
+        newSizes = DLGR_SETTING_PACK(maxFileSize, maxDirSize);
+    } while (!atomic_compare_exchange_weak_explicit(sizeSetting, &sizes, newSizes, memory_order_relaxed, memory_order_relaxed));
+
+    if (dlgr_save_state(NULL, 0) < 0){
+        return ERR_SETTINGS_OPEN;
+    }
+
+    dlgr_debug("DEBUG: dlgr_EditSettings finished.");
+    return 1;
+}
+
+void dlgr_destroy()
+{
+    dlgr_debug("DEBUG: dlgr_destroy called...");
+
+    int numModules = atomic_load_explicit(&dlgr_idx, memory_order_acquire);
+    for (int mod_idx = 0; mod_idx < numModules; mod_idx++){
+        datalogger_t *dlgr = &dlgr_settings[mod_idx];
+
+        // Every thread has been joined, so nothing else touches the queue anymore.
+        dlgr_drain(mod_idx);
+        dlgr_flush(dlgr);
+
+        if (dlgr->dataFd >= 0){
+            dlgr_sync(dlgr, 1);
+            close(dlgr->dataFd);
+            dlgr->dataFd = -1;
+        }
+
+        if (dlgr->dirFd >= 0){
+            close(dlgr->dirFd);
+            dlgr->dirFd = -1;
+        }
+
+    }
+
+    if (dlgr_state_fd >= 0){
+        close(dlgr_state_fd);
+        dlgr_state_fd = -1;
+    }
+    if (dlgr_log_fd >= 0){
+        close(dlgr_log_fd);
+        dlgr_log_fd = -1;
+    }
+    memset(&dlgr_state, 0x0, sizeof(dlgr_state));
+    atomic_store_explicit(&dlgr_setup_done, 0, memory_order_relaxed);
+
+    // Every buffer of every module goes with the arena.
+    free(dlgr_arena);
+    dlgr_arena = NULL;
+    dlgr_arena_capacity = 0;
+    dlgr_arena_used = 0;
+    dlgr_arena_modules = 0;
+    dlgr_settings = NULL;
+    dlgr_modname = NULL;
+    atomic_store_explicit(&dlgr_idx, 0, memory_order_relaxed);
+
+    dlgr_debug("DEBUG: dlgr_destroy finished.");
+}
@@ -0,0 +1,157 @@
+/**
+ * @file datalogger_export.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Cuts logged records into fixed-size downlink frames.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#define MAIN_PRIVATE       // enable prototypes in main.h
+#include <main.h>
+#undef MAIN_PRIVATE
+#include <stdint.h>
+#include <string.h>
+
+// CRC-16/CCITT-FALSE of every nibble value, see: dlgr_crc16.
+static const uint16_t dlgr_crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+uint16_t dlgr_crc16(const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < len; i++){
+        crc = (crc << 4) ^ dlgr_crc16_nibble[(crc >> 12) ^ (bytes[i] >> 4)];
+        crc = (crc << 4) ^ dlgr_crc16_nibble[(crc >> 12) ^ (bytes[i] & 0x0f)];
+    }
+
+    return crc;
+}
+
+int dlgr_export_open(dlgr_export_t *exp, char *moduleName, uint64_t tStart, uint64_t tEnd, int mtu, uint32_t firstSequence)
+{
+    return dlgr_export_openH(exp, dlgr_GetHandle(moduleName), tStart, tEnd, mtu, firstSequence);
+}
+
+int dlgr_export_openH(dlgr_export_t *exp, dlgr_handle_t handle, uint64_t tStart, uint64_t tEnd, int mtu, uint32_t firstSequence)
+{
+    if (exp == NULL){
+        return ERR_INVALID_INPUT;
+    }
+    // Until it is open, the pass has no frames.
+    exp->iter.fd = -1;
+    exp->finished = 1;
+
+    if (handle < 0 || handle >= atomic_load_explicit(&dlgr_idx, memory_order_acquire)){
+        return ERR_UNKNOWN_MODULE;
+    }
+
+    if (tStart > tEnd){
+        return ERR_INVALID_INPUT;
+    }
+
+    datalogger_t *dlgr = &dlgr_settings[handle];
+    int perFrame = (mtu - (int)sizeof(dlgr_export_header_t) - DLGR_EXPORT_CRC_SIZE) / (int)DLGR_PACKED_STRIDE(dlgr->moduleLogSize);
+    if (perFrame < 1 || dlgr->moduleLogSize > UINT16_MAX){
+        return ERR_INVALID_INPUT;
+    }
+
+    exp->tStart = tStart;
+    exp->tEnd = tEnd;
+    exp->schemaId = dlgr->schemaId;
+    exp->recordSize = dlgr->moduleLogSize;
+    exp->perFrame = perFrame < UINT8_MAX ? perFrame : UINT8_MAX;
+    exp->sequence = firstSequence;
+    exp->skip = (uint64_t)firstSequence * exp->perFrame;
+    exp->exhausted = 0;
+
+    int retval = dlgr_iter_start(&exp->iter, handle, 1, tEnd);
+    if (retval < 0){
+        return retval;
+    }
+
+    exp->finished = 0;
+    return 1;
+}
+
+/**
+ * @brief Reads up to maxRecords records of the range into out, packed.
+ *
+ * @return int Negative on failure (see: DLGR_ERRORS), otherwise the number of records read.
+ */
+static int dlgr_export_fill(dlgr_export_t *exp, char *out, int maxRecords)
+{
+    int numRecords = 0;
+
+    while (numRecords < maxRecords && !exp->exhausted){
+        int retval = dlgr_iter_read_range(&exp->iter, exp->tStart, exp->tEnd, out + numRecords * exp->iter.outStride, maxRecords - numRecords, &exp->exhausted);
+        if (retval < 0){
+            return retval;
+        }
+        numRecords += retval;
+    }
+
+    return numRecords;
+}
+
+int dlgr_export_next(dlgr_export_t *exp, void *frame)
+{
+    if (exp == NULL || frame == NULL){
+        return ERR_INVALID_INPUT;
+    }
+
+    if (exp->finished){
+        return 0;
+    }
+
+    dlgr_export_header_t header;
+    char *records = (char *)frame + sizeof(header);
+
+    // Frames before the one resumed from are rebuilt into this frame and dropped.
+    while (exp->skip > 0 && !exp->exhausted){
+        int retval = dlgr_export_fill(exp, records, exp->skip < (uint64_t)exp->perFrame ? (int)exp->skip : exp->perFrame);
+        if (retval < 0){
+            return retval;
+        }
+        exp->skip -= retval;
+    }
+    exp->skip = 0;
+
+    int numRecords = dlgr_export_fill(exp, records, exp->perFrame);
+    if (numRecords < 0){
+        return numRecords;
+    }
+
+    // A short frame, possibly empty, ends the pass.
+    if (numRecords < exp->perFrame){
+        exp->finished = 1;
+    }
+
+    header.magic = DLGR_EXPORT_MAGIC;
+    header.version = DLGR_EXPORT_VERSION;
+    header.flags = exp->finished ? DLGR_EXPORT_LAST : 0;
+    header.sequence = exp->sequence++;
+    header.schemaId = exp->schemaId;
+    header.recordSize = exp->recordSize;
+    header.numRecords = numRecords;
+    header.reserved = 0;
+    memcpy(frame, &header, sizeof(header));
+
+    size_t len = sizeof(header) + (size_t)numRecords * exp->iter.outStride;
+    uint16_t crc = dlgr_crc16(frame, len);
+    memcpy((char *)frame + len, &crc, sizeof(crc));
+
+    return len + DLGR_EXPORT_CRC_SIZE;
+}
+
+void dlgr_export_close(dlgr_export_t *exp)
+{
+    if (exp != NULL){
+        dlgr_iter_close(&exp->iter);
+    }
+}
@@ -13,10 +13,18 @@
 #include "eps_p31u/p31u.h"
 #undef EPS_P31U_PRIVATE
 #include "eps.h"
+#include "eps_stats.h"
+#include "eps_xport.h"
+#include "latency.h"
 #include <main.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <unistd.h>
 
 #define MODULE_NAME "eps"
@@ -24,228 +32,2032 @@
 /* Variable allocation for EPS */
 
 /**
-  * @brief The EPS object pointer.
-  *
-  */
-static p31u eps[1];
+ * @brief Where each board is, indexed by device.
+ *
+ */
+static const eps_dev_config_t eps_dev_configs[] = EPS_DEVICES;
+
+_Static_assert(sizeof(eps_dev_configs) / sizeof(eps_dev_configs[0]) == EPS_DEV_NUM, "EPS_DEVICES must list EPS_DEV_NUM boards");
+_Static_assert(EPS_DEV_NUM >= 1 && EPS_DEV_NUM <= EPS_DEV_MAX, "EPS_DEV_NUM must be between 1 and EPS_DEV_MAX");
+
+/**
+ * @brief One of the two buffers of the latest housekeeping snapshot.
+ *
+ */
+typedef struct
+{
+    _Atomic uint32_t seq; // Odd while the worker writes the buffer.
+    uint64_t time_ns;     // CLOCK_MONOTONIC time of the read.
+    eps_hk_t hk;
+} eps_snapshot_t;
+
+/**
+ * @brief A command slot and its state, see: eps_cmd_submit.
+ *
+ */
+typedef struct
+{
+    eps_cmd_t cmd;
+    eps_cmd_prio prio;
+    uint64_t seq;    // Submission order on the bus, for FIFO order within a priority.
+    int state;       // See: EPS_SLOT_*.
+    int abandoned;   // The submitter stopped waiting; free the slot once executed.
+} eps_cmd_slot_t;
+
+#define EPS_SLOT_FREE 0
+#define EPS_SLOT_QUEUED 1
+#define EPS_SLOT_RUNNING 2
+#define EPS_SLOT_DONE 3
+
+/**
+ * @brief Periodic work of a device, see: eps_sched_task_stats_t.
+ *
+ */
+typedef struct
+{
+    uint64_t period_ns;
+    uint64_t next_ns; // Absolute CLOCK_MONOTONIC deadline of the next run.
+    eps_sched_task_stats_t stats;
+    uint64_t jitter_sum_ns;
+} eps_task_t;
+
+typedef struct eps_bus eps_bus_t;
+
+/**
+ * @brief One EPS board.
+ *
+ * The command slots, tasks, policy and burst state are protected by the
+ * wait_m of the board's bus, the watchdog state by eps_wdt_m. The sample
+ * state is the bus worker's alone, as are writes to the snapshot and the
+ * configuration cache.
+ *
+ */
+typedef struct
+{
+    int id;         // Index in eps_devs.
+    eps_bus_t *bus; // NULL until eps_init.
+    int online;     // Initialized and answering pings; commands are refused otherwise.
+
+    p31u p31u[1];
+    eps_xport_t xport[1]; // Transfers with retries for the periodic bus work, if the bus can do them.
+    int xport_ok;
+
+    eps_cmd_slot_t cmd_slots[EPS_CMD_SLOTS];
+    eps_task_t tasks[EPS_TASK_NUM]; // Indexed by eps_task_id.
+    eps_sample_policy_t policy;
+    int bursting;
+    uint64_t burst_until_ns;
+
+    eps_hk_t hk;      // Newest housekeeping, partial reads merged into the last full one.
+    eps_hk_t hk_prev; // The sample before it, which triggers compare against.
+    int have_hk;
+    int hk_fresh;
+
+    /**
+     * latest names the snapshot buffer readers should use; the other one is
+     * where the next reply goes, so a reader is only ever disturbed by a
+     * writer that laps it twice. See: eps_dev_get_latest_hk.
+     */
+    eps_snapshot_t snapshot[2];
+    _Atomic int snapshot_latest;
+
+    /**
+     * Last-known configuration. The worker is the only writer, so it reads
+     * the cache without locking; conf_m guards the copies it hands out to
+     * other threads. A reboot loads the stored configuration again, so it
+     * invalidates the cache.
+     */
+    pthread_mutex_t conf_m[1];
+    eps_config_t conf_cache;
+    eps_config2_t conf2_cache;
+    int conf_valid;
+    int conf2_valid;
+
+    eps_wdt_stats_t wdt_stats;
+    uint64_t wdt_last_kick_ns; // Of the last successful kick.
+    int wdt_overdue;
+
+#ifndef NO_LATENCY_STATS
+    lat_hist_t cmd_lat[EPS_CMD_NUM]; // Of each command as its caller sees it.
+    lat_hist_t task_lat[EPS_TASK_NUM];
+    lat_hist_t wdt_lat;              // Of each watchdog kick, waiting for the bus included.
+#endif
+} eps_dev_t;
+
+/**
+ * @brief One I2C bus, and the worker of the EPS thread that polls and commands its boards.
+ *
+ */
+struct eps_bus
+{
+    int id; // i2c-dev bus number.
+
+    /**
+     * Held for every transaction on the bus, by its worker and eps_wdt_thread.
+     * Priority inheritance lets a kick waiting on it boost the worker.
+     */
+    pthread_mutex_t bus_m[1];
+
+    pthread_mutex_t wait_m[1];
+    pthread_cond_t *wait;         // Wakes the worker; eps_cmd_wait on the default device's bus, wait_own on the others.
+    pthread_cond_t wait_own[1];
+    pthread_cond_t done[1];       // Signals executed commands.
+    uint64_t cmd_seq;
+    int stopped;                  // The worker has exited.
+
+    eps_dev_t *devs[EPS_DEV_NUM]; // In device order.
+    int num_devs;
+
+#ifndef NO_LATENCY_STATS
+    lat_hist_t wake_lat; // How late the worker wakes for a deadline it slept until.
+#endif
+};
+
+static eps_dev_t eps_devs[EPS_DEV_NUM];
+
+/**
+ * @brief The buses in order of their first device, so eps_buses[0] is the default device's.
+ *
+ */
+static eps_bus_t eps_buses[EPS_DEV_NUM];
+static int eps_num_buses = 0;
+
+/**
+ * @brief Watchdog thread state; each device's wdt_* fields are protected by eps_wdt_m as well.
+ *
+ */
+pthread_cond_t eps_wdt_wait[1];
+static pthread_mutex_t eps_wdt_m[1] = {PTHREAD_MUTEX_INITIALIZER};
+
+// Waits on CLOCK_MONOTONIC deadlines; initialized by eps_init as the default device's bus wait.
+pthread_cond_t eps_cmd_wait[1];
+
+#define EPS_DEV_CHANNELS(dev, suffix)                                                                                                                                                \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_HK] = {EPS_LOG_HK suffix, sizeof(eps_hk_t), DLGR_SCHEMA_EPS_HK, EPS_LOG_PERIOD_MS, EPS_LOG_BATCH, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME},             \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_VI] = {EPS_LOG_VI suffix, sizeof(eps_hk_vi_t), DLGR_SCHEMA_EPS_HK_VI, EPS_VI_PERIOD_MS, EPS_LOG_BATCH, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME},        \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_WDT] = {EPS_LOG_WDT suffix, sizeof(eps_hk_wdt_t), DLGR_SCHEMA_EPS_HK_WDT, EPS_BASIC_PERIOD_MS, EPS_LOG_BATCH, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME}, \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_BASIC] = {EPS_LOG_BASIC suffix, sizeof(eps_hk_basic_t), DLGR_SCHEMA_EPS_HK_BASIC, EPS_BASIC_PERIOD_MS, EPS_LOG_BATCH, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME}, \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_CONF] = {EPS_LOG_CONF suffix, sizeof(eps_config_t), DLGR_SCHEMA_EPS_CONFIG, EPS_CONF_PERIOD_MS, 1, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME},         \
+    [(dev)*EPS_STREAM_NUM + EPS_STREAM_STATS] = {EPS_LOG_STATS suffix, sizeof(eps_stats_summary_t), DLGR_SCHEMA_EPS_STATS, EPS_STATS_WINDOW_MS, 1, EPS_LOG_MAX_DELAY_MS, EPS_LOG_KEYFRAME}
+
+// The default device keeps the plain names; device n appends n.
+const dlgr_channel_t eps_channels[EPS_NUM_CHANNELS] = {
+    EPS_DEV_CHANNELS(0, ""),
+#if EPS_DEV_NUM > 1
+    EPS_DEV_CHANNELS(1, "1"),
+#endif
+#if EPS_DEV_NUM > 2
+    EPS_DEV_CHANNELS(2, "2"),
+#endif
+#if EPS_DEV_NUM > 3
+    EPS_DEV_CHANNELS(3, "3"),
+#endif
+};
+
+dlgr_handle_t eps_handles[EPS_NUM_CHANNELS] = {[0 ... EPS_NUM_CHANNELS - 1] = ERR_UNKNOWN_MODULE};
+
+/**
+ * @brief Looks up a device that eps_init has set up.
+ *
+ * @return eps_dev_t* The device, NULL if there is none.
+ */
+static eps_dev_t *eps_dev_find(int dev)
+{
+    if (dev < 0 || dev >= EPS_DEV_NUM || eps_devs[dev].bus == NULL)
+    {
+        return NULL;
+    }
+    return &eps_devs[dev];
+}
+
+/**
+ * @brief Logs one record of a device's stream, if its channel is registered.
+ *
+ * @param dev The device.
+ * @param stream The stream.
+ * @param data A record of the stream's size.
+ */
+static void eps_stream_log(const eps_dev_t *dev, eps_stream_id stream, const void *data)
+{
+    int channel = dev->id * EPS_STREAM_NUM + stream;
+    if (eps_handles[channel] >= 0)
+    {
+        dlgr_LogDataH(eps_handles[channel], eps_channels[channel].maxLogSize, (void *)data);
+    }
+}
+
+/**
+ * @brief Default sampling policy of every device.
+ *
+ */
+static const eps_sample_policy_t eps_policy_default = {
+    .slow_period_ms = EPS_SLOW_PERIOD_MS,
+    .vi_period_ms = EPS_VI_PERIOD_MS,
+    .basic_period_ms = EPS_BASIC_PERIOD_MS,
+    .conf_period_ms = EPS_CONF_PERIOD_MS,
+    .hk_period_ms = EPS_HK_PERIOD_MS,
+    .burst_period_ms = EPS_BURST_PERIOD_MS,
+    .burst_duration_ms = EPS_BURST_DURATION_MS,
+    .vbatt_delta_mv = EPS_VBATT_DELTA_MV,
+    .current_delta_ma = EPS_CURRENT_DELTA_MA,
+    .trigger_latchup = 1,
+    .trigger_lup_cmd = 1,
+    .trigger_alarm = 1,
+};
+
+static uint64_t eps_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void eps_ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/**
+ * @brief Publishes a housekeeping reply to eps_dev_get_latest_hk readers.
+ *
+ * @param dev The device.
+ * @param hk The reply.
+ */
+static void eps_publish_hk(eps_dev_t *dev, const eps_hk_t *hk)
+{
+    int next = atomic_load_explicit(&dev->snapshot_latest, memory_order_relaxed) == 0 ? 1 : 0;
+    eps_snapshot_t *snap = &dev->snapshot[next];
+    uint32_t seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+
+    // Mark the buffer as being written before touching it.
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    snap->time_ns = eps_now_ns();
+    memcpy(&snap->hk, hk, sizeof(eps_hk_t));
+
+    atomic_store_explicit(&snap->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&dev->snapshot_latest, next, memory_order_release);
+}
+
+int eps_get_latest_hk(eps_hk_t *out, uint64_t *age_ns)
+{
+    return eps_dev_get_latest_hk(EPS_DEV_DEFAULT, out, age_ns);
+}
+
+int eps_dev_get_latest_hk(int dev_id, eps_hk_t *out, uint64_t *age_ns)
+{
+    eps_dev_t *dev = eps_dev_find(dev_id);
+    uint64_t time_ns;
+
+    if (dev == NULL)
+    {
+        return -1;
+    }
+
+    for (;;)
+    {
+        int latest = atomic_load_explicit(&dev->snapshot_latest, memory_order_acquire);
+        if (latest < 0)
+        {
+            return -1;
+        }
+
+        eps_snapshot_t *snap = &dev->snapshot[latest];
+        uint32_t seq = atomic_load_explicit(&snap->seq, memory_order_acquire);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        time_ns = snap->time_ns;
+        memcpy(out, &snap->hk, sizeof(eps_hk_t));
+
+        // Retry if the worker started rewriting this buffer while it was copied.
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&snap->seq, memory_order_relaxed) == seq)
+        {
+            break;
+        }
+    }
+
+    if (age_ns != NULL)
+    {
+        *age_ns = eps_now_ns() - time_ns;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief A field of a configuration struct, for dirty tracking.
+ *
+ */
+typedef struct
+{
+    size_t offset;
+    size_t size;
+} eps_conf_field_t;
+
+#define EPS_CONF_FIELD(type, field) {offsetof(type, field), sizeof(((type *)0)->field)}
+
+static const eps_conf_field_t eps_conf_fields[] = {
+    EPS_CONF_FIELD(eps_config_t, ppt_mode),
+    EPS_CONF_FIELD(eps_config_t, battheater_mode),
+    EPS_CONF_FIELD(eps_config_t, battheater_low),
+    EPS_CONF_FIELD(eps_config_t, battheater_high),
+    EPS_CONF_FIELD(eps_config_t, output_normal_value),
+    EPS_CONF_FIELD(eps_config_t, output_safe_value),
+    EPS_CONF_FIELD(eps_config_t, output_initial_on_delay),
+    EPS_CONF_FIELD(eps_config_t, output_initial_off_delay),
+    EPS_CONF_FIELD(eps_config_t, vboost),
+};
+
+static const eps_conf_field_t eps_conf2_fields[] = {
+    EPS_CONF_FIELD(eps_config2_t, batt_maxvoltage),
+    EPS_CONF_FIELD(eps_config2_t, batt_safevoltage),
+    EPS_CONF_FIELD(eps_config2_t, batt_criticalvoltage),
+    EPS_CONF_FIELD(eps_config2_t, batt_normalvoltage),
+    EPS_CONF_FIELD(eps_config2_t, reserved1),
+    EPS_CONF_FIELD(eps_config2_t, reserved2),
+};
+
+#define EPS_CONF_NUM_FIELDS(fields) (int)(sizeof(fields) / sizeof((fields)[0]))
+
+/**
+ * @brief Finds the fields in which two configurations differ.
+ *
+ * @param fields The fields of the configuration struct.
+ * @param num Number of fields.
+ * @param a A configuration.
+ * @param b The other configuration.
+ * @return uint32_t Bit i is set if fields[i] differs, 0 if the configurations are equal.
+ */
+static uint32_t eps_conf_diff(const eps_conf_field_t *fields, int num, const void *a, const void *b)
+{
+    uint32_t dirty = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (memcmp((const uint8_t *)a + fields[i].offset, (const uint8_t *)b + fields[i].offset, fields[i].size) != 0)
+        {
+            dirty |= 1u << i;
+        }
+    }
+    return dirty;
+}
+
+/**
+ * @brief Replaces a cached configuration. Called by the device's bus worker only.
+ *
+ * @param dev The device.
+ * @param cache The cached configuration.
+ * @param valid Its valid flag.
+ * @param conf The configuration now on the EPS, NULL if it is unknown.
+ * @param size Size of the configuration struct.
+ */
+static void eps_conf_store(eps_dev_t *dev, void *cache, int *valid, const void *conf, size_t size)
+{
+    pthread_mutex_lock(dev->conf_m);
+    if (conf != NULL)
+    {
+        memcpy(cache, conf, size);
+    }
+    *valid = conf != NULL;
+    pthread_mutex_unlock(dev->conf_m);
+}
+
+/**
+ * @brief Forgets the cached configuration, e.g. after the EPS rebooted. Called by the device's bus worker only.
+ *
+ */
+static void eps_conf_invalidate(eps_dev_t *dev)
+{
+    eps_conf_store(dev, &dev->conf_cache, &dev->conf_valid, NULL, sizeof(eps_config_t));
+    eps_conf_store(dev, &dev->conf2_cache, &dev->conf2_valid, NULL, sizeof(eps_config2_t));
+}
+
+/**
+ * @brief Copies a cached configuration out, if there is one.
+ *
+ * @return int 1 if it was copied, 0 if the cache is invalid.
+ */
+static int eps_conf_load(eps_dev_t *dev, const void *cache, const int *valid, void *conf, size_t size)
+{
+    pthread_mutex_lock(dev->conf_m);
+    int hit = *valid;
+    if (hit)
+    {
+        memcpy(conf, cache, size);
+    }
+    pthread_mutex_unlock(dev->conf_m);
+    return hit;
+}
+
+/**
+ * @brief Executes one command on a device. Called by its bus worker only, with the bus_m held.
+ *
+ * @param dev The device.
+ * @param cmd The command, results are written back into it.
+ */
+static void eps_cmd_exec(eps_dev_t *dev, eps_cmd_t *cmd)
+{
+    p31u *eps = dev->p31u;
+
+    switch (cmd->id)
+    {
+    case EPS_CMD_PING:
+        cmd->retval = eps_p31u_ping(eps);
+        break;
+    case EPS_CMD_REBOOT:
+        cmd->retval = eps_p31u_reboot(eps);
+        eps_conf_invalidate(dev);
+        break;
+    case EPS_CMD_TLUP:
+        cmd->retval = eps_p31u_tgl_lup(eps, cmd->arg[0]);
+        break;
+    case EPS_CMD_SLUP:
+        cmd->retval = eps_p31u_lup_set(eps, cmd->arg[0], cmd->arg[1]);
+        break;
+    case EPS_CMD_HARDRESET:
+        cmd->retval = eps_p31u_hardreset(eps);
+        eps_conf_invalidate(dev);
+        break;
+    case EPS_CMD_GET_HK:
+        cmd->retval = eps_p31u_get_hk(eps, &cmd->data.hk);
+        break;
+    case EPS_CMD_GET_HK_OUT:
+        cmd->retval = eps_p31u_get_hk_out(eps, &cmd->data.hk_out);
+        break;
+    case EPS_CMD_GET_HKPARAM:
+        cmd->retval = eps_p31u_get_hkparam(eps, &cmd->data.hkparam);
+        break;
+    case EPS_CMD_BATTHEATER_SET:
+        cmd->retval = eps_p31u_battheater_set(eps, cmd->tout_ms);
+        break;
+    case EPS_CMD_KS_SET:
+        cmd->retval = eps_p31u_ks_set(eps, cmd->tout_ms);
+        break;
+    case EPS_CMD_GET_CONF:
+        cmd->retval = eps_p31u_get_conf(eps, &cmd->data.conf);
+        if (cmd->retval >= 0)
+        {
+            eps_conf_store(dev, &dev->conf_cache, &dev->conf_valid, &cmd->data.conf, sizeof(eps_config_t));
+        }
+        break;
+    case EPS_CMD_SET_CONF:
+    {
+        // The EPS only takes whole configurations; skip the write if it would not change anything.
+        uint32_t dirty = dev->conf_valid ? eps_conf_diff(eps_conf_fields, EPS_CONF_NUM_FIELDS(eps_conf_fields),
+                                                         &dev->conf_cache, &cmd->data.conf)
+                                         : UINT32_MAX;
+        if (dirty == 0)
+        {
+            cmd->retval = 1;
+            break;
+        }
+        cmd->retval = eps_p31u_set_conf(eps, &cmd->data.conf);
+        // After a failed write the EPS may hold either configuration.
+        eps_conf_store(dev, &dev->conf_cache, &dev->conf_valid, cmd->retval >= 0 ? &cmd->data.conf : NULL, sizeof(eps_config_t));
+        break;
+    }
+    case EPS_CMD_GET_CONF2:
+        cmd->retval = eps_p31u_get_conf2(eps, &cmd->data.conf2);
+        if (cmd->retval >= 0)
+        {
+            eps_conf_store(dev, &dev->conf2_cache, &dev->conf2_valid, &cmd->data.conf2, sizeof(eps_config2_t));
+        }
+        break;
+    case EPS_CMD_SET_CONF2:
+    {
+        uint32_t dirty = dev->conf2_valid ? eps_conf_diff(eps_conf2_fields, EPS_CONF_NUM_FIELDS(eps_conf2_fields),
+                                                          &dev->conf2_cache, &cmd->data.conf2)
+                                          : UINT32_MAX;
+        if (dirty == 0)
+        {
+            cmd->retval = 1;
+            break;
+        }
+        cmd->retval = eps_p31u_set_conf2(eps, &cmd->data.conf2);
+        eps_conf_store(dev, &dev->conf2_cache, &dev->conf2_valid, cmd->retval >= 0 ? &cmd->data.conf2 : NULL, sizeof(eps_config2_t));
+        break;
+    }
+    case EPS_CMD_RESET_COUNTERS:
+        cmd->retval = eps_p31u_reset_counters(eps);
+        break;
+    case EPS_CMD_SET_HEATER:
+        cmd->retval = eps_p31u_set_heater(eps, cmd->data.reply, cmd->arg[0], cmd->arg[1], cmd->arg[2]);
+        // The heater mode is part of the cached configuration, whether or not this succeeded.
+        eps_conf_invalidate(dev);
+        break;
+    case EPS_CMD_SET_PV_AUTO:
+        cmd->retval = eps_p31u_set_pv_auto(eps, cmd->arg[0]);
+        // As is the PPT mode.
+        eps_conf_invalidate(dev);
+        break;
+    case EPS_CMD_SET_PV_VOLT:
+        cmd->retval = eps_p31u_set_pv_volt(eps, cmd->arg[0], cmd->arg[1], cmd->arg[2]);
+        // And the boost voltages.
+        eps_conf_invalidate(dev);
+        break;
+    case EPS_CMD_GET_HK_2_VI:
+        cmd->retval = eps_p31u_get_hk_2_vi(eps, &cmd->data.hk_vi);
+        break;
+    case EPS_CMD_GET_HK_WDT:
+        cmd->retval = eps_p31u_get_hk_wdt(eps, &cmd->data.hk_wdt);
+        break;
+    case EPS_CMD_GET_HK_2_BASIC:
+        cmd->retval = eps_p31u_get_hk_2_basic(eps, &cmd->data.hk_basic);
+        break;
+    default:
+        cmd->retval = EPS_CMD_ERR_INVALID;
+        break;
+    }
+}
+
+/**
+ * @brief Queues a command, see: eps_cmd_submit.
+ *
+ */
+static int eps_cmd_queue(eps_dev_t *dev, eps_cmd_t *cmd, eps_cmd_prio prio, int wait_ms)
+{
+    if (cmd == NULL || prio < EPS_PRIO_ROUTINE || prio >= EPS_PRIO_NUM || wait_ms < 0)
+    {
+        return EPS_CMD_ERR_INVALID;
+    }
+
+    if (dev == NULL)
+    {
+        return EPS_CMD_ERR_NODEV;
+    }
+
+    if (wait_ms > EPS_CMD_TIMEOUT * 1000)
+    {
+        wait_ms = EPS_CMD_TIMEOUT * 1000;
+    }
+
+    // Absolute deadline for pthread_cond_timedwait.
+    struct timespec deadline;
+    eps_ns_to_timespec(eps_now_ns() + wait_ms * 1000000ULL, &deadline);
+
+    eps_bus_t *bus = dev->bus;
+    pthread_mutex_lock(bus->wait_m);
+
+    if (bus->stopped)
+    {
+        pthread_mutex_unlock(bus->wait_m);
+        return EPS_CMD_ERR_STOPPED;
+    }
+
+    if (!dev->online)
+    {
+        pthread_mutex_unlock(bus->wait_m);
+        return EPS_CMD_ERR_NODEV;
+    }
+
+    eps_cmd_slot_t *slot = NULL;
+    for (int i = 0; i < EPS_CMD_SLOTS; i++)
+    {
+        if (dev->cmd_slots[i].state == EPS_SLOT_FREE)
+        {
+            slot = &dev->cmd_slots[i];
+            break;
+        }
+    }
+
+    if (slot == NULL)
+    {
+        pthread_mutex_unlock(bus->wait_m);
+        return EPS_CMD_ERR_FULL;
+    }
+
+    memcpy(&slot->cmd, cmd, sizeof(eps_cmd_t));
+    slot->prio = prio;
+    slot->seq = bus->cmd_seq++;
+    slot->state = EPS_SLOT_QUEUED;
+    slot->abandoned = (wait_ms == 0);
+    pthread_cond_signal(bus->wait);
+
+    if (wait_ms == 0)
+    {
+        pthread_mutex_unlock(bus->wait_m);
+        return 0;
+    }
+
+    int retval = 0;
+    while (slot->state != EPS_SLOT_DONE && retval != ETIMEDOUT)
+    {
+        retval = pthread_cond_timedwait(bus->done, bus->wait_m, &deadline);
+    }
+
+    if (slot->state == EPS_SLOT_QUEUED)
+    {
+        // Not started yet: cancelled, so a timeout means the command never reaches the EPS.
+        slot->state = EPS_SLOT_FREE;
+        pthread_mutex_unlock(bus->wait_m);
+        return bus->stopped ? EPS_CMD_ERR_STOPPED : EPS_CMD_ERR_TIMEOUT;
+    }
+
+    if (slot->state != EPS_SLOT_DONE)
+    {
+        // Already on the bus; the worker frees the slot once it completes and the result is dropped.
+        slot->abandoned = 1;
+        pthread_mutex_unlock(bus->wait_m);
+        return bus->stopped ? EPS_CMD_ERR_STOPPED : EPS_CMD_ERR_RUNNING;
+    }
+
+    memcpy(cmd, &slot->cmd, sizeof(eps_cmd_t));
+    slot->state = EPS_SLOT_FREE;
+    pthread_mutex_unlock(bus->wait_m);
+
+    return cmd->retval;
+}
+
+int eps_cmd_submit(eps_cmd_t *cmd, eps_cmd_prio prio, int wait_ms)
+{
+    return eps_dev_cmd_submit(EPS_DEV_DEFAULT, cmd, prio, wait_ms);
+}
+
+int eps_dev_cmd_submit(int dev_id, eps_cmd_t *cmd, eps_cmd_prio prio, int wait_ms)
+{
+    LAT_START(start);
+
+    eps_dev_t *dev = eps_dev_find(dev_id);
+    int retval = eps_cmd_queue(dev, cmd, prio, wait_ms);
+
+    // Time spent queued counts; that is what the caller waited for.
+    if (dev != NULL && cmd != NULL && cmd->id >= 0 && cmd->id < EPS_CMD_NUM)
+    {
+        LAT_RECORD(&dev->cmd_lat[cmd->id], start, retval < 0);
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Returns the next command to execute on a bus, highest priority and oldest first. Call with its wait_m held.
+ *
+ * @param bus The bus.
+ * @param dev Set to the device the command is for.
+ * @return eps_cmd_slot_t* The slot, NULL if no command is queued.
+ */
+static eps_cmd_slot_t *eps_cmd_next(eps_bus_t *bus, eps_dev_t **dev)
+{
+    eps_cmd_slot_t *next = NULL;
+
+    for (int d = 0; d < bus->num_devs; d++)
+    {
+        for (int i = 0; i < EPS_CMD_SLOTS; i++)
+        {
+            eps_cmd_slot_t *slot = &bus->devs[d]->cmd_slots[i];
+            if (slot->state != EPS_SLOT_QUEUED)
+            {
+                continue;
+            }
+            if (next == NULL || slot->prio > next->prio || (slot->prio == next->prio && slot->seq < next->seq))
+            {
+                next = slot;
+                *dev = bus->devs[d];
+            }
+        }
+    }
+
+    return next;
+}
+
+/**
+ * @brief Completes a command executed by a bus worker. Call with the bus's wait_m held.
+ *
+ * @param bus The bus.
+ * @param slot The command's slot.
+ */
+static void eps_cmd_complete(eps_bus_t *bus, eps_cmd_slot_t *slot)
+{
+    if (slot->abandoned)
+    {
+        slot->state = EPS_SLOT_FREE;
+    }
+    else
+    {
+        slot->state = EPS_SLOT_DONE;
+        pthread_cond_broadcast(bus->done);
+    }
+}
+
+int eps_ping()
+{
+    return eps_dev_ping(EPS_DEV_DEFAULT);
+}
+
+int eps_dev_ping(int dev)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_PING};
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_reboot()
+{
+    return eps_dev_reboot(EPS_DEV_DEFAULT);
+}
+
+int eps_dev_reboot(int dev)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_REBOOT};
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_CRITICAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_get_hkparam(hkparam_t *hk)
+{
+    return eps_dev_get_hkparam(EPS_DEV_DEFAULT, hk);
+}
+
+int eps_dev_get_hkparam(int dev, hkparam_t *hk)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HKPARAM};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(hk, &cmd.data.hkparam, sizeof(hkparam_t));
+    }
+    return retval;
+}
+
+int eps_get_hk(eps_hk_t *hk)
+{
+    return eps_dev_get_hk(EPS_DEV_DEFAULT, hk);
+}
+
+int eps_dev_get_hk(int dev, eps_hk_t *hk)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HK};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(hk, &cmd.data.hk, sizeof(eps_hk_t));
+    }
+    return retval;
+}
+
+int eps_get_hk_out(eps_hk_out_t *hk_out)
+{
+    return eps_dev_get_hk_out(EPS_DEV_DEFAULT, hk_out);
+}
+
+int eps_dev_get_hk_out(int dev, eps_hk_out_t *hk_out)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HK_OUT};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(hk_out, &cmd.data.hk_out, sizeof(eps_hk_out_t));
+    }
+    return retval;
+}
+
+void eps_hk_to_hkparam(const eps_hk_t *hk, hkparam_t *hkparam)
+{
+    memset(hkparam, 0x0, sizeof(hkparam_t));
+
+    for (int i = 0; i < 3; i++)
+    {
+        hkparam->pv[i] = hk->vboost[i];
+    }
+    hkparam->pc = hk->cursun;
+    hkparam->bv = hk->vbatt;
+    hkparam->sc = hk->cursys;
+    for (int i = 0; i < 4; i++)
+    {
+        hkparam->temp[i] = hk->temp[i];
+    }
+    // eps_hk_t has the two battery temperatures after the four board temperatures.
+    for (int i = 0; i < 2; i++)
+    {
+        hkparam->batt_temp[i] = hk->temp[4 + i];
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        hkparam->latchup[i] = hk->latchup[i];
+    }
+    hkparam->reset = hk->bootcause;
+    hkparam->bootcount = hk->counter_boot;
+    hkparam->ppt_mode = hk->pptmode;
+    // One bit per output, output 0 in the LSB.
+    for (int i = 0; i < 8; i++)
+    {
+        hkparam->channel_status |= (hk->output[i] ? 1 : 0) << i;
+    }
+}
+
+void eps_hk_to_hk_out(const eps_hk_t *hk, eps_hk_out_t *hk_out)
+{
+    memcpy(hk_out->curout, hk->curout, sizeof(hk_out->curout));
+    memcpy(hk_out->output, hk->output, sizeof(hk_out->output));
+    memcpy(hk_out->output_on_delta, hk->output_on_delta, sizeof(hk_out->output_on_delta));
+    memcpy(hk_out->output_off_delta, hk->output_off_delta, sizeof(hk_out->output_off_delta));
+    memcpy(hk_out->latchup, hk->latchup, sizeof(hk_out->latchup));
+}
+int eps_tgl_lup(eps_lup_idx lup)
+{
+    return eps_dev_tgl_lup(EPS_DEV_DEFAULT, lup);
+}
+
+int eps_dev_tgl_lup(int dev, eps_lup_idx lup)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_TLUP};
+    cmd.arg[0] = lup;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_CRITICAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_lup_set(eps_lup_idx lup, int pw)
+{
+    return eps_dev_lup_set(EPS_DEV_DEFAULT, lup, pw);
+}
+
+int eps_dev_lup_set(int dev, eps_lup_idx lup, int pw)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SLUP};
+    cmd.arg[0] = lup;
+    cmd.arg[1] = pw;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_CRITICAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_battheater_set(uint64_t tout_ms)
+{
+    return eps_dev_battheater_set(EPS_DEV_DEFAULT, tout_ms);
+}
+
+int eps_dev_battheater_set(int dev, uint64_t tout_ms)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_BATTHEATER_SET};
+    cmd.tout_ms = tout_ms;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_ks_set(uint64_t tout_ms)
+{
+    return eps_dev_ks_set(EPS_DEV_DEFAULT, tout_ms);
+}
+
+int eps_dev_ks_set(int dev, uint64_t tout_ms)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_KS_SET};
+    cmd.tout_ms = tout_ms;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_CRITICAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_hardreset()
+{
+    return eps_dev_hardreset(EPS_DEV_DEFAULT);
+}
+
+int eps_dev_hardreset(int dev)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_HARDRESET};
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_CRITICAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+/**
+ * @brief Sets up a bus for its first device. Called by eps_init only.
+ *
+ * @param bus The bus.
+ * @param id i2c-dev bus number.
+ * @param wait The condition that wakes its worker.
+ */
+static void eps_bus_init(eps_bus_t *bus, int id, pthread_cond_t *wait)
+{
+    bus->id = id;
+    bus->wait = wait;
+
+    // Deadlines are absolute CLOCK_MONOTONIC times, immune to clock adjustments.
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(bus->wait, &cond_attr);
+    pthread_cond_init(bus->done, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    // A kick waiting for the bus raises whoever holds it to the watchdog thread's priority.
+    pthread_mutexattr_t bus_attr;
+    pthread_mutexattr_init(&bus_attr);
+    pthread_mutexattr_setprotocol(&bus_attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(bus->bus_m, &bus_attr);
+    pthread_mutexattr_destroy(&bus_attr);
+
+    pthread_mutex_init(bus->wait_m, NULL);
+}
+
+/**
+ * @brief Initializes one board and ping-tests it.
+ *
+ * @return int 1 on success, -1 if the driver failed, -2 if the board does not answer.
+ */
+static int eps_dev_open(eps_dev_t *dev, const eps_dev_config_t *config)
+{
+    // Initializes the EPS component while checking if successful.
+    if (eps_p31u_init(dev->p31u, config->bus, config->addr) <= 0)
+    {
+        return -1;
+    }
+
+    // If we can't successfully ping the EPS then something has gone wrong.
+    if (eps_p31u_ping(dev->p31u) < 0)
+    {
+        return -2;
+    }
+
+    // Without I2C_RDWR transfers the periodic work goes through the driver.
+    dev->xport_ok = eps_xport_init(dev->xport, dev->p31u->bus->fd, dev->p31u->bus->addr) > 0;
+    if (!dev->xport_ok)
+    {
+        eprintf("I2C_RDWR transfers unavailable for EPS %d, using the p31u driver.", dev->id);
+    }
+
+    dev->online = 1;
+    return 1;
+}
+
+// Initializes the EPS boards and ping-tests them.
+int eps_init()
+{
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(eps_wdt_wait, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    int retval = 1;
+
+    for (int i = 0; i < EPS_DEV_NUM; i++)
+    {
+        eps_dev_t *dev = &eps_devs[i];
+        const eps_dev_config_t *config = &eps_dev_configs[i];
+
+        dev->id = i;
+        dev->policy = eps_policy_default;
+        atomic_init(&dev->snapshot_latest, -1);
+        pthread_mutex_init(dev->conf_m, NULL);
+        dev->wdt_stats.timeout_ns = EPS_GND_WDT_TIMEOUT_S * 1000000000ULL;
+        dev->wdt_stats.gnd_time_left_min = UINT32_MAX;
+
+        // Boards on one bus share its worker.
+        int b = 0;
+        while (b < eps_num_buses && eps_buses[b].id != config->bus)
+        {
+            b++;
+        }
+        eps_bus_t *bus = &eps_buses[b];
+        if (b == eps_num_buses)
+        {
+            eps_bus_init(bus, config->bus, b == 0 ? eps_cmd_wait : bus->wait_own);
+            eps_num_buses++;
+        }
+        bus->devs[bus->num_devs++] = dev;
+        dev->bus = bus;
+
+        int dev_retval = eps_dev_open(dev, config);
+        if (dev_retval < 0)
+        {
+            // Only the default board is required; the others are left offline.
+            eprintf("EPS %d on bus %d at 0x%02x failed to initialize (%d).", i, config->bus, config->addr, dev_retval);
+            if (i == EPS_DEV_DEFAULT)
+            {
+                retval = dev_retval;
+            }
+        }
+    }
+
+    return retval;
+}
+
+int eps_get_conf(eps_config_t *conf)
+{
+    return eps_dev_get_conf(EPS_DEV_DEFAULT, conf);
+}
+
+int eps_dev_get_conf(int dev_id, eps_config_t *conf)
+{
+    eps_dev_t *dev = eps_dev_find(dev_id);
+    if (dev != NULL && eps_conf_load(dev, &dev->conf_cache, &dev->conf_valid, conf, sizeof(eps_config_t)))
+    {
+        return 1;
+    }
+
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_CONF};
+    int retval = eps_dev_cmd_submit(dev_id, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(conf, &cmd.data.conf, sizeof(eps_config_t));
+    }
+    return retval;
+}
+
+int eps_set_conf(eps_config_t *conf)
+{
+    return eps_dev_set_conf(EPS_DEV_DEFAULT, conf);
+}
+
+int eps_dev_set_conf(int dev, eps_config_t *conf)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SET_CONF};
+    memcpy(&cmd.data.conf, conf, sizeof(eps_config_t));
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_get_conf2(eps_config2_t *conf)
+{
+    return eps_dev_get_conf2(EPS_DEV_DEFAULT, conf);
+}
+
+int eps_dev_get_conf2(int dev_id, eps_config2_t *conf)
+{
+    eps_dev_t *dev = eps_dev_find(dev_id);
+    if (dev != NULL && eps_conf_load(dev, &dev->conf2_cache, &dev->conf2_valid, conf, sizeof(eps_config2_t)))
+    {
+        return 1;
+    }
+
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_CONF2};
+    int retval = eps_dev_cmd_submit(dev_id, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(conf, &cmd.data.conf2, sizeof(eps_config2_t));
+    }
+    return retval;
+}
+
+int eps_set_conf2(eps_config2_t *conf)
+{
+    return eps_dev_set_conf2(EPS_DEV_DEFAULT, conf);
+}
+
+int eps_dev_set_conf2(int dev, eps_config2_t *conf)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SET_CONF2};
+    memcpy(&cmd.data.conf2, conf, sizeof(eps_config2_t));
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_reset_counters()
+{
+    return eps_dev_reset_counters(EPS_DEV_DEFAULT);
+}
+
+int eps_dev_reset_counters(int dev)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_RESET_COUNTERS};
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_set_heater(unsigned char *reply, uint8_t cmd_, uint8_t heater, uint8_t mode)
+{
+    return eps_dev_set_heater(EPS_DEV_DEFAULT, reply, cmd_, heater, mode);
+}
+
+int eps_dev_set_heater(int dev, unsigned char *reply, uint8_t cmd_, uint8_t heater, uint8_t mode)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SET_HEATER};
+    cmd.arg[0] = cmd_;
+    cmd.arg[1] = heater;
+    cmd.arg[2] = mode;
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(reply, cmd.data.reply, EPS_HEATER_REPLY_SZ);
+    }
+    return retval;
+}
+
+int eps_set_pv_auto(uint8_t mode)
+{
+    return eps_dev_set_pv_auto(EPS_DEV_DEFAULT, mode);
+}
+
+int eps_dev_set_pv_auto(int dev, uint8_t mode)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SET_PV_AUTO};
+    cmd.arg[0] = mode;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_set_pv_volt(uint16_t V1, uint16_t V2, uint16_t V3)
+{
+    return eps_dev_set_pv_volt(EPS_DEV_DEFAULT, V1, V2, V3);
+}
+
+int eps_dev_set_pv_volt(int dev, uint16_t V1, uint16_t V2, uint16_t V3)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_SET_PV_VOLT};
+    cmd.arg[0] = V1;
+    cmd.arg[1] = V2;
+    cmd.arg[2] = V3;
+    return eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_NORMAL, EPS_CMD_TIMEOUT * 1000);
+}
+
+int eps_get_hk_2_vi(eps_hk_vi_t *hk)
+{
+    return eps_dev_get_hk_2_vi(EPS_DEV_DEFAULT, hk);
+}
+
+int eps_dev_get_hk_2_vi(int dev, eps_hk_vi_t *hk)
+{
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HK_2_VI};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
+    {
+        memcpy(hk, &cmd.data.hk_vi, sizeof(eps_hk_vi_t));
+    }
+    return retval;
+}
+
+int eps_get_hk_wdt(eps_hk_wdt_t *hk)
+{
+    return eps_dev_get_hk_wdt(EPS_DEV_DEFAULT, hk);
+}
 
-int eps_ping()
+int eps_dev_get_hk_wdt(int dev, eps_hk_wdt_t *hk)
 {
-    if (eps == NULL)
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HK_WDT};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
     {
-        return -1;
+        memcpy(hk, &cmd.data.hk_wdt, sizeof(eps_hk_wdt_t));
     }
+    return retval;
+}
 
-    return eps_p31u_ping(eps);
+int eps_get_hk_2_basic(eps_hk_basic_t *hk)
+{
+    return eps_dev_get_hk_2_basic(EPS_DEV_DEFAULT, hk);
 }
 
-int eps_reboot()
+int eps_dev_get_hk_2_basic(int dev, eps_hk_basic_t *hk)
 {
-    if (eps == NULL)
+    eps_cmd_t cmd = {.id = EPS_CMD_GET_HK_2_BASIC};
+    int retval = eps_dev_cmd_submit(dev, &cmd, EPS_PRIO_ROUTINE, EPS_CMD_TIMEOUT * 1000);
+    if (retval >= 0)
     {
-        return -1;
+        memcpy(hk, &cmd.data.hk_basic, sizeof(eps_hk_basic_t));
     }
+    return retval;
+}
+
+/**
+ * @brief Sets a device's task periods for its burst state and policy. Call with the bus's wait_m held.
+ *
+ * A task whose period shrinks, or that is enabled, runs at the latest one new
+ * period from now; a disabled task, or any task of an offline device, never runs.
+ *
+ * @param dev The device.
+ * @param now Current CLOCK_MONOTONIC time.
+ */
+static void eps_sched_apply(eps_dev_t *dev, uint64_t now)
+{
+    const eps_sample_policy_t *p = &dev->policy;
+    uint64_t period_ms[EPS_TASK_NUM] = {
+        [EPS_TASK_HK] = dev->bursting ? p->hk_period_ms : p->slow_period_ms,
+        [EPS_TASK_BASIC] = p->basic_period_ms,
+        [EPS_TASK_VI] = dev->bursting ? p->burst_period_ms : p->vi_period_ms,
+        [EPS_TASK_CONF] = p->conf_period_ms,
+        [EPS_TASK_LOG] = EPS_LOG_PERIOD_MS,
+    };
+
+    for (int i = 0; i < EPS_TASK_NUM; i++)
+    {
+        eps_task_t *task = &dev->tasks[i];
+        task->period_ns = dev->online ? period_ms[i] * 1000000ULL : 0;
 
-    return eps_p31u_reboot(eps);
+        if (task->period_ns == 0)
+        {
+            task->next_ns = UINT64_MAX;
+        }
+        else if (task->next_ns > now + task->period_ns)
+        {
+            task->next_ns = now;
+        }
+    }
 }
 
-int eps_get_hkparam(hkparam_t *hk)
+/**
+ * @brief Starts or extends a device's burst. Call with the bus's wait_m held.
+ *
+ * @param dev The device.
+ * @param now Current CLOCK_MONOTONIC time.
+ */
+static void eps_burst_trigger(eps_dev_t *dev, uint64_t now)
 {
-    if (eps == NULL)
+    dev->burst_until_ns = now + dev->policy.burst_duration_ms * 1000000ULL;
+
+    if (!dev->bursting)
     {
-        return -1;
+        dev->bursting = 1;
+        eps_sched_apply(dev, now);
+        dev->tasks[EPS_TASK_VI].next_ns = now;
     }
+}
 
-    return eps_p31u_get_hkparam(eps, hk);
+static int eps_delta_exceeds(uint16_t a, uint16_t b, uint16_t threshold)
+{
+    return threshold > 0 && (a > b ? a - b : b - a) >= threshold;
 }
 
-int eps_get_hk(eps_hk_t *hk)
+/**
+ * @brief Whether the change between two samples should start or extend a burst. Call with the bus's wait_m held.
+ *
+ * @param p The device's sampling policy.
+ * @param prev The previous sample.
+ * @param cur The new sample.
+ * @param full Whether the samples are complete; otherwise only the eps_hk_vi_t fields are compared.
+ * @return int 1 if a threshold was exceeded, 0 otherwise.
+ */
+static int eps_hk_triggers(const eps_sample_policy_t *p, const eps_hk_t *prev, const eps_hk_t *cur, int full)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_get_hk(eps, hk);
+    if (eps_delta_exceeds(prev->vbatt, cur->vbatt, p->vbatt_delta_mv) ||
+        eps_delta_exceeds(prev->cursun, cur->cursun, p->current_delta_ma) ||
+        eps_delta_exceeds(prev->cursys, cur->cursys, p->current_delta_ma))
+    {
+        return 1;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (eps_delta_exceeds(prev->curin[i], cur->curin[i], p->current_delta_ma))
+        {
+            return 1;
+        }
+    }
+
+    if (!full)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (eps_delta_exceeds(prev->curout[i], cur->curout[i], p->current_delta_ma) ||
+            (p->trigger_latchup && prev->latchup[i] != cur->latchup[i]))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
-int eps_get_hk_out(eps_hk_out_t *hk_out)
+int eps_set_sample_policy(const eps_sample_policy_t *policy)
+{
+    return eps_dev_set_sample_policy(EPS_DEV_DEFAULT, policy);
+}
+
+int eps_dev_set_sample_policy(int dev_id, const eps_sample_policy_t *policy)
 {
-    if (eps == NULL)
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || policy == NULL || policy->slow_period_ms == 0 || policy->hk_period_ms == 0 ||
+        policy->burst_period_ms == 0 || policy->burst_period_ms > policy->hk_period_ms)
     {
         return -1;
     }
 
-    return eps_p31u_get_hk_out(eps, hk_out);
+    pthread_mutex_lock(dev->bus->wait_m);
+    dev->policy = *policy;
+    eps_sched_apply(dev, eps_now_ns());
+    pthread_cond_signal(dev->bus->wait);
+    pthread_mutex_unlock(dev->bus->wait_m);
+
+    return 1;
 }
 
-int eps_tgl_lup(eps_lup_idx lup)
+void eps_get_sample_policy(eps_sample_policy_t *policy, int *bursting)
+{
+    if (eps_dev_get_sample_policy(EPS_DEV_DEFAULT, policy, bursting) < 0)
+    {
+        // Before eps_init there is only the default policy.
+        *policy = eps_policy_default;
+        if (bursting != NULL)
+        {
+            *bursting = 0;
+        }
+    }
+}
+
+int eps_dev_get_sample_policy(int dev_id, eps_sample_policy_t *policy, int *bursting)
 {
-    if (eps == NULL)
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || policy == NULL)
     {
         return -1;
     }
 
-    return eps_p31u_tgl_lup(eps, lup);
+    pthread_mutex_lock(dev->bus->wait_m);
+    *policy = dev->policy;
+    if (bursting != NULL)
+    {
+        *bursting = dev->bursting;
+    }
+    pthread_mutex_unlock(dev->bus->wait_m);
+
+    return 1;
 }
 
-int eps_lup_set(eps_lup_idx lup, int pw)
+int eps_get_cmd_latency(eps_cmd_id cmd, lat_summary_t *summary)
 {
-    if (eps == NULL)
+    return eps_dev_get_cmd_latency(EPS_DEV_DEFAULT, cmd, summary);
+}
+
+int eps_dev_get_cmd_latency(int dev_id, eps_cmd_id cmd, lat_summary_t *summary)
+{
+#ifndef NO_LATENCY_STATS
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || cmd < 0 || cmd >= EPS_CMD_NUM || summary == NULL)
     {
         return -1;
     }
 
-    return eps_p31u_lup_set(eps, lup, (int)pw);
+    return lat_summarize(&dev->cmd_lat[cmd], summary);
+#else
+    return -1;
+#endif
 }
 
-int eps_battheater_set(uint64_t tout_ms)
+int eps_get_task_latency(eps_task_id task, lat_summary_t *summary)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_battheater_set(eps, tout_ms);
+    return eps_dev_get_task_latency(EPS_DEV_DEFAULT, task, summary);
 }
 
-int eps_ks_set(uint64_t tout_ms)
+int eps_dev_get_task_latency(int dev_id, eps_task_id task, lat_summary_t *summary)
 {
-    if (eps == NULL)
+#ifndef NO_LATENCY_STATS
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || task < 0 || task >= EPS_TASK_NUM || summary == NULL)
+    {
         return -1;
-    return eps_p31u_ks_set(eps, tout_ms);
+    }
+
+    return lat_summarize(&dev->task_lat[task], summary);
+#else
+    return -1;
+#endif
 }
 
-int eps_hardreset()
+int eps_get_wake_latency(lat_summary_t *summary)
 {
-    if (eps == NULL)
+    return eps_dev_get_wake_latency(EPS_DEV_DEFAULT, summary);
+}
+
+int eps_dev_get_wake_latency(int dev_id, lat_summary_t *summary)
+{
+#ifndef NO_LATENCY_STATS
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || summary == NULL)
     {
         return -1;
     }
 
-    return eps_p31u_hardreset(eps);
+    return lat_summarize(&dev->bus->wake_lat, summary);
+#else
+    return -1;
+#endif
 }
 
-// Initializes the EPS and ping-tests it.
-int eps_init()
+int eps_get_wdt_stats(eps_wdt_stats_t *stats)
+{
+    return eps_dev_get_wdt_stats(EPS_DEV_DEFAULT, stats);
+}
+
+int eps_dev_get_wdt_stats(int dev_id, eps_wdt_stats_t *stats)
 {
-    // Check if malloc was successful.
-    if (eps == NULL)
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || stats == NULL)
     {
         return -1;
     }
 
-    // Initializes the EPS component while checking if successful.
-    if (eps_p31u_init(eps, 1, 0x1b) <= 0)
+    pthread_mutex_lock(eps_wdt_m);
+    memcpy(stats, &dev->wdt_stats, sizeof(eps_wdt_stats_t));
+    pthread_mutex_unlock(eps_wdt_m);
+
+    return 1;
+}
+
+int eps_get_xport_stats(eps_xport_op_id op, eps_xport_stats_t *stats)
+{
+    return eps_dev_get_xport_stats(EPS_DEV_DEFAULT, op, stats);
+}
+
+int eps_dev_get_xport_stats(int dev_id, eps_xport_op_id op, eps_xport_stats_t *stats)
+{
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || op < 0 || op >= EPS_XPORT_OP_NUM || stats == NULL)
     {
         return -1;
     }
 
-    // If we can't successfully ping the EPS then something has gone wrong.
-    if (eps_p31u_ping(eps) < 0)
+    // A board without I2C_RDWR transfers, or that failed before they were set up, sent nothing through them.
+    if (!dev->xport_ok)
     {
-        return -2;
+        memset(stats, 0x0, sizeof(eps_xport_stats_t));
+        return 1;
     }
 
-    return 1;
+    return eps_xport_get_stats(dev->xport, op, stats);
 }
 
-int eps_get_conf(eps_config_t *conf)
+int eps_get_wdt_latency(lat_summary_t *summary)
 {
-    return eps_p31u_get_conf(eps, conf);
+    return eps_dev_get_wdt_latency(EPS_DEV_DEFAULT, summary);
 }
 
-int eps_set_conf(eps_config_t *conf)
+int eps_dev_get_wdt_latency(int dev_id, lat_summary_t *summary)
 {
-    return eps_p31u_set_conf(eps, conf);
+#ifndef NO_LATENCY_STATS
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || summary == NULL)
+    {
+        return -1;
+    }
+
+    return lat_summarize(&dev->wdt_lat, summary);
+#else
+    return -1;
+#endif
 }
 
-int eps_get_conf2(eps_config2_t *conf)
+int eps_get_sched_stats(eps_task_id task, eps_sched_task_stats_t *stats)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_get_conf2(eps, conf);
+    return eps_dev_get_sched_stats(EPS_DEV_DEFAULT, task, stats);
 }
 
-int eps_set_conf2(eps_config2_t *conf)
+int eps_dev_get_sched_stats(int dev_id, eps_task_id task, eps_sched_task_stats_t *stats)
 {
-    if (eps == NULL)
+    eps_dev_t *dev = eps_dev_find(dev_id);
+
+    if (dev == NULL || task < 0 || task >= EPS_TASK_NUM || stats == NULL)
+    {
         return -1;
-    return eps_p31u_set_conf2(eps, conf);
+    }
+
+    pthread_mutex_lock(dev->bus->wait_m);
+    memcpy(stats, &dev->tasks[task].stats, sizeof(eps_sched_task_stats_t));
+    if (stats->runs > 0)
+    {
+        stats->jitter_avg_ns = dev->tasks[task].jitter_sum_ns / stats->runs;
+    }
+    pthread_mutex_unlock(dev->bus->wait_m);
+
+    return 1;
 }
 
-int eps_reset_counters()
+/**
+ * @brief Accounts for a task about to run and schedules its next deadline. Call with the bus's wait_m held.
+ *
+ * @param task The task.
+ * @param now Current CLOCK_MONOTONIC time.
+ */
+static void eps_task_start(eps_task_t *task, uint64_t now)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_reset_counters(eps);
+    uint64_t late = now - task->next_ns;
+
+    task->stats.runs++;
+    task->jitter_sum_ns += late;
+    if (late > task->stats.jitter_max_ns)
+    {
+        task->stats.jitter_max_ns = late;
+    }
+
+    // Deadlines stay on the original grid; every deadline missed entirely is an overrun.
+    uint64_t missed = late / task->period_ns;
+    task->stats.overruns += missed;
+    task->next_ns += (missed + 1) * task->period_ns;
 }
 
-int eps_set_heater(unsigned char *reply, uint8_t cmd, uint8_t heater, uint8_t mode)
+/**
+ * @brief Sends one periodic command to a device, through its transport if the bus can do it. Call with the bus_m held.
+ *
+ * @param dev The device.
+ * @param id EPS_XPORT_OP_RESET_WDT to kick the ground watchdog, EPS_XPORT_OP_GET_HK to read all housekeeping.
+ * @param hk Output for EPS_XPORT_OP_GET_HK, unused otherwise.
+ * @return int 1 on success, negative on failure.
+ */
+static int eps_bus_op(eps_dev_t *dev, eps_xport_op_id id, eps_hk_t *hk)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_set_heater(eps, reply, cmd, heater, mode);
+    if (dev->xport_ok)
+    {
+        return eps_xport_run(dev->xport, id, hk);
+    }
+
+    if (id == EPS_XPORT_OP_RESET_WDT)
+    {
+        return eps_reset_wdt(dev->p31u);
+    }
+    return eps_p31u_get_hk(dev->p31u, hk);
 }
 
-int eps_set_pv_auto(uint8_t mode)
+/**
+ * @brief Runs one periodic task of a device. Called by its bus worker only, without the wait_m held.
+ *
+ * @param dev The device.
+ * @param task The task.
+ * @param sampled Set to 1 for a full sample, 2 for voltages and currents only, 0 for none.
+ * @return int EPS_STATS_* bits of the sample.
+ */
+static int eps_task_run(eps_dev_t *dev, eps_task_id task, int *sampled)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_set_pv_auto(eps, mode);
+    eps_bus_t *bus = dev->bus;
+    eps_hk_t *hk = &dev->hk;
+    eps_hk_t sample;
+    int failed = 0; // A bus transaction of the task failed.
+    int stats = 0;
+
+    *sampled = 0;
+
+    LAT_START(task_start);
+
+    switch (task)
+    {
+    case EPS_TASK_HK:
+    {
+        // Read all of the housekeeping. One command returns all of it; the hkparam_t
+        // and eps_hk_out_t views are derived from it (see: eps_hk_to_hkparam).
+        memset(&sample, 0x0, sizeof(eps_hk_t));
+        pthread_mutex_lock(bus->bus_m);
+        failed = eps_bus_op(dev, EPS_XPORT_OP_GET_HK, &sample) < 0;
+        pthread_mutex_unlock(bus->bus_m);
+        if (!failed)
+        {
+            *sampled = 1;
+        }
+        break;
+    }
+
+    case EPS_TASK_BASIC:
+    {
+        // Slow-moving counters; the snapshot gets them between full reads.
+        eps_hk_basic_t basic;
+        eps_hk_wdt_t wdt;
+        int published = 0;
+
+        // The bus is released between transactions, so a kick never waits for more than one.
+        pthread_mutex_lock(bus->bus_m);
+        int basic_ok = eps_p31u_get_hk_2_basic(dev->p31u, &basic) >= 0;
+        pthread_mutex_unlock(bus->bus_m);
+        pthread_mutex_lock(bus->bus_m);
+        int wdt_ok = eps_p31u_get_hk_wdt(dev->p31u, &wdt) >= 0;
+        pthread_mutex_unlock(bus->bus_m);
+
+        if (basic_ok)
+        {
+            eps_stream_log(dev, EPS_STREAM_BASIC, &basic);
+            // The EPS rebooted on its own, e.g. from a watchdog.
+            if (dev->have_hk && basic.counter_boot != hk->counter_boot)
+            {
+                eps_conf_invalidate(dev);
+            }
+            hk->counter_boot = basic.counter_boot;
+            memcpy(hk->temp, basic.temp, sizeof(hk->temp));
+            hk->bootcause = basic.bootcause;
+            hk->battmode = basic.battmode;
+            hk->pptmode = basic.pptmode;
+            published = dev->have_hk;
+        }
+        else
+        {
+            failed = 1;
+        }
+
+        if (wdt_ok)
+        {
+            eps_stream_log(dev, EPS_STREAM_WDT, &wdt);
+            pthread_mutex_lock(eps_wdt_m);
+            if (wdt.wdt_gnd_time_left < dev->wdt_stats.gnd_time_left_min)
+            {
+                dev->wdt_stats.gnd_time_left_min = wdt.wdt_gnd_time_left;
+            }
+            pthread_mutex_unlock(eps_wdt_m);
+            hk->wdt_i2c_time_left = wdt.wdt_i2c_time_left;
+            hk->wdt_gnd_time_left = wdt.wdt_gnd_time_left;
+            memcpy(hk->wdt_csp_pings_left, wdt.wdt_csp_pings_left, sizeof(hk->wdt_csp_pings_left));
+            hk->counter_wdt_i2c = wdt.counter_wdt_i2c;
+            hk->counter_wdt_gnd = wdt.counter_wdt_gnd;
+            memcpy(hk->counter_wdt_csp, wdt.counter_wdt_csp, sizeof(hk->counter_wdt_csp));
+            published = dev->have_hk;
+        }
+        else
+        {
+            failed = 1;
+        }
+
+        if (published)
+        {
+            eps_publish_hk(dev, hk);
+        }
+        break;
+    }
+
+    case EPS_TASK_VI:
+    {
+        eps_hk_vi_t vi;
+        pthread_mutex_lock(bus->bus_m);
+        int vi_ok = eps_p31u_get_hk_2_vi(dev->p31u, &vi) >= 0;
+        pthread_mutex_unlock(bus->bus_m);
+        if (vi_ok)
+        {
+            eps_stream_log(dev, EPS_STREAM_VI, &vi);
+        }
+        else
+        {
+            failed = 1;
+            break;
+        }
+
+        // Until the first full read there is nothing to merge into or compare against.
+        if (dev->have_hk)
+        {
+            sample = *hk;
+            memcpy(sample.vboost, vi.vboost, sizeof(sample.vboost));
+            sample.vbatt = vi.vbatt;
+            memcpy(sample.curin, vi.curin, sizeof(sample.curin));
+            sample.cursun = vi.cursun;
+            sample.cursys = vi.cursys;
+            *sampled = 2;
+        }
+        break;
+    }
+
+    case EPS_TASK_CONF:
+    {
+        eps_config_t conf;
+        pthread_mutex_lock(bus->bus_m);
+        int conf_ok = eps_p31u_get_conf(dev->p31u, &conf) >= 0;
+        pthread_mutex_unlock(bus->bus_m);
+        if (conf_ok)
+        {
+            eps_stream_log(dev, EPS_STREAM_CONF, &conf);
+            eps_conf_store(dev, &dev->conf_cache, &dev->conf_valid, &conf, sizeof(eps_config_t));
+        }
+        else
+        {
+            failed = 1;
+        }
+        break;
+    }
+
+    case EPS_TASK_LOG:
+        // Log the newest sample once; a failed poll is not logged as stale data.
+        if (dev->hk_fresh)
+        {
+            eps_stream_log(dev, EPS_STREAM_HK, hk);
+        }
+        dev->hk_fresh = 0;
+        break;
+
+    default:
+        break;
+    }
+
+    LAT_RECORD(&dev->task_lat[task], task_start, failed);
+
+    // Publish housekeeping data, but only what was actually read.
+    if (*sampled)
+    {
+        dev->hk_prev = *hk;
+        *hk = sample;
+        eps_publish_hk(dev, hk);
+        dev->hk_fresh = 1;
+
+        eps_stats_summary_t summary;
+        stats = eps_stats_update(dev->id, hk, *sampled == 1, eps_now_ns(), &summary);
+        if (stats & EPS_STATS_CLOSED)
+        {
+            eps_stream_log(dev, EPS_STREAM_STATS, &summary);
+        }
+    }
+
+    return stats;
 }
 
-int eps_set_pv_volt(uint16_t V1, uint16_t V2, uint16_t V3)
+/**
+ * @brief Polls and commands the devices of one bus until the program exits.
+ *
+ * @param bus The bus.
+ */
+static void eps_bus_worker(eps_bus_t *bus)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_set_pv_volt(eps, V1, V2, V3);
+    // Each task of each device runs on its own fixed grid of absolute
+    // deadlines, and queued commands execute in between. The bus is shared
+    // only with eps_wdt_thread, which takes it between two of our transactions.
+    uint64_t start = eps_now_ns();
+
+    pthread_mutex_lock(bus->wait_m);
+
+    for (int d = 0; d < bus->num_devs; d++)
+    {
+        for (int i = 0; i < EPS_TASK_NUM; i++)
+        {
+            bus->devs[d]->tasks[i].next_ns = start;
+        }
+        eps_sched_apply(bus->devs[d], start);
+    }
+
+    while (!done)
+    {
+        eps_dev_t *dev = NULL;
+        eps_cmd_slot_t *slot = eps_cmd_next(bus, &dev);
+
+        if (slot != NULL)
+        {
+            slot->state = EPS_SLOT_RUNNING;
+            pthread_mutex_unlock(bus->wait_m);
+
+            pthread_mutex_lock(bus->bus_m);
+            eps_cmd_exec(dev, &slot->cmd);
+            pthread_mutex_unlock(bus->bus_m);
+
+            pthread_mutex_lock(bus->wait_m);
+            // Switching a channel is the likeliest cause of a current transient.
+            if ((slot->cmd.id == EPS_CMD_TLUP || slot->cmd.id == EPS_CMD_SLUP) && dev->policy.trigger_lup_cmd)
+            {
+                eps_burst_trigger(dev, eps_now_ns());
+            }
+            eps_cmd_complete(bus, slot);
+            continue;
+        }
+
+        uint64_t now = eps_now_ns();
+
+        // The task with the earliest deadline; ties go to the lowest device, then the lowest eps_task_id.
+        int task = 0;
+        uint64_t wake_ns = UINT64_MAX;
+        dev = bus->devs[0];
+
+        for (int d = 0; d < bus->num_devs; d++)
+        {
+            eps_dev_t *cand = bus->devs[d];
+
+            // Back off once a burst has gone without triggers long enough.
+            if (cand->bursting && now >= cand->burst_until_ns)
+            {
+                cand->bursting = 0;
+                eps_sched_apply(cand, now);
+            }
+            if (cand->bursting && cand->burst_until_ns < wake_ns)
+            {
+                wake_ns = cand->burst_until_ns;
+            }
+
+            for (int i = 0; i < EPS_TASK_NUM; i++)
+            {
+                if (cand->tasks[i].next_ns < dev->tasks[task].next_ns)
+                {
+                    dev = cand;
+                    task = i;
+                }
+            }
+        }
+
+        if (dev->tasks[task].next_ns < wake_ns)
+        {
+            wake_ns = dev->tasks[task].next_ns;
+        }
+
+        if (now < wake_ns)
+        {
+            // Sleep until that deadline, or until a command is queued or we are shutting down.
+            // With nothing scheduled, e.g. every device offline, check for exit every EPS_LOOP_TIMER.
+            int idle = wake_ns == UINT64_MAX;
+            if (idle)
+            {
+                wake_ns = now + EPS_LOOP_TIMER * 1000000000ULL;
+            }
+
+            struct timespec deadline;
+            eps_ns_to_timespec(wake_ns, &deadline);
+            if (pthread_cond_timedwait(bus->wait, bus->wait_m, &deadline) == ETIMEDOUT && !idle)
+            {
+                // Woken by the deadline, not a command: the delay is the scheduler's and the mutex's.
+                uint64_t woke_ns = eps_now_ns();
+                LAT_RECORD_NS(&bus->wake_lat, woke_ns > wake_ns ? woke_ns - wake_ns : 0, 0);
+            }
+            continue;
+        }
+
+        if (now < dev->tasks[task].next_ns)
+        {
+            continue;
+        }
+
+        eps_task_start(&dev->tasks[task], now);
+
+        // Commands queued meanwhile wait for at most this one task.
+        pthread_mutex_unlock(bus->wait_m);
+
+        int sampled;
+        int stats = eps_task_run(dev, task, &sampled);
+
+        pthread_mutex_lock(bus->wait_m);
+
+        if ((sampled && dev->have_hk && eps_hk_triggers(&dev->policy, &dev->hk_prev, &dev->hk, sampled == 1)) ||
+            ((stats & EPS_STATS_RAISED) && dev->policy.trigger_alarm))
+        {
+            eps_burst_trigger(dev, eps_now_ns());
+        }
+        if (sampled == 1)
+        {
+            if (dev->have_hk && dev->hk.counter_boot != dev->hk_prev.counter_boot)
+            {
+                eps_conf_invalidate(dev);
+            }
+            dev->have_hk = 1;
+        }
+    }
+
+    // Nothing executes commands anymore; release everyone still waiting.
+    bus->stopped = 1;
+    for (int d = 0; d < bus->num_devs; d++)
+    {
+        for (int i = 0; i < EPS_CMD_SLOTS; i++)
+        {
+            eps_cmd_slot_t *slot = &bus->devs[d]->cmd_slots[i];
+            if (slot->state == EPS_SLOT_QUEUED)
+            {
+                slot->cmd.retval = EPS_CMD_ERR_STOPPED;
+                eps_cmd_complete(bus, slot);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(bus->wait_m);
 }
 
-int eps_get_hk_2_vi(eps_hk_vi_t *hk)
+static void *eps_bus_thread(void *arg)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_get_hk_2_vi(eps, hk);
+    eps_bus_worker((eps_bus_t *)arg);
+    pthread_exit(NULL);
 }
 
-int eps_get_hk_wdt(eps_hk_wdt_t *hk)
+void *eps_thread(void *tid)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_get_hk_wdt(eps, hk);
+    // Every other bus gets a worker of its own, so independent buses poll in
+    // parallel. The workers get a prefaulted stack like this thread's and
+    // run with its policy, priority and CPUs, see: main_start_worker.
+    pthread_t workers[EPS_DEV_NUM];
+    int started[EPS_DEV_NUM] = {0};
+
+    for (int b = 1; b < eps_num_buses; b++)
+    {
+        started[b] = main_start_worker(&workers[b], eps_bus_thread, &eps_buses[b]) == 0;
+        if (!started[b])
+        {
+            eprintf("Could not start the worker of I2C bus %d; its EPS boards are not polled.", eps_buses[b].id);
+        }
+    }
+
+    if (eps_num_buses > 0)
+    {
+        eps_bus_worker(&eps_buses[0]);
+    }
+
+    // main() only wakes the default device's bus.
+    for (int b = 1; b < eps_num_buses; b++)
+    {
+        if (started[b])
+        {
+            pthread_mutex_lock(eps_buses[b].wait_m);
+            pthread_cond_broadcast(eps_buses[b].wait);
+            pthread_mutex_unlock(eps_buses[b].wait_m);
+            pthread_join(workers[b], NULL);
+        }
+    }
+
+    pthread_exit(NULL);
 }
 
-int eps_get_hk_2_basic(eps_hk_basic_t *hk)
+/**
+ * @brief Kicks one device's ground watchdog and accounts for it. Called by eps_wdt_thread only, without eps_wdt_m held.
+ *
+ * @param dev The device.
+ * @param deadline CLOCK_MONOTONIC time the kick was due.
+ * @param miss_ns Interval after which a kick counts as missed.
+ */
+static void eps_wdt_kick(eps_dev_t *dev, uint64_t deadline, uint64_t miss_ns)
 {
-    if (eps == NULL)
-        return -1;
-    return eps_p31u_get_hk_2_basic(eps, hk);
+    uint64_t late = eps_now_ns() - deadline;
+
+    LAT_START(kick_start);
+    pthread_mutex_lock(dev->bus->bus_m);
+    int failed = eps_bus_op(dev, EPS_XPORT_OP_RESET_WDT, NULL) < 0;
+    pthread_mutex_unlock(dev->bus->bus_m);
+    LAT_RECORD(&dev->wdt_lat, kick_start, failed);
+
+    uint64_t kicked = eps_now_ns();
+    int alert = 0;
+
+    pthread_mutex_lock(eps_wdt_m);
+
+    uint64_t since = kicked - dev->wdt_last_kick_ns;
+
+    if (late > dev->wdt_stats.late_max_ns)
+    {
+        dev->wdt_stats.late_max_ns = late;
+    }
+    if (failed)
+    {
+        dev->wdt_stats.failures++;
+    }
+    else
+    {
+        dev->wdt_stats.kicks++;
+    }
+
+    // The interval so far counts even while kicks keep failing.
+    if (since > dev->wdt_stats.interval_max_ns)
+    {
+        dev->wdt_stats.interval_max_ns = since;
+    }
+    if (since > miss_ns && !dev->wdt_overdue)
+    {
+        dev->wdt_stats.misses++;
+        dev->wdt_overdue = 1;
+        alert = 1;
+    }
+    if (!failed)
+    {
+        dev->wdt_last_kick_ns = kicked;
+        dev->wdt_overdue = 0;
+    }
+
+    pthread_mutex_unlock(eps_wdt_m);
+
+    if (alert)
+    {
+        eprintf("Watchdog kick of EPS %d overdue: %llu ms since the last one, the ground watchdog times out after %d s.", dev->id, (unsigned long long)(since / 1000000ULL), EPS_GND_WDT_TIMEOUT_S);
+    }
 }
 
-void *eps_thread(void *tid)
+void *eps_wdt_thread(void *tid)
 {
+    // Kicks every board on one fixed grid of absolute deadlines. Everything
+    // but the kicks themselves happens under eps_wdt_m, never under a bus_m.
+    uint64_t period_ns = EPS_WDT_PERIOD_MS * 1000000ULL;
+    uint64_t miss_ns = EPS_WDT_MISS_MS * 1000000ULL;
+    uint64_t next_ns = eps_now_ns();
+
+    pthread_mutex_lock(eps_wdt_m);
+
+    for (int i = 0; i < EPS_DEV_NUM; i++)
+    {
+        eps_devs[i].wdt_last_kick_ns = next_ns;
+    }
+
     while (!done)
     {
-        // Reset the watch-dog timer.
-        eps_reset_wdt(eps);
-        // add other things here
+        uint64_t now = eps_now_ns();
 
-        hkparam_t hk;
-        eps_hk_out_t hk_out;
-        //eps_config_t conf[1]; <-- NOTE: Unused variable warning.
+        if (now < next_ns)
+        {
+            struct timespec deadline;
+            eps_ns_to_timespec(next_ns, &deadline);
+            pthread_cond_timedwait(eps_wdt_wait, eps_wdt_m, &deadline);
+            continue;
+        }
 
-        memset(&hk, 0x0, sizeof(hkparam_t));
-        eps_get_hkparam(&hk);
-        memset(&hk_out, 0x0, sizeof(eps_hk_out_t));
-        eps_get_hk_out(&hk_out);
+        // Deadlines missed entirely are not made up; the next kick is on the grid.
+        uint64_t deadline = next_ns;
+        next_ns += ((now - next_ns) / period_ns + 1) * period_ns;
 
-        // Log housekeeping data.
-        dlgr_LogData(MODULE_NAME, sizeof(eps_hk_t), &hk_out);
+        pthread_mutex_unlock(eps_wdt_m);
 
-        sleep(EPS_LOOP_TIMER);
+        for (int i = 0; i < EPS_DEV_NUM; i++)
+        {
+            if (eps_devs[i].online)
+            {
+                eps_wdt_kick(&eps_devs[i], deadline, miss_ns);
+            }
+        }
+
+        pthread_mutex_lock(eps_wdt_m);
     }
 
+    pthread_mutex_unlock(eps_wdt_m);
+
     pthread_exit(NULL);
 }
 
-// Frees eps memory and destroys the EPS object.
+// Frees eps memory and destroys the EPS objects.
 void eps_destroy()
 {
-    // Destroy / free the eps.
-    eps_p31u_destroy(eps);
+    for (int i = 0; i < EPS_DEV_NUM; i++)
+    {
+        // Destroy every board eps_init got to.
+        if (eps_devs[i].bus != NULL)
+        {
+            eps_p31u_destroy(eps_devs[i].p31u);
+        }
+    }
 }
@@ -0,0 +1,162 @@
+/**
+ * @file eps_decode.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Bulk decoding of logged housekeeping into per-channel columns.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "eps_decode.h"
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(EPS_DECODE_SCALAR) && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define EPS_DECODE_VECTOR
+#endif
+#endif
+
+/**
+ * @brief A run of equally converted 16-bit fields of eps_hk_t, in column order.
+ *
+ */
+typedef struct
+{
+    uint16_t offset; // Of the first field in eps_hk_t.
+    uint8_t count;   // Consecutive fields, one column each.
+    uint8_t is_signed;
+    float scale;     // Unit per count.
+} eps_decode_run_t;
+
+static const eps_decode_run_t eps_decode_hk_layout[] = {
+    {offsetof(eps_hk_t, vboost), 3, 0, 1e-3f}, // mV
+    {offsetof(eps_hk_t, vbatt), 1, 0, 1e-3f},  // mV
+    {offsetof(eps_hk_t, curin), 3, 0, 1e-3f},  // mA
+    {offsetof(eps_hk_t, cursun), 1, 0, 1e-3f}, // mA
+    {offsetof(eps_hk_t, cursys), 1, 0, 1e-3f}, // mA
+    {offsetof(eps_hk_t, curout), 6, 0, 1e-3f}, // mA
+    {offsetof(eps_hk_t, temp), 6, 1, 1.0f},    // degrees Celsius
+};
+
+#define EPS_DECODE_RUNS (int)(sizeof(eps_decode_hk_layout) / sizeof(eps_decode_hk_layout[0]))
+
+#ifdef EPS_DECODE_VECTOR
+
+typedef uint16_t eps_u16x8 __attribute__((vector_size(16)));
+typedef int16_t eps_i16x8 __attribute__((vector_size(16)));
+typedef float eps_f32x8 __attribute__((vector_size(32)));
+
+_Static_assert(EPS_DECODE_BLOCK == 8, "the kernels convert eight records at a time");
+
+/**
+ * @brief Converts len (at most EPS_DECODE_BLOCK) raw values of one column; raw holds EPS_DECODE_BLOCK.
+ *
+ */
+static void eps_decode_convert(const uint16_t *raw, const eps_decode_run_t *run, int swap, float *out, int len)
+{
+    eps_u16x8 v;
+    eps_f32x8 f;
+
+    memcpy(&v, raw, sizeof(v));
+    if (swap)
+    {
+        v = (v << 8) | (v >> 8);
+    }
+
+    if (run->is_signed)
+    {
+        f = __builtin_convertvector((eps_i16x8)v, eps_f32x8);
+    }
+    else
+    {
+        f = __builtin_convertvector(v, eps_f32x8);
+    }
+    f *= run->scale;
+
+    memcpy(out, &f, sizeof(float) * len);
+}
+
+#else // EPS_DECODE_VECTOR
+
+static void eps_decode_convert(const uint16_t *raw, const eps_decode_run_t *run, int swap, float *out, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        uint16_t v = swap ? (uint16_t)((raw[i] << 8) | (raw[i] >> 8)) : raw[i];
+        out[i] = (run->is_signed ? (float)(int16_t)v : (float)v) * run->scale;
+    }
+}
+
+#endif // EPS_DECODE_VECTOR
+
+size_t eps_hk_columns_size(int numRecords)
+{
+    return (sizeof(uint64_t) + sizeof(float) * EPS_HK_COL_NUM) * (size_t)numRecords;
+}
+
+void eps_hk_columns_bind(eps_hk_columns_t *cols, void *buf, int numRecords)
+{
+    cols->time = (uint64_t *)buf;
+    float *col = (float *)(cols->time + numRecords);
+    for (int c = 0; c < EPS_HK_COL_NUM; c++, col += numRecords)
+    {
+        cols->col[c] = col;
+    }
+}
+
+int eps_decode_hk(const void *records, int numRecords, int flags, eps_hk_columns_t *cols)
+{
+    if (records == NULL || cols == NULL || numRecords < 0)
+    {
+        return -1;
+    }
+
+    int packed = flags & EPS_DECODE_PACKED;
+    int swap = (flags & EPS_DECODE_SWAP) != 0;
+    size_t stride = packed ? DLGR_PACKED_STRIDE(sizeof(eps_hk_t)) : DLGR_RECORD_STRIDE(sizeof(eps_hk_t));
+    size_t time_offset = (packed ? 0 : FBEGIN_SIZE) + offsetof(dlgr_timestamp_t, realtime);
+    size_t data_offset = packed ? sizeof(dlgr_timestamp_t) : DLGR_RECORD_DATA_OFFSET;
+
+    // Staging for one block, column by column, so that each column converts as one vector.
+    uint16_t raw[EPS_HK_COL_NUM][EPS_DECODE_BLOCK];
+    memset(raw, 0x0, sizeof(raw));
+
+    for (int base = 0; base < numRecords; base += EPS_DECODE_BLOCK)
+    {
+        int len = numRecords - base < EPS_DECODE_BLOCK ? numRecords - base : EPS_DECODE_BLOCK;
+
+        // Records are packed and unaligned; fields are gathered one by one.
+        for (int r = 0; r < len; r++)
+        {
+            const char *record = (const char *)records + (size_t)(base + r) * stride;
+            const char *data = record + data_offset;
+
+            uint64_t time;
+            memcpy(&time, record + time_offset, sizeof(time));
+            cols->time[base + r] = swap ? __builtin_bswap64(time) : time;
+
+            int c = 0;
+            for (int i = 0; i < EPS_DECODE_RUNS; i++)
+            {
+                for (int j = 0; j < eps_decode_hk_layout[i].count; j++, c++)
+                {
+                    memcpy(&raw[c][r], data + eps_decode_hk_layout[i].offset + j * sizeof(uint16_t), sizeof(uint16_t));
+                }
+            }
+        }
+
+        int c = 0;
+        for (int i = 0; i < EPS_DECODE_RUNS; i++)
+        {
+            for (int j = 0; j < eps_decode_hk_layout[i].count; j++, c++)
+            {
+                eps_decode_convert(raw[c], &eps_decode_hk_layout[i], swap, cols->col[c] + base, len);
+            }
+        }
+    }
+
+    return numRecords;
+}
@@ -0,0 +1,343 @@
+/**
+ * @file eps_stats.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief Running statistics and alarms of the EPS thread's telemetry.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "eps_stats.h"
+#include "eps.h"
+#include <main.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief A run of 16-bit fields of eps_hk_t, one channel each, in channel order.
+ *
+ */
+typedef struct
+{
+    uint16_t offset;   // Of the first field in eps_hk_t.
+    uint8_t count;     // Consecutive fields.
+    uint8_t is_signed;
+    uint8_t full_only; // Only read by full housekeeping, see: eps_hk_vi_t.
+} eps_stats_run_t;
+
+static const eps_stats_run_t eps_stats_layout[] = {
+    {offsetof(eps_hk_t, curout), 6, 0, 1},
+    {offsetof(eps_hk_t, vbatt), 1, 0, 0},
+    {offsetof(eps_hk_t, cursun), 1, 0, 0},
+    {offsetof(eps_hk_t, cursys), 1, 0, 0},
+    {offsetof(eps_hk_t, temp), 6, 1, 1},
+};
+
+#define EPS_STATS_RUNS (int)(sizeof(eps_stats_layout) / sizeof(eps_stats_layout[0]))
+
+static const char *const eps_stats_names[EPS_STAT_NUM] = {
+    "curout[0]", "curout[1]", "curout[2]", "curout[3]", "curout[4]", "curout[5]",
+    "vbatt", "cursun", "cursys",
+    "temp[0]", "temp[1]", "temp[2]", "temp[3]", "temp[4]", "temp[5]",
+};
+
+/**
+ * @brief Running statistics of one window, see: eps_stats_add.
+ *
+ */
+typedef struct
+{
+    uint32_t count;
+    float min;
+    float max;
+    double mean;
+    double m2; // Sum of squared deviations from the mean.
+} eps_stats_acc_t;
+
+/**
+ * @brief State of one channel.
+ *
+ */
+typedef struct
+{
+    eps_stats_acc_t window;
+    eps_window_stats_t last;
+    double ewma;
+    float rate;
+    uint64_t last_ns;      // Time of the latest sample, 0 before the first.
+    uint8_t alarms;        // Of the latest sample.
+    uint8_t window_alarms; // Of every sample of the window.
+    uint32_t raised;
+} eps_stats_channel_t;
+
+/**
+ * @brief Policy, shared by all devices, and each device's state, protected by eps_stats_m.
+ *
+ */
+static pthread_mutex_t eps_stats_m[1] = {PTHREAD_MUTEX_INITIALIZER};
+static eps_stats_policy_t eps_stats_policy = {
+    .window_ms = EPS_STATS_WINDOW_MS,
+    .ewma_tau_ms = EPS_STATS_TAU_MS,
+    .alarm = {
+        [EPS_STAT_CUROUT ... EPS_STAT_CUROUT + 5] = {.rate = EPS_ALARM_CUROUT_RATE_MA_S, .enable = EPS_ALARM_RATE},
+        [EPS_STAT_VBATT] = {.low = EPS_ALARM_VBATT_LOW_MV, .rate = EPS_ALARM_VBATT_RATE_MV_S, .enable = EPS_ALARM_LOW | EPS_ALARM_RATE},
+        [EPS_STAT_TEMP ... EPS_STAT_TEMP + 5] = {.low = EPS_ALARM_TEMP_LOW_C, .high = EPS_ALARM_TEMP_HIGH_C, .enable = EPS_ALARM_LOW | EPS_ALARM_HIGH},
+    },
+};
+static eps_stats_channel_t eps_stats_channels[EPS_DEV_NUM][EPS_STAT_NUM];
+static uint64_t eps_stats_window_ns[EPS_DEV_NUM]; // Opening of the current window, 0 before the first sample.
+
+/**
+ * @brief Adds a sample to a window with Welford's algorithm, which stays exact over long windows.
+ *
+ */
+static void eps_stats_add(eps_stats_acc_t *acc, float x)
+{
+    if (acc->count == 0 || x < acc->min)
+    {
+        acc->min = x;
+    }
+    if (acc->count == 0 || x > acc->max)
+    {
+        acc->max = x;
+    }
+
+    acc->count++;
+    double delta = x - acc->mean;
+    acc->mean += delta / acc->count;
+    acc->m2 += delta * (x - acc->mean);
+}
+
+static void eps_stats_finish(const eps_stats_acc_t *acc, eps_window_stats_t *stats)
+{
+    memset(stats, 0x0, sizeof(eps_window_stats_t));
+    if (acc->count > 0)
+    {
+        stats->count = acc->count;
+        stats->min = acc->min;
+        stats->max = acc->max;
+        stats->mean = acc->mean;
+        stats->var = acc->count > 1 ? acc->m2 / (acc->count - 1) : 0;
+    }
+}
+
+static int16_t eps_stats_round(double x)
+{
+    return x < INT16_MIN ? INT16_MIN : x > INT16_MAX ? INT16_MAX : (int16_t)lround(x);
+}
+
+/**
+ * @brief Closes a device's current window and opens the one now falls into. Call with eps_stats_m held.
+ *
+ * @param dev The device.
+ * @param now CLOCK_MONOTONIC time of the sample that closes it.
+ * @param summary Output.
+ */
+static void eps_stats_close(int dev, uint64_t now, eps_stats_summary_t *summary)
+{
+    uint64_t window_ns = eps_stats_policy.window_ms * 1000000ULL;
+    uint64_t opened = eps_stats_window_ns[dev];
+
+    // Windows stay on the grid of the first; a gap in the samples is one long window.
+    eps_stats_window_ns[dev] += (now - opened) / window_ns * window_ns;
+    summary->duration_ms = (eps_stats_window_ns[dev] - opened) / 1000000ULL;
+
+    for (int c = 0; c < EPS_STAT_NUM; c++)
+    {
+        eps_stats_channel_t *ch = &eps_stats_channels[dev][c];
+        eps_stats_channel_summary_t *out = &summary->channel[c];
+
+        eps_stats_finish(&ch->window, &ch->last);
+        memset(out, 0x0, sizeof(eps_stats_channel_summary_t));
+        if (ch->last.count > 0)
+        {
+            out->count = ch->last.count < UINT16_MAX ? ch->last.count : UINT16_MAX;
+            out->min = eps_stats_round(ch->last.min);
+            out->max = eps_stats_round(ch->last.max);
+            out->mean = eps_stats_round(ch->last.mean);
+            double stddev = sqrt(ch->last.var);
+            out->stddev = stddev < UINT16_MAX ? (uint16_t)lround(stddev) : UINT16_MAX;
+            out->ewma = eps_stats_round(ch->ewma);
+            out->alarms = ch->window_alarms;
+        }
+
+        memset(&ch->window, 0x0, sizeof(eps_stats_acc_t));
+        ch->window_alarms = 0;
+    }
+}
+
+int eps_stats_update(int dev, const eps_hk_t *hk, int full, uint64_t now, eps_stats_summary_t *summary)
+{
+    int retval = 0;
+
+    // Reported once eps_stats_m is released.
+    uint8_t raised[EPS_STAT_NUM];
+    float value[EPS_STAT_NUM];
+    float ewma[EPS_STAT_NUM];
+    float rate[EPS_STAT_NUM];
+    memset(raised, 0x0, sizeof(raised));
+
+    pthread_mutex_lock(eps_stats_m);
+
+    const eps_stats_policy_t *p = &eps_stats_policy;
+
+    // The sample that closes a window is the first of the next one.
+    if (eps_stats_window_ns[dev] == 0)
+    {
+        eps_stats_window_ns[dev] = now;
+    }
+    else if (now - eps_stats_window_ns[dev] >= p->window_ms * 1000000ULL)
+    {
+        eps_stats_close(dev, now, summary);
+        retval |= EPS_STATS_CLOSED;
+    }
+
+    double tau_ns = p->ewma_tau_ms * 1e6;
+    int c = 0;
+    for (int i = 0; i < EPS_STATS_RUNS; i++)
+    {
+        const eps_stats_run_t *run = &eps_stats_layout[i];
+
+        for (int j = 0; j < run->count; j++, c++)
+        {
+            if (run->full_only && !full)
+            {
+                continue;
+            }
+
+            uint16_t raw;
+            memcpy(&raw, (const char *)hk + run->offset + j * sizeof(uint16_t), sizeof(uint16_t));
+            float x = run->is_signed ? (float)(int16_t)raw : (float)raw;
+
+            eps_stats_channel_t *ch = &eps_stats_channels[dev][c];
+            eps_stats_add(&ch->window, x);
+
+            // Weighted by the time since the last sample, so bursts do not shorten the average.
+            if (ch->last_ns == 0)
+            {
+                ch->ewma = x;
+                ch->rate = 0;
+            }
+            else if (now > ch->last_ns)
+            {
+                double dt = now - ch->last_ns;
+                double prev = ch->ewma;
+                ch->ewma += (x - ch->ewma) * -expm1(-dt / tau_ns);
+                ch->rate = (ch->ewma - prev) * 1e9 / dt;
+            }
+            ch->last_ns = now;
+
+            const eps_alarm_t *a = &p->alarm[c];
+            uint8_t alarms = 0;
+            if ((a->enable & EPS_ALARM_LOW) && x < a->low)
+            {
+                alarms |= EPS_ALARM_LOW;
+            }
+            if ((a->enable & EPS_ALARM_HIGH) && x > a->high)
+            {
+                alarms |= EPS_ALARM_HIGH;
+            }
+            if ((a->enable & EPS_ALARM_RATE) && fabsf(ch->rate) > a->rate)
+            {
+                alarms |= EPS_ALARM_RATE;
+            }
+
+            raised[c] = alarms & ~ch->alarms;
+            ch->alarms = alarms;
+            ch->window_alarms |= alarms;
+            if (raised[c])
+            {
+                ch->raised++;
+                retval |= EPS_STATS_RAISED;
+                value[c] = x;
+                ewma[c] = ch->ewma;
+                rate[c] = ch->rate;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(eps_stats_m);
+
+    for (c = 0; c < EPS_STAT_NUM && (retval & EPS_STATS_RAISED); c++)
+    {
+        if (raised[c])
+        {
+            eprintf("Telemetry alarm, EPS %d %s%s%s%s: %.0f, average %.1f changing by %.2f/s.", dev, eps_stats_names[c],
+                    (raised[c] & EPS_ALARM_LOW) ? " low" : "", (raised[c] & EPS_ALARM_HIGH) ? " high" : "",
+                    (raised[c] & EPS_ALARM_RATE) ? " rate" : "", value[c], ewma[c], rate[c]);
+        }
+    }
+
+    return retval;
+}
+
+int eps_set_stats_policy(const eps_stats_policy_t *policy)
+{
+    if (policy == NULL || policy->window_ms == 0 || policy->ewma_tau_ms == 0)
+    {
+        return -1;
+    }
+
+    for (int c = 0; c < EPS_STAT_NUM; c++)
+    {
+        const eps_alarm_t *a = &policy->alarm[c];
+        if ((a->enable & EPS_ALARM_LOW) && (a->enable & EPS_ALARM_HIGH) && !(a->low < a->high))
+        {
+            return -1;
+        }
+        if ((a->enable & EPS_ALARM_RATE) && !(a->rate > 0))
+        {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(eps_stats_m);
+    eps_stats_policy = *policy;
+    pthread_mutex_unlock(eps_stats_m);
+
+    return 1;
+}
+
+void eps_get_stats_policy(eps_stats_policy_t *policy)
+{
+    pthread_mutex_lock(eps_stats_m);
+    *policy = eps_stats_policy;
+    pthread_mutex_unlock(eps_stats_m);
+}
+
+int eps_get_channel_stats(eps_stat_channel channel, eps_channel_stats_t *stats)
+{
+    return eps_dev_get_channel_stats(EPS_DEV_DEFAULT, channel, stats);
+}
+
+int eps_dev_get_channel_stats(int dev, eps_stat_channel channel, eps_channel_stats_t *stats)
+{
+    if (dev < 0 || dev >= EPS_DEV_NUM || channel < 0 || channel >= EPS_STAT_NUM || stats == NULL)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(eps_stats_m);
+
+    eps_stats_channel_t *ch = &eps_stats_channels[dev][channel];
+    if (ch->last_ns == 0)
+    {
+        pthread_mutex_unlock(eps_stats_m);
+        return -1;
+    }
+
+    eps_stats_finish(&ch->window, &stats->window);
+    stats->last = ch->last;
+    stats->ewma = ch->ewma;
+    stats->rate = ch->rate;
+    stats->alarms = ch->alarms;
+    stats->raised = ch->raised;
+
+    pthread_mutex_unlock(eps_stats_m);
+
+    return 1;
+}
@@ -2,11 +2,15 @@
 #include "main.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #define MODULE_NAME "eps_test"
 
+#define EPS_TEST_MTU 235 // Bytes per frame for the export test, that of a typical UHF radio.
+
 /*
 Commands available externally:
 Ping
@@ -18,14 +22,6 @@ Set LUP
 Hard Reset
 */
 
-#define EPS_CMD_PING 0
-#define EPS_CMD_REBOOT 1
-#define EPS_CMD_TLUP 2
-#define EPS_CMD_SLUP 3
-#define EPS_CMD_HARDRESET 4
-#define EPS_CMD_GET_HK 5
-#define EPS_CMD_GET_HK_OUT 6
-
 hkparam_t hk[1];
 eps_hk_out_t hkout[1];
 
@@ -145,6 +141,7 @@ void getval_conf_t(eps_config_t *conf)
 
 void *eps_test(void *tid)
 {
+    eps_hk_t hk_full;
     hkparam_t hk;
     eps_hk_out_t hk_out;
     eps_config_t conf[1];
@@ -155,7 +152,7 @@ void *eps_test(void *tid)
 #endif
     while (!done)
     {
-        printf("[p]ing, [k]ill eps, get [h]ousekeeping, [c]onfig, [r]eboot, toggle [l]atchup, [q]uit, get [d]ata log: ");
+        printf("[p]ing, [k]ill eps, get [h]ousekeeping, [c]onfig, [r]eboot, toggle [l]atchup, [s]cheduler stats, telemetry st[a]ts, la[t]ency, e[x]port last hour, [q]uit, get [d]ata log: ");
         c = getchar();
         fflush(stdin);
         printf("\n");
@@ -167,10 +164,19 @@ void *eps_test(void *tid)
             break;
         case 'h':
         case 'H':
-            memset(&hk, 0x0, sizeof(hkparam_t));
-            eps_get_hkparam(&hk);
-            memset(&hk_out, 0x0, sizeof(eps_hk_out_t));
-            eps_get_hk_out(&hk_out);
+            // eps_thread reads housekeeping every cycle; only go to the bus if it has not yet.
+            memset(&hk_full, 0x0, sizeof(eps_hk_t));
+            uint64_t hk_age = 0;
+            if (eps_get_latest_hk(&hk_full, &hk_age) > 0)
+            {
+                printf("Housekeeping from %.1f s ago:\n", hk_age / 1e9);
+            }
+            else
+            {
+                eps_get_hk(&hk_full);
+            }
+            eps_hk_to_hkparam(&hk_full, &hk);
+            eps_hk_to_hk_out(&hk_full, &hk_out);
             print_hk(hk);
             print_hk_out(hk_out);
 
@@ -234,6 +240,169 @@ void *eps_test(void *tid)
             sleep(1);
             eps_hardreset();
             break;
+        case 's':
+        case 'S':
+        {
+            const char *task_names[EPS_TASK_NUM] = {"Housekeeping", "Basic housekeeping", "V/I", "Configuration", "Logging"};
+            eps_sched_task_stats_t stats;
+            eps_sample_policy_t policy;
+            int bursting = 0;
+            eps_get_sample_policy(&policy, &bursting);
+            printf("Sampling: %s, full every %u ms, V/I every %u ms\n", bursting ? "burst" : "quiescent",
+                   bursting ? policy.hk_period_ms : policy.slow_period_ms,
+                   bursting ? policy.burst_period_ms : policy.vi_period_ms);
+            for (int i = 0; i < EPS_TASK_NUM; i++)
+            {
+                if (eps_get_sched_stats(i, &stats) > 0)
+                {
+                    printf("%s: %llu runs, %llu overruns, jitter avg %llu us, max %llu us\n", task_names[i],
+                           (unsigned long long)stats.runs, (unsigned long long)stats.overruns,
+                           (unsigned long long)stats.jitter_avg_ns / 1000, (unsigned long long)stats.jitter_max_ns / 1000);
+                }
+            }
+            const char *op_names[EPS_XPORT_OP_NUM] = {"Watchdog kick", "Get housekeeping"};
+            eps_xport_stats_t xstats;
+            for (int i = 0; i < EPS_XPORT_OP_NUM; i++)
+            {
+                if (eps_get_xport_stats(i, &xstats) > 0 && xstats.count > 0)
+                {
+                    printf("%s: %llu sent in %llu transfers, %llu retries, %llu errors, latency avg %llu us, max %llu us\n",
+                           op_names[i], (unsigned long long)xstats.count, (unsigned long long)xstats.transfers,
+                           (unsigned long long)xstats.retries, (unsigned long long)xstats.errors,
+                           (unsigned long long)xstats.latency_avg_ns / 1000, (unsigned long long)xstats.latency_max_ns / 1000);
+                }
+            }
+            eps_wdt_stats_t wdt;
+            if (eps_get_wdt_stats(&wdt) > 0)
+            {
+                printf("Watchdog: %llu kicks, %llu failures, %llu misses, late max %llu us, interval max %llu ms of %llu s",
+                       (unsigned long long)wdt.kicks, (unsigned long long)wdt.failures, (unsigned long long)wdt.misses,
+                       (unsigned long long)wdt.late_max_ns / 1000, (unsigned long long)wdt.interval_max_ns / 1000000,
+                       (unsigned long long)wdt.timeout_ns / 1000000000ULL);
+                if (wdt.gnd_time_left_min != UINT32_MAX)
+                {
+                    printf(", ground time left min %u s", wdt.gnd_time_left_min);
+                }
+                printf("\n");
+            }
+            dlgr_arena_stats_t arena;
+            if (dlgr_GetArenaStats(&arena) > 0)
+            {
+                printf("Datalogger arena: %zu of %zu bytes, %d of %d modules\n", arena.used, arena.capacity,
+                       arena.modules, arena.maxModules);
+            }
+            break;
+        }
+        case 'a':
+        case 'A':
+        {
+            const char *stat_names[EPS_STAT_NUM] = {"curout[0]", "curout[1]", "curout[2]", "curout[3]", "curout[4]",
+                                                    "curout[5]", "vbatt", "cursun", "cursys", "temp[0]", "temp[1]",
+                                                    "temp[2]", "temp[3]", "temp[4]", "temp[5]"};
+            eps_channel_stats_t stats;
+
+            printf("%-10s %6s %8s %8s %8s %8s %8s %8s %7s\n", "", "count", "min", "max", "mean", "stddev", "average",
+                   "rate/s", "alarms");
+            for (int i = 0; i < EPS_STAT_NUM; i++)
+            {
+                if (eps_get_channel_stats(i, &stats) > 0)
+                {
+                    // The last closed window, the current one until the first closes.
+                    eps_window_stats_t *w = stats.last.count > 0 ? &stats.last : &stats.window;
+                    printf("%-10s %6u %8.0f %8.0f %8.1f %8.1f %8.1f %8.2f %c%c%c %3u\n", stat_names[i], w->count, w->min,
+                           w->max, w->mean, sqrtf(w->var), stats.ewma, stats.rate,
+                           (stats.alarms & EPS_ALARM_LOW) ? 'L' : '-', (stats.alarms & EPS_ALARM_HIGH) ? 'H' : '-',
+                           (stats.alarms & EPS_ALARM_RATE) ? 'R' : '-', stats.raised);
+                }
+            }
+            break;
+        }
+        case 't':
+        case 'T':
+        {
+            const char *cmd_names[EPS_CMD_NUM] = {"ping", "reboot", "tgl_lup", "lup_set", "hardreset", "get_hk",
+                                                  "get_hk_out", "get_hkparam", "battheater_set", "ks_set", "get_conf",
+                                                  "set_conf", "get_conf2", "set_conf2", "reset_counters", "set_heater",
+                                                  "set_pv_auto", "set_pv_volt", "get_hk_2_vi", "get_hk_wdt", "get_hk_2_basic"};
+            const char *task_names[EPS_TASK_NUM] = {"Housekeeping", "Basic housekeeping", "V/I", "Configuration", "Logging"};
+            const char *dlgr_names[DLGR_LAT_NUM] = {"dlgr_LogData", "dlgr_RetrieveData", "dlgr_RetrieveRange", "dlgr write",
+                                                    "dlgr_iter_next"};
+            lat_summary_t lat;
+
+            if (eps_get_cmd_latency(0, &lat) < 0)
+            {
+                printf("Built without latency statistics.\n");
+                break;
+            }
+
+            printf("%-20s %8s %8s %10s %10s %10s\n", "", "calls", "errors", "p50 us", "p99 us", "max us");
+            for (int i = 0; i < EPS_CMD_NUM; i++)
+            {
+                if (eps_get_cmd_latency(i, &lat) > 0 && lat.count > 0)
+                {
+                    printf("eps_%-16s %8llu %8llu %10.1f %10.1f %10.1f\n", cmd_names[i], (unsigned long long)lat.count,
+                           (unsigned long long)lat.errors, lat.p50_ns / 1e3, lat.p99_ns / 1e3, lat.max_ns / 1e3);
+                }
+            }
+            for (int i = 0; i < EPS_TASK_NUM; i++)
+            {
+                if (eps_get_task_latency(i, &lat) > 0 && lat.count > 0)
+                {
+                    printf("%-20s %8llu %8llu %10.1f %10.1f %10.1f\n", task_names[i], (unsigned long long)lat.count,
+                           (unsigned long long)lat.errors, lat.p50_ns / 1e3, lat.p99_ns / 1e3, lat.max_ns / 1e3);
+                }
+            }
+            if (eps_get_wake_latency(&lat) > 0 && lat.count > 0)
+            {
+                printf("%-20s %8llu %8llu %10.1f %10.1f %10.1f\n", "EPS wake-up", (unsigned long long)lat.count,
+                       (unsigned long long)lat.errors, lat.p50_ns / 1e3, lat.p99_ns / 1e3, lat.max_ns / 1e3);
+            }
+            if (eps_get_wdt_latency(&lat) > 0 && lat.count > 0)
+            {
+                printf("%-20s %8llu %8llu %10.1f %10.1f %10.1f\n", "WDT kick", (unsigned long long)lat.count,
+                       (unsigned long long)lat.errors, lat.p50_ns / 1e3, lat.p99_ns / 1e3, lat.max_ns / 1e3);
+            }
+            for (int i = 0; i < DLGR_LAT_NUM; i++)
+            {
+                if (dlgr_GetLatency(i, &lat) > 0 && lat.count > 0)
+                {
+                    printf("%-20s %8llu %8llu %10.1f %10.1f %10.1f\n", dlgr_names[i], (unsigned long long)lat.count,
+                           (unsigned long long)lat.errors, lat.p50_ns / 1e3, lat.p99_ns / 1e3, lat.max_ns / 1e3);
+                }
+            }
+            break;
+        }
+        case 'x':
+        case 'X':
+        {
+            // Cuts the last hour of housekeeping into radio-sized frames and checks them.
+            dlgr_export_t exp;
+            uint8_t frame[EPS_TEST_MTU];
+            struct timespec now;
+            int len, frames = 0, records = 0, bad = 0;
+
+            clock_gettime(CLOCK_REALTIME, &now);
+            uint64_t tEnd = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+            if (dlgr_export_open(&exp, EPS_LOG_HK, tEnd - 3600 * 1000000000ULL, tEnd, sizeof(frame), 0) < 0)
+            {
+                printf("Export failed to start.\n");
+                break;
+            }
+            while ((len = dlgr_export_next(&exp, frame)) > 0)
+            {
+                dlgr_export_header_t header;
+                uint16_t crc;
+                memcpy(&header, frame, sizeof(header));
+                memcpy(&crc, frame + len - DLGR_EXPORT_CRC_SIZE, sizeof(crc));
+                bad += crc != dlgr_crc16(frame, len - DLGR_EXPORT_CRC_SIZE);
+                records += header.numRecords;
+                frames++;
+            }
+            dlgr_export_close(&exp);
+            printf("Exported %d records in %d frames of at most %zu bytes, %d bad CRCs%s.\n", records, frames, sizeof(frame), bad,
+                   len < 0 ? ", stopped by an error" : "");
+            break;
+        }
         case 'q':
         case 'Q':
             printf("main: quitting...");
@@ -243,15 +412,25 @@ void *eps_test(void *tid)
         case 'd':
         case 'D':
             printf("Getting latest data log ... \n");
-            // Logs, retrieves, and prints sample HKing data.
-            char *logOut;
-
-            logOut = malloc(dlgr_QueryMemorySize("eps", 1));
-            dlgr_RetrieveData("eps", logOut, 1);
+            // Retrieves and prints the newest housekeeping record, without allocating.
+            dlgr_iter_t iter;
+            char logOut[DLGR_RECORD_STRIDE(sizeof(eps_hk_t))];
 
-            print_hk(*(hkparam_t *)logOut);
+            if (dlgr_iter_open(&iter, EPS_LOG_HK) > 0 && dlgr_iter_next(&iter, logOut, 1) > 0)
+            {
+                // Retrieved records keep their FBEGIN/FEND delimiters.
+                memcpy(&hk_full, logOut + DLGR_RECORD_DATA_OFFSET, sizeof(eps_hk_t));
+                eps_hk_to_hkparam(&hk_full, &hk);
+                eps_hk_to_hk_out(&hk_full, &hk_out);
+                print_hk(hk);
+                print_hk_out(hk_out);
+            }
+            else
+            {
+                printf("No data logged yet.\n");
+            }
 
-            free(logOut);
+            dlgr_iter_close(&iter);
             done = 1;
         default:
             break;
@@ -0,0 +1,242 @@
+/**
+ * @file eps_xport.c
+ * @author Mit Bailey (mitbailey99@gmail.com)
+ * @brief I2C transport for the EPS thread's periodic transactions.
+ * @version 0.3
+ * @date 2021-03-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "eps_xport.h"
+#include <endian.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// P31u commands, see the NanoPower P31u manual.
+#define EPS_XPORT_CMD_GET_HK 8
+#define EPS_XPORT_CMD_RESET_WDT 16
+#define EPS_XPORT_HK_FULL 0     // eps_hk_t, the argument of EPS_XPORT_CMD_GET_HK
+#define EPS_XPORT_WDT_MAGIC 0x78
+
+#define EPS_XPORT_REPLY_HDR 2 // Every reply starts with the command and an error code.
+
+/**
+ * @brief A run of equally wide fields of a reply, which are big-endian on the bus.
+ *
+ */
+typedef struct
+{
+    uint8_t width; // 1, 2 or 4 bytes.
+    uint8_t count;
+} eps_xport_run_t;
+
+// eps_hk_t, field by field.
+static const eps_xport_run_t eps_xport_hk_layout[] = {
+    {2, 10}, // vboost, vbatt, curin, cursun, cursys, reserved1
+    {2, 6},  // curout
+    {1, 8},  // output
+    {2, 16}, // output_on_delta, output_off_delta
+    {2, 6},  // latchup
+    {4, 2},  // wdt_i2c_time_left, wdt_gnd_time_left
+    {1, 2},  // wdt_csp_pings_left
+    {4, 5},  // counter_wdt_i2c, counter_wdt_gnd, counter_wdt_csp, counter_boot
+    {2, 6},  // temp
+    {1, 3},  // bootcause, battmode, pptmode
+    {2, 1},  // reserved2
+};
+
+/**
+ * @brief A command eps_xport_run knows.
+ *
+ */
+typedef struct
+{
+    uint8_t cmd[2];
+    uint8_t cmd_len;
+    uint16_t reply_len;            // Without EPS_XPORT_REPLY_HDR.
+    const eps_xport_run_t *layout; // NULL for no reply data.
+    int layout_len;
+} eps_xport_cmd_t;
+
+#define EPS_XPORT_LAYOUT(layout) layout, (int)(sizeof(layout) / sizeof((layout)[0]))
+
+static const eps_xport_cmd_t eps_xport_cmds[EPS_XPORT_OP_NUM] = {
+    [EPS_XPORT_OP_RESET_WDT] = {{EPS_XPORT_CMD_RESET_WDT, EPS_XPORT_WDT_MAGIC}, 2, 0, NULL, 0},
+    [EPS_XPORT_OP_GET_HK] = {{EPS_XPORT_CMD_GET_HK, EPS_XPORT_HK_FULL}, 2, sizeof(eps_hk_t), EPS_XPORT_LAYOUT(eps_xport_hk_layout)},
+};
+
+#define EPS_XPORT_MAX_REPLY sizeof(eps_hk_t)
+
+static uint64_t eps_xport_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Converts a reply from bus to host byte order.
+ *
+ */
+static void eps_xport_to_host(uint8_t *data, const eps_xport_run_t *layout, int layout_len)
+{
+    int offset = 0;
+    for (int i = 0; i < layout_len; i++)
+    {
+        for (int j = 0; j < layout[i].count; j++, offset += layout[i].width)
+        {
+            if (layout[i].width == 2)
+            {
+                uint16_t v;
+                memcpy(&v, data + offset, sizeof(v));
+                v = be16toh(v);
+                memcpy(data + offset, &v, sizeof(v));
+            }
+            else if (layout[i].width == 4)
+            {
+                uint32_t v;
+                memcpy(&v, data + offset, sizeof(v));
+                v = be32toh(v);
+                memcpy(data + offset, &v, sizeof(v));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Bytes described by a layout.
+ *
+ */
+static int eps_xport_layout_size(const eps_xport_run_t *layout, int layout_len)
+{
+    int size = 0;
+    for (int i = 0; i < layout_len; i++)
+    {
+        size += layout[i].width * layout[i].count;
+    }
+    return size;
+}
+
+int eps_xport_init(eps_xport_t *xport, int fd, uint16_t addr)
+{
+    pthread_mutex_init(xport->stats_m, NULL);
+    memset(xport->stats, 0x0, sizeof(xport->stats));
+    memset(xport->latency_sum_ns, 0x0, sizeof(xport->latency_sum_ns));
+
+    // The layouts must match the driver's structs, or replies would be misread.
+    for (int i = 0; i < EPS_XPORT_OP_NUM; i++)
+    {
+        if (eps_xport_layout_size(eps_xport_cmds[i].layout, eps_xport_cmds[i].layout_len) != eps_xport_cmds[i].reply_len)
+        {
+            return -1;
+        }
+    }
+
+    unsigned long funcs = 0;
+    if (fd < 0 || ioctl(fd, I2C_FUNCS, &funcs) < 0 || !(funcs & I2C_FUNC_I2C))
+    {
+        return -1;
+    }
+
+    xport->fd = fd;
+    xport->addr = addr;
+
+    return 1;
+}
+
+int eps_xport_run(eps_xport_t *xport, eps_xport_op_id id, void *reply)
+{
+    if (id < 0 || id >= EPS_XPORT_OP_NUM)
+    {
+        return EPS_XPORT_ERR_INVALID;
+    }
+
+    const eps_xport_cmd_t *cmd = &eps_xport_cmds[id];
+    eps_xport_stats_t *stats = &xport->stats[id];
+    uint8_t tx[2];
+    uint8_t rx[EPS_XPORT_REPLY_HDR + EPS_XPORT_MAX_REPLY];
+    int retval = EPS_XPORT_ERR_IO;
+
+    pthread_mutex_lock(xport->stats_m);
+    stats->count++;
+    pthread_mutex_unlock(xport->stats_m);
+
+    for (int attempt = 0; attempt <= EPS_XPORT_RETRIES && retval < 0; attempt++)
+    {
+        if (attempt > 0)
+        {
+            usleep(EPS_XPORT_BACKOFF_US << (attempt - 1));
+        }
+
+        // The command is a write followed by a read of its reply, in one transfer.
+        memcpy(tx, cmd->cmd, cmd->cmd_len);
+        struct i2c_msg msgs[2] = {
+            {.addr = xport->addr, .flags = 0, .len = cmd->cmd_len, .buf = tx},
+            {.addr = xport->addr, .flags = I2C_M_RD, .len = EPS_XPORT_REPLY_HDR + cmd->reply_len, .buf = rx},
+        };
+        struct i2c_rdwr_ioctl_data xfer = {.msgs = msgs, .nmsgs = 2};
+
+        uint64_t start = eps_xport_now_ns();
+        int ret = ioctl(xport->fd, I2C_RDWR, &xfer);
+        uint64_t latency = eps_xport_now_ns() - start;
+
+        if (ret < 0)
+        {
+            retval = EPS_XPORT_ERR_IO;
+        }
+        else if (rx[0] != cmd->cmd[0] || rx[1] != 0)
+        {
+            retval = EPS_XPORT_ERR_REPLY;
+        }
+        else
+        {
+            if (cmd->reply_len > 0)
+            {
+                eps_xport_to_host(rx + EPS_XPORT_REPLY_HDR, cmd->layout, cmd->layout_len);
+                memcpy(reply, rx + EPS_XPORT_REPLY_HDR, cmd->reply_len);
+            }
+            retval = 1;
+        }
+
+        pthread_mutex_lock(xport->stats_m);
+        stats->transfers++;
+        stats->retries += attempt > 0;
+        xport->latency_sum_ns[id] += latency;
+        if (latency > stats->latency_max_ns)
+        {
+            stats->latency_max_ns = latency;
+        }
+        if (retval < 0 && attempt == EPS_XPORT_RETRIES)
+        {
+            stats->errors++;
+        }
+        pthread_mutex_unlock(xport->stats_m);
+    }
+
+    return retval;
+}
+
+int eps_xport_get_stats(eps_xport_t *xport, eps_xport_op_id op, eps_xport_stats_t *stats)
+{
+    if (op < 0 || op >= EPS_XPORT_OP_NUM || stats == NULL)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(xport->stats_m);
+    memcpy(stats, &xport->stats[op], sizeof(eps_xport_stats_t));
+    if (stats->transfers > 0)
+    {
+        stats->latency_avg_ns = xport->latency_sum_ns[op] / stats->transfers;
+    }
+    pthread_mutex_unlock(xport->stats_m);
+
+    return 1;
+}
@@ -8,6 +8,7 @@
  * @copyright Copyright (c) 2020
  * 
  */
+#define _GNU_SOURCE        // pthread_attr_setaffinity_np()
 #define MAIN_PRIVATE       // enable prototypes in main.h and modules in modules.h
 #define DATALOGGER_PRIVATE //
 #include <main.h>
@@ -18,26 +19,18 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#define FBEGIN_SIZE 6
-#define FEND_SIZE 4
-
 int sys_boot_count = -1;
 volatile sig_atomic_t done = 0;
 __thread int sys_status;
 
-char FBEGIN[6] = {'F', 'B', 'E', 'G', 'I', 'N'};
-char FEND[4] = {'F', 'E', 'N', 'D'};
-
-int dlgr_idx = 0;
-datalogger_t *dlgr_settings = NULL;
-char **dlgr_modname = NULL;
-
 /**
  * @brief Main function executed when shflight.out binary is executed
  * 
@@ -45,27 +38,53 @@ char **dlgr_modname = NULL;
  */
 int main(void)
 {
-    // Boot counter
-    sys_boot_count = bootCount(); // Holds bootCount to generate a different log file at every boot
-    if (sys_boot_count < 0)
-    {
-        fprintf(stderr, "Boot count returned negative, fatal error. Exiting.\n");
-        exit(-1);
-    }
     // SIGINT handler register
     struct sigaction saction;
     saction.sa_handler = &catch_sigint;
     sigaction(SIGINT, &saction, NULL);
 
-    // Allocate dlgr_settings enough memory to store settings of all systems, even though
-    // this is unlikely to ever be needed.
-    dlgr_settings = (datalogger_t *)malloc(sizeof(datalogger_t) * num_systems);
-    dlgr_modname = (char **)malloc(sizeof(char*) * num_systems * 20);
-    
+    // Keep every page resident, current and future, so that no thread stalls on a page fault.
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        perror("[Main] mlockall, memory stays pageable");
+    }
+
+    // Allocate all datalogger state for the channels in modules.h; nothing is allocated later.
+    int num_channels = 0;
+    for (int i = 0; i < num_modules; i++)
+    {
+        num_channels += modules[i].num_channels;
+    }
+    dlgr_channel_t channels[num_channels > 0 ? num_channels : 1];
+    for (int i = 0, j = 0; i < num_modules; j += modules[i].num_channels, i++)
+    {
+        if (modules[i].num_channels > 0)
+        {
+            memcpy(&channels[j], modules[i].channels, sizeof(dlgr_channel_t) * modules[i].num_channels);
+        }
+    }
+    if (dlgr_ArenaInit(channels, num_channels) < 0)
+    {
+        fprintf(stderr, "Datalogger arena allocation failed, fatal error. Exiting.\n");
+        exit(-1);
+    }
+
+    // Register every module's channels, so that modules log by handle from the start. This touches
+    // no file: the datalogger thread opens the logs and counts the boot (see: dlgr_Setup), while
+    // the other modules already run.
+    for (int i = 0; i < num_modules; i++)
+    {
+        dlgr_OpenChannels(modules[i].channels, modules[i].num_channels, modules[i].handles);
+    }
+
     // initialize modules
-    for (int i = 0; i < num_init; i++)
+    for (int i = 0; i < num_modules; i++)
     {
-        int val = module_init[i]();
+        if (modules[i].init == NULL)
+        {
+            continue;
+        }
+        int val = modules[i].init();
         if (val < 0)
         {
             sherror("Error in initialization!");
@@ -74,50 +93,51 @@ int main(void)
     }
     printf("Done init modules\n");
 
-    // Initialize datalogger.
-    //printf("Initializing datalogger: %d\n", dlgr_init());
-
     // set up threads
-    int rc[num_systems];                                         // fork-join return codes
-    pthread_t thread[num_systems];                               // thread containers
-    pthread_attr_t attr;                                         // thread attribute
-    int args[num_systems];                                       // thread arguments (thread id in this case, but can be expanded by passing structs etc)
-    void *status;                                                // thread return value
-    pthread_attr_init(&attr);                                    // initialize attribute
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE); // create threads to be joinable
+    int rc[num_modules];             // fork-join return codes
+    pthread_t thread[num_modules];   // thread containers
+    main_thread_t args[num_modules]; // thread arguments (thread id in this case, but can be expanded by passing structs etc)
+    void *status;                    // thread return value
 
-    for (int i = 0; i < num_systems; i++)
+    for (int i = 0; i < num_modules; i++)
     {
-        args[i] = i; // sending a pointer to i to every thread may end up with duplicate thread ids because of access times
-        rc[i] = pthread_create(&thread[i], &attr, module_exec[i], (void *)(&args[i]));
+        if (modules[i].exec == NULL)
+        {
+            continue;
+        }
+        args[i].module = &modules[i];
+        args[i].id = i; // sending a pointer to i to every thread may end up with duplicate thread ids because of access times
+        rc[i] = main_start_thread(&args[i], &thread[i]);
         if (rc[i])
         {
-            printf("[Main] Error: Unable to create thread %d: Errno %d\n", i, errno);
+            printf("[Main] Error: Unable to create thread %s: Errno %d\n", modules[i].name, rc[i]);
             exit(-1);
         }
     }
 
-    pthread_attr_destroy(&attr); // destroy the attribute
-
-    for (int i = 0; i < num_systems; i++)
+    for (int i = 0; i < num_modules; i++)
     {
+        if (modules[i].exec == NULL)
+        {
+            continue;
+        }
         rc[i] = pthread_join(thread[i], &status);
         if (rc[i])
         {
-            printf("[Main] Error: Unable to join thread %d: Errno %d\n", i, errno);
+            printf("[Main] Error: Unable to join thread %s: Errno %d\n", modules[i].name, rc[i]);
             exit(-1);
         }
     }
 
-    // destroy modules
-    for (int i = 0; i < num_destroy; i++)
+    // destroy modules, the datalogger (and its arena) last
+    for (int i = num_modules - 1; i >= 0; i--)
     {
-        module_destroy[i]();
+        if (modules[i].destroy != NULL)
+        {
+            modules[i].destroy();
+        }
     }
 
-    free(dlgr_settings);
-    free(dlgr_modname);
-
     return 0;
 }
 /**
@@ -129,550 +149,166 @@ int main(void)
 void catch_sigint(int sig)
 {
     done = 1;
-    for (int i = 0; i < num_wakeups; i++)
-        pthread_cond_broadcast(wakeups[i]);
+    for (int i = 0; i < num_modules; i++)
+        if (modules[i].wakeup != NULL)
+            pthread_cond_broadcast(modules[i].wakeup);
 }
 /**
- * @brief Prints errors specific to shflight in a fashion similar to perror
+ * @brief Starts a module's thread, joinable, with the module's scheduling attributes.
  * 
- * @param msg Input message to print along with error description
+ * Without the privilege for SCHED_FIFO the thread runs under the default
+ * policy, and on a system without the module's CPUs it may run on any.
+ * 
+ * @param start The module and its thread ID; must outlive the thread.
+ * @param thread Output.
+ * @return int 0 on success, an error number on failure.
  */
-void sherror(const char *msg)
+int main_start_thread(main_thread_t *start, pthread_t *thread)
 {
-    switch (sys_status)
-    {
-    case ERROR_MALLOC:
-        fprintf(stderr, "%s: Error allocating memory\n", msg);
-        break;
-
-    case ERROR_HBRIDGE_INIT:
-        fprintf(stderr, "%s: Error initializing h-bridge\n", msg);
-        break;
-
-    case ERROR_MUX_INIT:
-        fprintf(stderr, "%s: Error initializing mux\n", msg);
-        break;
-
-    case ERROR_CSS_INIT:
-        fprintf(stderr, "%s: Error initializing CSS\n", msg);
-        break;
-
-    case ERROR_FSS_INIT:
-        fprintf(stderr, "%s: Error initializing FSS\n", msg);
-        break;
-
-    case ERROR_FSS_CONFIG:
-        fprintf(stderr, "%s: Error configuring FSS\n", msg);
-        break;
+    const module_t *module = start->module;
+    int use_sched = module->priority > 0;
+    int use_cpus = module->cpus != 0;
+    int rc;
 
-    default:
-        fprintf(stderr, "%s\n", msg);
-        break;
-    }
-}
-
-int bootCount()
-{
-    FILE *fp;
-    int _bootCount = 0;                      // assume 0 boot
-    if (access(BOOTCOUNT_FNAME, F_OK) != -1) // file exists
+    for (;;)
     {
-        fp = fopen(BOOTCOUNT_FNAME, "r+");              // open file for reading
-        int read_bytes = fscanf(fp, "%d", &_bootCount); // read bootcount
-        if (read_bytes < 0)                             // if no bytes were read
-        {
-            perror("File not read"); // indicate error
-            _bootCount = 0;          // reset boot count
-        }
-        fclose(fp); // close
-    }
-    // Update boot file
-    fp = fopen(BOOTCOUNT_FNAME, "w"); // open for writing
-    fprintf(fp, "%d", ++_bootCount);  // write 1
-    fclose(fp);                       // close
-    sync();                           // sync file system
-    return --_bootCount;              // return 0 on first boot, return 1 on second boot etc
-}
-
-// Datalogger functions below.
-
-int dlgr_init(char* moduleName, ssize_t maxLogSize)
-{
-    eprintf("DEBUG: dlgr_init called...");
-
-    if (maxLogSize < 1){
-        // A log must contain at least 1 byte.
-        return ERR_INVALID_INPUT;
-    }
-
-    // Store the moduleName into dlgr_modname[dlgr_idx];
-    dlgr_modname[dlgr_idx] = moduleName;
-
-    // Check if log directory exists. If not, create it.
-    const char directory[] = "log";
-    struct stat sb;
-
-    if (!(stat(directory, &sb) == 0 && S_ISDIR(sb.st_mode)))
-    {
-        mkdir(directory, S_IRUSR | S_IWUSR);
-    }
-
-    // Change our directory to inside the log folder.
-    if (chdir(directory) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    eprintf("DEBUG: Passed log directory check.");
-
-    // Check if moduleName directory exists. If not, create it.
-    if (!(stat(moduleName, &sb) == 0 && S_ISDIR(sb.st_mode))){
-        mkdir(moduleName, S_IRUSR | S_IWUSR);
-    }
-
-    // Change our directory to inside the moduleName folder.
-    if (chdir(moduleName) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    eprintf("DEBUG: Passed moduleName directory check.");
-
-#define MODULE_FNAME_SZ 128
-
-    // Set up module.inf file.
-    FILE *fModuleInf = NULL;
-    const char* moduleFileName = "module.inf";
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE); // create threads to be joinable
+        pthread_attr_setstacksize(&attr, module->stack_size ? module->stack_size : MAIN_STACK_SIZE);
 
-    // To retrieve the maxLogSize as a c-string.
-    char sMaxLogSize[20];
-
-    // If a module.inf file already exists, use its maxLogSize value. 
-    // Otherwise, create one and put in this module's max log size.
-    if (access(moduleFileName, F_OK | R_OK) == 0){
-        fModuleInf = fopen(moduleFileName, "r");
-        if (fModuleInf == NULL){
-            return ERR_MODU_OPEN;
-        }
-        fgets(sMaxLogSize, 20, (FILE *)fModuleInf);
-        dlgr_settings[dlgr_idx].moduleLogSize = atoi(sMaxLogSize);
-        fclose(fModuleInf);
-    } else {
-        fModuleInf = fopen(moduleFileName, "w");
-        if (fModuleInf == NULL){
-            return ERR_MODU_OPEN;
-        }
-        fprintf(fModuleInf, "%d", maxLogSize);
-        dlgr_settings[dlgr_idx].moduleLogSize = maxLogSize;
-        fclose(fModuleInf);
-        sync();
-    }
-
-    eprintf("DEBUG: Passed module.inf check.");
-
-    // Set up index.inf file.
-    FILE *fIndexInf = NULL;
-    const char* indexFileName = "index.inf";
-
-    // To retrieve the index as a c-string.
-    char sIndex[20];
-
-    // If there is no index.inf, then there cannot be any .dat log files either.
-    // If this is the case, we will also need to create an initial 0.dat file.
-    FILE *fDataDat = NULL;
-    const char* dataFileName = "0.dat";
-
-    // If an index.inf exists, grab our last index.
-    // Otherwise, put in 0.
-    if (access(indexFileName, F_OK | R_OK) == 0){
-        fIndexInf = fopen(indexFileName, "r");
-        if (fIndexInf == NULL){
-            return ERR_INDEX_OPEN;
-        }
-        fgets(sIndex, 20, (FILE *)fIndexInf);
-        dlgr_settings[dlgr_idx].logIndex = atoi(sIndex);
-        fclose(fIndexInf);
-    } else {
-        fIndexInf = fopen(indexFileName, "w");
-        if (fIndexInf == NULL){
-            return ERR_INDEX_OPEN;
-        }
-        fprintf(fIndexInf, "0\n");
-        dlgr_settings[dlgr_idx].logIndex = 0;
-        fclose(fIndexInf);
-        sync();
-
-        // Now set up 0.dat. Note that it will be blank until a log is logged.
-        fDataDat = fopen(dataFileName, "wb");
-        if (fDataDat == NULL){
-            return ERR_DATA_OPEN;
-        }
-        fclose(fDataDat);
-        sync();
-    }
-
-    eprintf("DEBUG: Passed index.inf and 0.dat check.");
-
-    // Set up settings.cfg file.
-    FILE *fSettingsCfg = NULL;
-    const char* settingsFileName = "settings.cfg";
-
-    // For the extraction of relevant settings.
-    char sMaxFileSize[20];
-    char sMaxDirSize[20];
-
-    // If settings.cfg exists, update our dlgr_settings.
-    // Otherwise, create a settings.cfg with default settings.
-    if (access(settingsFileName, F_OK | R_OK) == 0){
-        fSettingsCfg = fopen(settingsFileName, "r");
-        if (fSettingsCfg == NULL){
-            return ERR_SETTINGS_OPEN;
-        }
-        if(fgets(sMaxFileSize, 20, (FILE *)fSettingsCfg) == NULL || fgets(sMaxDirSize, 10, (FILE *)fSettingsCfg) == NULL){
-            return ERR_SETTINGS_ACCESS;
-        }
-        dlgr_settings[dlgr_idx].maxFileSize = atoi(sMaxFileSize);
-        dlgr_settings[dlgr_idx].maxDirSize = atoi(sMaxDirSize);
-        fclose(fSettingsCfg);
-    } else {
-        fSettingsCfg = fopen(settingsFileName, "w");
-        if (fSettingsCfg == NULL){
-            return ERR_SETTINGS_OPEN;
+        if (use_sched)
+        {
+            struct sched_param param = {.sched_priority = module->priority};
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &param);
         }
-        fprintf(fSettingsCfg, "8192\n");
-        fprintf(fSettingsCfg, "4194304\n");
-        fclose(fSettingsCfg);
-        sync();
-    }
-
-    eprintf("DEBUG: Passed settings.cfg checks.");
 
-    chdir(".."); // Returns up from moduleName folder to log folder.
-    chdir(".."); // Returns up from log folder to home directory.
-
-    dlgr_idx++;
-
-    eprintf("DEBUG: Reached end of initialization.");
-    return 1;
-}
-
-int dlgr_LogData(char* moduleName, ssize_t size, void *dataIn)
-{
-    eprintf("DEBUG: dlgr_LogData called...");
-
-    // We can find this module's settings via the following.
-    int mod_idx = 0;
-    for(; mod_idx < num_systems; mod_idx++){
-        if (dlgr_modname[mod_idx] == moduleName){
-            break;
+        if (use_cpus)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (int i = 0; i < (int)(8 * sizeof(module->cpus)) && i < CPU_SETSIZE; i++)
+            {
+                if (module->cpus & (1UL << i))
+                {
+                    CPU_SET(i, &cpus);
+                }
+            }
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
         }
-    }
-
-    int moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
-
-    const char directory[] = "log";
-
-    // Change our directory to inside the log folder.
-    if (chdir(directory) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    // Change our directory to inside the moduleName folder.
-    if (chdir(moduleName) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    if (size > moduleLogSize){
-        return ERR_MAXLOGSIZE_EXCEEDED;
-    }
-
-    // Construct n.dat directory.
-    char dataFileName[MODULE_FNAME_SZ] = {0x0, };
-    snprintf(dataFileName, sizeof(dataFileName), "%d.dat", dlgr_settings[mod_idx].logIndex);
-
-    // Construct n+1.dat directory.
-    char dataFileNewName[MODULE_FNAME_SZ] = {0x0, };
-    snprintf(dataFileNewName, sizeof(dataFileNewName), "%d.dat", dlgr_settings[mod_idx].logIndex+1);
-
-    // Open the current data (.dat) file in binary-append mode.
-    FILE *fDataDat = NULL;
-    fDataDat = fopen(dataFileName, "ab");
-    if(fDataDat == NULL){
-        return ERR_DATA_OPEN;
-    }
-
-    // Fetch the current file size.
-    long int fileSize = ftell(fDataDat);
-
-    // If we have to make a new .dat file...
-    FILE *fIndexInf = NULL;
-    const char* indexFileName = "index.inf";
 
-    eprintf("DEBUG: Passed directory checks.");
+        rc = pthread_create(thread, &attr, main_thread_entry, (void *)start);
+        pthread_attr_destroy(&attr); // destroy the attribute
 
-    // Make a new .dat file and iterate the index if necessary.
-    if(fileSize >= dlgr_settings[mod_idx].maxFileSize){
-        fIndexInf = fopen(indexFileName, "w");
-        if (fIndexInf==NULL){
-            return ERR_SETTINGS_OPEN;
+        if (rc == EPERM && use_sched)
+        {
+            fprintf(stderr, "[Main] %s: no permission for SCHED_FIFO, using the default policy\n", module->name);
+            use_sched = 0;
         }
-
-        // Iterate the index.
-        dlgr_settings[mod_idx].logIndex++;
-
-        // Rewrite the index file.
-        fprintf(fIndexInf, "%d\n", dlgr_settings[mod_idx].logIndex);
-        fclose(fDataDat);
-        fclose(fIndexInf);
-        sync();
-
-        // Switch the data pointer to the new data file.
-        fDataDat = fopen(dataFileNewName, "wb");
-        if (fDataDat == NULL){
-            return ERR_DATA_OPEN;
+        else if (rc == EINVAL && use_cpus)
+        {
+            fprintf(stderr, "[Main] %s: CPUs 0x%lx not available, running on any\n", module->name, module->cpus);
+            use_cpus = 0;
         }
-
-        // Delete an old file.
-        char dataFileOldName[MODULE_FNAME_SZ] = {0x0, };
-
-        eprintf("DEBUG: Deleting old file. This is prone to SEGMENTATION FAULTS.");
-        
-        snprintf(dataFileOldName, sizeof(dataFileOldName), "%d.dat", dlgr_settings[mod_idx].logIndex - (dlgr_settings[mod_idx].maxDirSize / dlgr_settings[mod_idx].maxFileSize));
-        if (remove(dataFileOldName) != 0){
-            return ERR_DATA_REMOVE;
+        else
+        {
+            return rc;
         }
-        
-        eprintf("DEBUG: Deleted old file.");
     }
-
-    // Write FBEGIN, the data, and then FEND to the binary .dat file.
-    fwrite(FBEGIN, 6, 1, fDataDat);
-    fwrite(dataIn, sizeof(dataIn), 1, fDataDat);
-
-    // Data padding is size < moduleLogSize.
-    for (; size < moduleLogSize; size += sizeof(0)){
-        fwrite(dataIn, 1, 1, 0);
-    }
-
-    fwrite(FEND, 4, 1, fDataDat);
-
-    fclose(fDataDat);
-    sync();
-
-    chdir(".."); // Returns up from moduleName folder to log folder.
-    chdir(".."); // Returns up from log folder to home directory.
-
-    eprintf("DEBUG: Finished data log.");
-
-    return 1;
 }
-
-// TODO: Bring RetrieveData and all below functions in line with the current
-//       dlgr_settings[] paradigm.
-
-int dlgr_RetrieveData(char *moduleName, char *output, int numRequestedLogs)
+/**
+ * @brief Touches the next MAIN_STACK_PREFAULT bytes of the stack. Kept out of line so they are free again on return.
+ */
+static void __attribute__((noinline)) main_prefault_stack(void)
 {
-    eprintf("dlgr_RetrieveData called...");
-
-    /*
-     * This should return sets of data from the binary .dat files irregardless of what file its in,
-     * for as much as is requested.
-     *
-     */
-
-    // Assume:      The size of every item within a .dat file is the same size. Note that,
-    //              for instance, eps and acs will not have equally sized data.
-    // Consider:    A header at the start of the file containing the size of each item.
-    // Remember:    .dat binary files look like...
-
-    /* FBEGIN
-     * < Some module-specific data of size n >
-     * FEND
-     */
-
-    int numReadLogs = 0;
-    int indexOffset = 0; // How many files back we have to go.
-    int errorCheck = 0;
-
-    while (numReadLogs < numRequestedLogs){
-        errorCheck = dlgr_retrieve(moduleName, output, numRequestedLogs - numReadLogs, indexOffset);
-        if (errorCheck < 0){
-            return errorCheck;
-        }
-        numReadLogs += errorCheck;
-        indexOffset++;
-    }
-
-    if (numReadLogs != numRequestedLogs){
-        return ERR_READ_NUM;
+    volatile char stack[MAIN_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 256)
+    {
+        stack[i] = 0;
     }
-
-    eprintf("DEBUG: Finished data retrieval.");
-
-    return 1;
 }
-
-int dlgr_retrieve(char *moduleName, char *output, int numRequestedLogs, int indexOffset)
+void *main_thread_entry(void *arg)
 {
-    eprintf("DEBUG: dlgr_retrieve called...");
-
-    // We can find this module's settings via the following.
-    int mod_idx = 0;
-    for(; mod_idx < num_systems; mod_idx++){
-        if (dlgr_modname[mod_idx] == moduleName){
-            break;
-        }
-    }
-
-    int moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
-
-    const char directory[] = "log";
-
-    // Change our directory to inside the log folder.
-    if (chdir(directory) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    // Change our directory to inside the moduleName folder.
-    if (chdir(moduleName) < 0){
-        return ERR_CHDIR_FAIL;
-    }
-
-    int numReadLogs = 0;
-
-    // First, construct directories.
-    char dataFileName[MODULE_FNAME_SZ] = {0x0, };
-    snprintf(dataFileName, sizeof(dataFileName), "%d.dat", dlgr_settings[mod_idx].logIndex);
-
-    // Open the .dat file in binary-read mode.
-    FILE *fDataDat = NULL;
-    fDataDat = fopen(dataFileName, "rb");
-    if (fDataDat == NULL){
-        return ERR_DATA_OPEN;
-    }
+    main_thread_t *start = (main_thread_t *)arg;
 
-    // Find the total size of the .dat file.
-    fseek(fDataDat, 0, SEEK_END);
-    ssize_t fileSize = ftell(fDataDat);
-    fseek(fDataDat, 0, SEEK_SET);
+    main_prefault_stack();
 
-    // Create a memory buffer of size fileSize
-    char *buffer = NULL;
-    buffer = malloc(fileSize + 1);
-    if (buffer == NULL){
-        return ERR_MALLOC;
-    }
-
-    // Read the entire file into memory buffer. One byte at a time for sizeof(buffer) bytes.
-    if (fread(buffer, 0x1, fileSize, fDataDat) != 1){
-        return ERR_DATA_READ;
-    }
-
-    // Create a cursor to mark our current position in the buffer. Pull it one structure from the back.
-    char *bufferCursor = buffer + fileSize;
-    bufferCursor -= dlgr_settings[mod_idx].moduleLogSize - FBEGIN_SIZE + FEND_SIZE;
-
-    // If we haven't reached the beginning of the buffer, keep getting structures.
-    while (buffer - bufferCursor != 0 && numReadLogs < numRequestedLogs){
-        // Copies one structure to the output. Contains delimiters and trace amounts of tree nuts.
-        memcpy(output, buffer, moduleLogSize + FBEGIN_SIZE + FEND_SIZE);
-        numReadLogs++;
+    // A worker's start was allocated for it by main_start_worker.
+    if (start->module == NULL)
+    {
+        exec_func exec = start->exec;
+        void *worker_arg = start->arg;
+        free(start);
+        return exec(worker_arg);
     }
 
-    fclose(fDataDat);
-    free(buffer);
-
-    chdir("..");
-    chdir("..");
-
-    eprintf("DEBUG: dlgr_retrieve finished...");
-
-    return numReadLogs;
+    return start->module->exec((void *)&start->id);
 }
-
-ssize_t dlgr_QueryMemorySize(char *moduleName, int numRequestedLogs)
+int main_start_worker(pthread_t *thread, void *(*exec)(void *), void *arg)
 {
-    eprintf("DEBUG: dlgr_QueryMemorySize called...");
-
-    // We can find this module's settings via the following.
-    int mod_idx = 0;
-    for(; mod_idx < num_systems; mod_idx++){
-        if (dlgr_modname[mod_idx] == moduleName){
-            break;
-        }
+    main_thread_t *start = malloc(sizeof(main_thread_t));
+    if (start == NULL)
+    {
+        return ENOMEM;
+    }
+    start->module = NULL;
+    start->id = -1;
+    start->exec = exec;
+    start->arg = arg;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&attr, MAIN_STACK_SIZE);
+    // Not left to the attribute's default: the worker runs at its module's priority.
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+
+    int rc = pthread_create(thread, &attr, main_thread_entry, (void *)start);
+    pthread_attr_destroy(&attr);
+    if (rc)
+    {
+        free(start);
     }
 
-    int moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
-
-    eprintf("DEBUG: dlgr_QueryMemorySize finished.");
-    return numRequestedLogs * (moduleLogSize + FBEGIN_SIZE + FEND_SIZE);
+    return rc;
 }
-
-int dlgr_EditSettings(char *moduleName, int value, int setting)
+/**
+ * @brief Prints errors specific to shflight in a fashion similar to perror
+ * 
+ * @param msg Input message to print along with error description
+ */
+void sherror(const char *msg)
 {
-    eprintf("DEBUG: dlgr_EditSettings called...");
-
-    // We can find this module's settings via the following.
-    int mod_idx = 0;
-    for(; mod_idx < num_systems; mod_idx++){
-        if (dlgr_modname[mod_idx] == moduleName){
-            break;
-        }
-    }
-
-    //int moduleLogSize = dlgr_settings[mod_idx].moduleLogSize;
-
-    const char directory[] = "log";
+    switch (sys_status)
+    {
+    case ERROR_MALLOC:
+        fprintf(stderr, "%s: Error allocating memory\n", msg);
+        break;
 
-    // Change our directory to inside the log folder.
-    if (chdir(directory) < 0){
-        return ERR_CHDIR_FAIL;
-    }
+    case ERROR_HBRIDGE_INIT:
+        fprintf(stderr, "%s: Error initializing h-bridge\n", msg);
+        break;
 
-    // Change our directory to inside the moduleName folder.
-    if (chdir(moduleName) < 0){
-        return ERR_CHDIR_FAIL;
-    }
+    case ERROR_MUX_INIT:
+        fprintf(stderr, "%s: Error initializing mux\n", msg);
+        break;
 
-    switch (setting){
-        case MAX_FILE_SIZE:
-            if (value > SIZE_FILE_HARDLIMIT || value < 1){
-                return ERR_SETTINGS_SET;
-            }
+    case ERROR_CSS_INIT:
+        fprintf(stderr, "%s: Error initializing CSS\n", msg);
+        break;
 
-            dlgr_settings[mod_idx].maxFileSize = value;
-            break;
-        case MAX_DIR_SIZE:
-            if (value > SIZE_DIR_HARDLIMIT || value < 1){
-                return ERR_SETTINGS_SET;
-            }
+    case ERROR_FSS_INIT:
+        fprintf(stderr, "%s: Error initializing FSS\n", msg);
+        break;
 
-            dlgr_settings[mod_idx].maxDirSize = value;
-            break;
-        default:
-            return ERR_DEFAULT_CASE;
-    }
+    case ERROR_FSS_CONFIG:
+        fprintf(stderr, "%s: Error configuring FSS\n", msg);
+        break;
 
-    FILE *fSettingsCfg = NULL;
-    fSettingsCfg = fopen("settings.cfg", "w");
-    if (fSettingsCfg == NULL) {
-        return ERR_SETTINGS_OPEN;
+    default:
+        fprintf(stderr, "%s\n", msg);
+        break;
     }
-
-    fprintf(fSettingsCfg, "%d\n", dlgr_settings[mod_idx].maxFileSize);
-    fprintf(fSettingsCfg, "%d\n", dlgr_settings[mod_idx].maxDirSize);
-
-    fclose(fSettingsCfg);
-    sync();
-
-    chdir("..");
-    chdir("..");
-
-    eprintf("DEBUG: dlgr_EditSettings finished.");
-    return 1;
 }
-
-void dlgr_destroy()
-{
-    eprintf("DEBUG: dlgr_destroy called...");
-    // TODO: Add frees
-    eprintf("DEBUG: dlgr_destroy finished.");
-}
\ No newline at end of file